@@ -0,0 +1,158 @@
+#include "bench_daemon.h"
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+const auto daemon_start_timeout = std::chrono::seconds{5};
+
+namespace dvr {
+	BenchDaemon::BenchDaemon(const BenchEnvironment& env, const std::vector<BenchService>& services, const std::string& log_level, bool default_socket):
+		pid{-1}
+	{
+		char dir_template[] = "/tmp/devoured-bench-XXXXXX";
+		if(!::mkdtemp(dir_template)){
+			return;
+		}
+		directory = dir_template;
+		const std::filesystem::path socket_directory = default_socket ? std::filesystem::path{"/tmp/devoured"} : directory;
+		const std::string socket_name = default_socket ? "default" : "bench";
+		socket = socket_directory / (socket_name + "-" + std::to_string(::getuid()));
+		std::ofstream config{directory / "config.toml"};
+		config<<"[Socket]\n"
+			<<"Path = \""<<socket_directory.string()<<"/\"\n"
+			<<"Name = \""<<socket_name<<"\"\n"
+			<<"[Log]\n"
+			<<"Path = \""<<logFile()<<"\"\n"
+			<<"Level = \""<<log_level<<"\"\n";
+		for(const BenchService& service : services){
+			const std::string exec = service.exec.front() == '/' ? service.exec : env.helpers + "/" + service.exec;
+			config<<"[service."<<service.name<<"]\n"
+				<<"Exec = \""<<exec<<"\"\n"
+				<<"Args = [";
+			for(size_t i = 0; i < service.args.size(); ++i){
+				config<<(i > 0 ? ", " : "")<<"\""<<service.args[i]<<"\"";
+			}
+			config<<"]\n"
+				<<service.settings;
+		}
+		config.close();
+
+		pid = ::fork();
+		if(pid == 0){
+			// The daemon reads config.toml from its working directory
+			if(::chdir(directory.c_str()) == 0){
+				::execl(env.daemon.c_str(), env.daemon.c_str(), "-d", static_cast<char*>(nullptr));
+			}
+			_exit(127);
+		}
+	}
+
+	BenchDaemon::~BenchDaemon(){
+		if(pid > 0){
+			::kill(pid, SIGTERM);
+			int status;
+			::waitpid(pid, &status, 0);
+		}
+		if(!directory.empty()){
+			std::error_code error;
+			std::filesystem::remove_all(directory, error);
+		}
+	}
+
+	std::string BenchDaemon::address() const {
+		return socket.string();
+	}
+
+	std::string BenchDaemon::logFile() const {
+		return (directory / "daemon.log").string();
+	}
+
+	bool BenchDaemon::running() const {
+		return pid > 0;
+	}
+
+	pid_t BenchDaemon::getPID() const {
+		return pid;
+	}
+
+	bool connectBenchDaemon(const BenchDaemon& daemon, const BenchEnvironment& env, Client& client){
+		if(!daemon.running()){
+			std::cerr<<"Couldn't start "<<env.daemon<<std::endl;
+			return false;
+		}
+		const auto give_up = std::chrono::steady_clock::now() + daemon_start_timeout;
+		// Connecting before the socket exists would log an error for every attempt
+		while(!std::filesystem::exists(daemon.address()) || !client.connect(daemon.address())){
+			if(std::chrono::steady_clock::now() > give_up){
+				std::cerr<<"Couldn't connect to "<<daemon.address()<<std::endl;
+				return false;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds{10});
+		}
+		return true;
+	}
+
+	uint64_t daemonCounter(Client& client, const std::string& name){
+		auto metrics = client.request(Devoured::Mode::METRICS, "", "");
+		if(!metrics){
+			return 0;
+		}
+		for(const MessageResponse& resp : *metrics){
+			// "<name> <value>" lines, histograms follow with their summaries
+			std::istringstream ss{resp.content};
+			std::string line;
+			while(std::getline(ss, line)){
+				if(line.size() > name.size() && line.compare(0, name.size(), name) == 0 && line[name.size()] == ' '){
+					return std::strtoull(line.c_str() + name.size() + 1, nullptr, 10);
+				}
+			}
+		}
+		return 0;
+	}
+
+	ProcessUsage processUsage(pid_t pid){
+		ProcessUsage usage{0.0, 0, 0};
+		const std::string proc = "/proc/" + std::to_string(pid);
+
+		// utime and stime are the 14th and 15th field, the name before them may contain spaces
+		std::ifstream stat_file{proc + "/stat"};
+		std::string stat;
+		std::getline(stat_file, stat);
+		const size_t name_end = stat.rfind(')');
+		if(name_end != std::string::npos){
+			std::istringstream ss{stat.substr(name_end + 2)};
+			std::string field;
+			for(size_t i = 3; i < 14 && ss>>field; ++i){}
+			uint64_t user = 0;
+			uint64_t system = 0;
+			if(ss>>user>>system){
+				usage.cpu_us = static_cast<double>(user + system) * 1e6 / static_cast<double>(::sysconf(_SC_CLK_TCK));
+			}
+		}
+
+		std::ifstream status_file{proc + "/status"};
+		std::string line;
+		while(std::getline(status_file, line)){
+			const size_t colon = line.find(':');
+			if(colon == std::string::npos){
+				continue;
+			}
+			const std::string key = line.substr(0, colon);
+			const uint64_t value = std::strtoull(line.c_str() + colon + 1, nullptr, 10);
+			if(key == "VmRSS"){
+				usage.rss_kib = value;
+			}else if(key == "voluntary_ctxt_switches" || key == "nonvoluntary_ctxt_switches"){
+				usage.context_switches += value;
+			}
+		}
+		return usage;
+	}
+}
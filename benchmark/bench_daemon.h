@@ -0,0 +1,71 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "benchmarks.h"
+#include "client/client.h"
+
+namespace dvr {
+	struct BenchService {
+		std::string name;
+		// A helper, or an absolute path
+		std::string exec;
+		std::vector<std::string> args;
+		// Further keys of its table, one per line
+		std::string settings = "";
+	};
+
+	/*
+	 * A daemon in its own directory with the given services, logging
+	 * to a file in it at the given level.
+	 * Stopped with SIGTERM and removed with the directory on destruction.
+	 *
+	 * The socket is in the directory too, unless default_socket is set.
+	 * Then the daemon listens where the client commands connect to,
+	 * /tmp/devoured/default-<uid>.
+	 */
+	class BenchDaemon {
+	private:
+		std::filesystem::path directory;
+		std::filesystem::path socket;
+		pid_t pid;
+	public:
+		BenchDaemon(const BenchEnvironment& env, const std::vector<BenchService>& services, const std::string& log_level = "error", bool default_socket = false);
+		~BenchDaemon();
+
+		BenchDaemon(const BenchDaemon&) = delete;
+		BenchDaemon& operator=(const BenchDaemon&) = delete;
+
+		std::string address() const;
+		std::string logFile() const;
+		bool running() const;
+		pid_t getPID() const;
+	};
+
+	/*
+	 * Waits until the socket of the daemon accepts the client
+	 */
+	bool connectBenchDaemon(const BenchDaemon& daemon, const BenchEnvironment& env, Client& client);
+
+	/*
+	 * Counter of the METRICS response of the daemon, 0 if it is missing
+	 */
+	uint64_t daemonCounter(Client& client, const std::string& name);
+
+	struct ProcessUsage {
+		double cpu_us;
+		// Voluntary and involuntary, a blocking poll wait is one
+		uint64_t context_switches;
+		uint64_t rss_kib;
+	};
+
+	/*
+	 * Usage of a process so far, from /proc
+	 */
+	ProcessUsage processUsage(pid_t pid);
+}
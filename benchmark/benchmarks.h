@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include "report.h"
+
+namespace dvr {
+	struct BenchEnvironment {
+		// Directory of the helper programs used as children
+		std::string helpers;
+		// The daemon binary for the round trip through the control socket
+		std::string daemon;
+		// Samples per measurement
+		size_t iterations;
+	};
+
+	/*
+	 * createProcessStream until it returns and until the child runs, with
+	 * a growing parent RSS. fork copies the page tables of the parent.
+	 */
+	void benchSpawn(const BenchEnvironment& env, BenchReport& report);
+	/*
+	 * From the exit of the child until Service::onExit, on the SIGCHLD path of the daemon
+	 */
+	void benchReap(const BenchEnvironment& env, BenchReport& report);
+	/*
+	 * Output relayed from a child on pipes and on a terminal
+	 */
+	void benchRelay(const BenchEnvironment& env, BenchReport& report);
+	/*
+	 * From a line printed by a child without flushing until it is relayed,
+	 * on a pipe and on a terminal
+	 */
+	void benchLatency(const BenchEnvironment& env, BenchReport& report);
+	/*
+	 * A service which exits right away and is started again after every reap
+	 */
+	void benchRestart(const BenchEnvironment& env, BenchReport& report);
+	/*
+	 * COMMAND sent to a daemon until the reply of the child arrives at an
+	 * attached connection and until the COMMAND response arrives
+	 */
+	void benchCommand(const BenchEnvironment& env, BenchReport& report);
+	/*
+	 * STATUS round trips to an idle daemon and to one relaying a service
+	 * which writes at full speed
+	 */
+	void benchControl(const BenchEnvironment& env, BenchReport& report);
+	/*
+	 * Pipelined STATUS requests per second to daemons logging at the
+	 * levels off, info and debug, with the CPU time, poll wakeups and
+	 * context switches of the daemon per request
+	 */
+	void benchThroughput(const BenchEnvironment& env, BenchReport& report);
+	/*
+	 * Wall clock from exec to exit of the one-shot client commands,
+	 * against /bin/true. Needs the default socket to be free.
+	 */
+	void benchOneShot(const BenchEnvironment& env, BenchReport& report);
+	/*
+	 * 1 to 1000 clients attached to one service writing 256KiB/s, with
+	 * the CPU time and RSS of the daemon per follower count
+	 */
+	void benchFanout(const BenchEnvironment& env, BenchReport& report);
+	/*
+	 * From starting a daemon until the last of six services with startup
+	 * times is ready, started one after another and along their dependencies
+	 */
+	void benchColdStart(const BenchEnvironment& env, BenchReport& report);
+	/*
+	 * CPU time of a daemon running 1000 services probed every second, per
+	 * probe kind and without probes, with the time the probes report
+	 */
+	void benchHealth(const BenchEnvironment& env, BenchReport& report);
+	/*
+	 * Time and line range queries on an OutputStore of 2GiB, and OUTPUT
+	 * requests to a daemon storing the output of a service
+	 */
+	void benchOutput(const BenchEnvironment& env, BenchReport& report);
+	/*
+	 * increment and observe of the metrics on one thread and on several,
+	 * against a counter shared by the threads
+	 */
+	void benchMetrics(const BenchEnvironment& env, BenchReport& report);
+	/*
+	 * Arming, moving, cancelling and expiring 100k timers of a timing
+	 * wheel, against the multimap the scheduler used before
+	 */
+	void benchTimers(const BenchEnvironment& env, BenchReport& report);
+}
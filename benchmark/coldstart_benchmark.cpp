@@ -0,0 +1,87 @@
+#include "benchmarks.h"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench_daemon.h"
+
+const auto coldstart_timeout = std::chrono::seconds{30};
+const auto coldstart_poll_interval = std::chrono::milliseconds{5};
+
+namespace dvr {
+	namespace {
+		struct ColdStartService {
+			std::string name;
+			// Until it prints "<name> ready"
+			std::string startup_seconds;
+			std::vector<std::string> after;
+		};
+
+		BenchService readyService(const ColdStartService& service){
+			std::string settings = "ReadyOutput = \"" + service.name + " ready\"\n";
+			if(!service.after.empty()){
+				settings += "After = [";
+				for(size_t i = 0; i < service.after.size(); ++i){
+					settings += (i > 0 ? ", \"" : "\"") + service.after[i] + "\"";
+				}
+				settings += "]\n";
+			}
+			return {service.name, "ready", {service.startup_seconds, service.name + " ready"}, settings};
+		}
+
+		/*
+		 * Milliseconds from starting the daemon until the log reports last as ready, 0 on failure
+		 */
+		double coldStart(const BenchEnvironment& env, const std::vector<ColdStartService>& services, const std::string& last){
+			std::vector<BenchService> bench_services;
+			for(const ColdStartService& service : services){
+				bench_services.push_back(readyService(service));
+			}
+			const auto begin = std::chrono::steady_clock::now();
+			BenchDaemon daemon{env, bench_services, "info"};
+			if(!daemon.running()){
+				std::cerr<<"Couldn't start "<<env.daemon<<std::endl;
+				return 0.0;
+			}
+			const std::string ready = last + " is ready";
+			while(std::chrono::steady_clock::now() - begin < coldstart_timeout){
+				std::ifstream log{daemon.logFile()};
+				const std::string content{std::istreambuf_iterator<char>{log}, std::istreambuf_iterator<char>{}};
+				if(content.find(ready) != std::string::npos){
+					return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+				}
+				std::this_thread::sleep_for(coldstart_poll_interval);
+			}
+			std::cerr<<last<<" wasn't ready within "<<coldstart_timeout.count()<<"s, see "<<daemon.logFile()<<std::endl;
+			return 0.0;
+		}
+	}
+
+	void benchColdStart(const BenchEnvironment& env, BenchReport& report){
+		// A database and a cache, three APIs using both and a web frontend using the APIs
+		const std::vector<ColdStartService> graph = {
+			{"db", "2", {}},
+			{"cache", "1.5", {}},
+			{"api1", "1", {"db", "cache"}},
+			{"api2", "1", {"db", "cache"}},
+			{"api3", "1", {"db", "cache"}},
+			{"web", "0.5", {"api1", "api2", "api3"}}
+		};
+		// The same services started one by one
+		const std::vector<ColdStartService> chain = {
+			{"db", "2", {}},
+			{"cache", "1.5", {"db"}},
+			{"api1", "1", {"cache"}},
+			{"api2", "1", {"api1"}},
+			{"api3", "1", {"api2"}},
+			{"web", "0.5", {"api3"}}
+		};
+		report.add("coldstart_chain_ms", coldStart(env, chain, "web"));
+		report.add("coldstart_graph_ms", coldStart(env, graph, "web"));
+	}
+}
@@ -0,0 +1,170 @@
+#include "benchmarks.h"
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "bench_daemon.h"
+#include "client/client.h"
+
+// COMMAND responses wait for the quiet period of the daemon, so fewer samples are taken
+const size_t command_iteration_divisor = 4;
+// Until the flood has filled the pipes and the daemon relays at full speed
+const auto flood_warmup = std::chrono::milliseconds{200};
+// STATUS requests in flight on the connection of the throughput benchmark
+const size_t throughput_window = 64;
+const size_t throughput_requests_per_iteration = 100;
+const size_t throughput_rounds = 7;
+
+namespace dvr {
+	namespace {
+		/*
+		 * STATUS round trips in microseconds
+		 */
+		std::vector<double> sampleStatus(Client& client, size_t iterations){
+			std::vector<double> samples;
+			samples.reserve(iterations);
+			for(size_t i = 0; i < iterations; ++i){
+				const auto begin = std::chrono::steady_clock::now();
+				auto status = client.request(Devoured::Mode::STATUS, "", "");
+				if(!status){
+					std::cerr<<"Lost the connection to the daemon"<<std::endl;
+					break;
+				}
+				samples.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count());
+			}
+			return samples;
+		}
+
+		/*
+		 * STATUS requests of target per second, pipelined
+		 */
+		double sampleThroughput(Client& client, const std::string& target, size_t requests){
+			size_t sent = 0;
+			size_t finished = 0;
+			const auto begin = std::chrono::steady_clock::now();
+			while(finished < requests){
+				while(sent < requests && sent - finished < throughput_window){
+					client.send(Devoured::Mode::STATUS, target, "", [&](const MessageResponse&){
+						++finished;
+					});
+					++sent;
+				}
+				if(!client.poll(1000)){
+					std::cerr<<"Lost the connection to the daemon"<<std::endl;
+					return 0.0;
+				}
+			}
+			return static_cast<double>(requests) / std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		}
+	}
+
+	void benchCommand(const BenchEnvironment& env, BenchReport& report){
+		BenchDaemon daemon{env, {{"echo", "echo", {}}}};
+		Client client;
+		if(!connectBenchDaemon(daemon, env, client)){
+			return;
+		}
+
+		// Output of the attached service arrives without a pending request
+		std::string output;
+		client.onUnsolicited([&](const MessageResponse& resp){
+			output += resp.content;
+		});
+		auto attached = client.request(Devoured::Mode::INTERACTIVE, "echo", "");
+		if(!attached || attached->empty() || attached->front().return_code != static_cast<uint8_t>(ReturnCode::OK)){
+			std::cerr<<"Couldn't attach to the echo service"<<std::endl;
+			return;
+		}
+
+		std::vector<double> echo_samples;
+		std::vector<double> response_samples;
+		const size_t iterations = std::max<size_t>(1, env.iterations / command_iteration_divisor);
+		for(size_t i = 0; i < iterations; ++i){
+			const std::string expected = "pong " + std::to_string(i) + "\n";
+			output.clear();
+			bool responded = false;
+			const auto begin = std::chrono::steady_clock::now();
+			std::chrono::steady_clock::time_point echoed;
+			std::chrono::steady_clock::time_point answered;
+			client.send(Devoured::Mode::COMMAND, "echo", "ping " + std::to_string(i), [&](const MessageResponse&){
+				responded = true;
+				answered = std::chrono::steady_clock::now();
+			});
+			bool seen = false;
+			while(!(seen && responded)){
+				if(!client.poll(1000)){
+					std::cerr<<"Lost the connection to the daemon"<<std::endl;
+					return;
+				}
+				if(!seen && output.find(expected) != std::string::npos){
+					seen = true;
+					echoed = std::chrono::steady_clock::now();
+				}
+			}
+			echo_samples.push_back(std::chrono::duration<double, std::micro>(echoed - begin).count());
+			response_samples.push_back(std::chrono::duration<double, std::micro>(answered - begin).count());
+		}
+		report.addSamples("command_echo_us", std::move(echo_samples));
+		report.addSamples("command_response_us", std::move(response_samples));
+	}
+
+	void benchControl(const BenchEnvironment& env, BenchReport& report){
+		{
+			BenchDaemon daemon{env, {{"echo", "echo", {}}}};
+			Client client;
+			if(!connectBenchDaemon(daemon, env, client)){
+				return;
+			}
+			report.addSamples("control_status_idle_us", sampleStatus(client, env.iterations));
+		}
+
+		{
+			// 0 MiB floods until it is stopped
+			BenchDaemon daemon{env, {{"echo", "echo", {}}, {"flood", "flood", {"0"}}}};
+			Client client;
+			if(!connectBenchDaemon(daemon, env, client)){
+				return;
+			}
+			std::this_thread::sleep_for(flood_warmup);
+			report.addSamples("control_status_flood_us", sampleStatus(client, env.iterations));
+		}
+
+		// The relay thread stores the flood, two segments of 1MiB in the directory of the daemon
+		BenchDaemon daemon{env, {{"echo", "echo", {}}, {"flood", "flood", {"0"}, "OutputStore = \"output\"\nOutputSegmentSize = 1\nOutputSegments = 2\n"}}};
+		Client client;
+		if(!connectBenchDaemon(daemon, env, client)){
+			return;
+		}
+		std::this_thread::sleep_for(flood_warmup);
+		report.addSamples("control_status_stored_flood_us", sampleStatus(client, env.iterations));
+	}
+
+	void benchThroughput(const BenchEnvironment& env, BenchReport& report){
+		// Debug records are only compiled into daemons built with scons log_level=0
+		for(const char* level : {"off", "info", "debug"}){
+			BenchDaemon daemon{env, {{"echo", "echo", {}}}, level};
+			Client client;
+			if(!connectBenchDaemon(daemon, env, client)){
+				return;
+			}
+			const ProcessUsage usage_before = processUsage(daemon.getPID());
+			const uint64_t wakeups_before = daemonCounter(client, "epoll_wakeups");
+			std::vector<double> samples;
+			for(size_t i = 0; i < throughput_rounds; ++i){
+				samples.push_back(sampleThroughput(client, "echo", env.iterations * throughput_requests_per_iteration));
+			}
+			const uint64_t wakeups = daemonCounter(client, "epoll_wakeups") - wakeups_before;
+			const ProcessUsage usage = processUsage(daemon.getPID());
+			const std::string name = std::string{"throughput_log_"} + level;
+			report.addSamples(name + "_rps", std::move(samples));
+
+			// The cost of a request to the daemon, to compare the poll backends
+			const double requests = static_cast<double>(throughput_rounds * env.iterations * throughput_requests_per_iteration);
+			report.add(name + "_cpu_per_request_ns", (usage.cpu_us - usage_before.cpu_us) * 1000.0 / requests);
+			report.add(name + "_wakeups_per_1k_requests", static_cast<double>(wakeups) * 1000.0 / requests);
+			report.add(name + "_context_switches_per_1k_requests", static_cast<double>(usage.context_switches - usage_before.context_switches) * 1000.0 / requests);
+		}
+	}
+}
@@ -0,0 +1,83 @@
+#include "benchmarks.h"
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bench_daemon.h"
+#include "client/client.h"
+#include "network/network.h"
+
+const size_t fanout_followers[] = {1, 10, 100, 1000};
+// Output of the followed service, paced like a busy log instead of a flood the daemon can't keep up with
+const size_t fanout_kib_per_s = 256;
+const auto fanout_attach_timeout = std::chrono::seconds{10};
+// Until every follower has received output and the connections are in their steady state
+const auto fanout_warmup = std::chrono::milliseconds{500};
+const auto fanout_window = std::chrono::seconds{2};
+
+namespace dvr {
+	void benchFanout(const BenchEnvironment& env, BenchReport& report){
+		for(size_t count : fanout_followers){
+			BenchDaemon daemon{env, {{"flood", "flood", {"0", std::to_string(fanout_kib_per_s)}}}};
+			Client control;
+			if(!connectBenchDaemon(daemon, env, control)){
+				return;
+			}
+
+			// One poll for all followers, like a monitor following the service in many sessions
+			Network network;
+			std::vector<std::unique_ptr<Client>> followers;
+			size_t attached = 0;
+			size_t received = 0;
+			for(size_t i = 0; i < count; ++i){
+				auto follower = std::make_unique<Client>(network);
+				if(!follower->connect(daemon.address())){
+					std::cerr<<"Couldn't connect follower "<<i<<" to "<<daemon.address()<<std::endl;
+					return;
+				}
+				follower->onUnsolicited([&](const MessageResponse& resp){
+					received += resp.content.size();
+				});
+				follower->send(Devoured::Mode::INTERACTIVE, "flood", "", [&](const MessageResponse& resp){
+					if(resp.return_code == static_cast<uint8_t>(ReturnCode::OK)){
+						++attached;
+					}
+				});
+				followers.push_back(std::move(follower));
+			}
+			const auto give_up = std::chrono::steady_clock::now() + fanout_attach_timeout;
+			while(attached < count){
+				if(std::chrono::steady_clock::now() > give_up){
+					std::cerr<<"Attached "<<attached<<" of "<<count<<" followers"<<std::endl;
+					return;
+				}
+				network.poll(100);
+			}
+
+			auto pollFor = [&](std::chrono::steady_clock::duration duration){
+				const auto end = std::chrono::steady_clock::now() + duration;
+				for(auto now = std::chrono::steady_clock::now(); now < end; now = std::chrono::steady_clock::now()){
+					network.poll(static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(end - now).count()) + 1);
+				}
+			};
+			pollFor(fanout_warmup);
+			const ProcessUsage before = processUsage(daemon.getPID());
+			received = 0;
+			const auto begin = std::chrono::steady_clock::now();
+			pollFor(fanout_window);
+			const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+			const ProcessUsage usage = processUsage(daemon.getPID());
+
+			const double mib = static_cast<double>(received) / (1024.0 * 1024.0);
+			const double cpu_us = usage.cpu_us - before.cpu_us;
+			const std::string name = "fanout_followers" + std::to_string(count);
+			report.add(name + "_delivered_mib_per_s", mib / seconds);
+			report.add(name + "_daemon_cpu_percent", cpu_us / (seconds * 1e4));
+			report.add(name + "_daemon_cpu_per_mib_us", mib > 0.0 ? cpu_us / mib : 0.0);
+			report.add(name + "_daemon_rss_kib", static_cast<double>(usage.rss_kib));
+		}
+	}
+}
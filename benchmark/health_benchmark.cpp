@@ -0,0 +1,69 @@
+#include "benchmarks.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench_daemon.h"
+#include "client/client.h"
+
+const size_t health_services = 1000;
+const auto health_start_timeout = std::chrono::seconds{60};
+// After the last spawn, so the startup doesn't count
+const auto health_warmup = std::chrono::seconds{2};
+const auto health_window = std::chrono::seconds{5};
+
+namespace dvr {
+	void benchHealth(const BenchEnvironment& env, BenchReport& report){
+		// Without a probe the daemon only samples the CPU time of the services
+		for(const std::string probe : {"none", "alive", "state", "command"}){
+			std::string settings;
+			if(probe != "none"){
+				settings = "HealthInterval = 1\nHealthProbe = \"" + probe + "\"\n";
+				if(probe == "command"){
+					settings += "HealthCommand = \"ping health\"\nHealthOutput = \"pong health\"\n";
+				}
+			}
+			std::vector<BenchService> services;
+			for(size_t i = 0; i < health_services; ++i){
+				services.push_back({"echo" + std::to_string(i), "echo", {}, settings});
+			}
+			BenchDaemon daemon{env, services};
+			Client client;
+			if(!connectBenchDaemon(daemon, env, client)){
+				return;
+			}
+			const auto give_up = std::chrono::steady_clock::now() + health_start_timeout;
+			while(daemonCounter(client, "spawns") < health_services){
+				if(std::chrono::steady_clock::now() > give_up){
+					std::cerr<<"Couldn't start "<<health_services<<" services"<<std::endl;
+					return;
+				}
+				std::this_thread::sleep_for(std::chrono::milliseconds{100});
+			}
+			std::this_thread::sleep_for(health_warmup);
+
+			const ProcessUsage usage_before = processUsage(daemon.getPID());
+			const uint64_t probes_before = daemonCounter(client, "health_probes");
+			const uint64_t failures_before = daemonCounter(client, "health_probe_failures");
+			const uint64_t probe_ns_before = daemonCounter(client, "health_probe_ns");
+			const auto begin = std::chrono::steady_clock::now();
+			std::this_thread::sleep_for(health_window);
+			const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+			const ProcessUsage usage = processUsage(daemon.getPID());
+			const uint64_t probes = daemonCounter(client, "health_probes") - probes_before;
+			const uint64_t failures = daemonCounter(client, "health_probe_failures") - failures_before;
+			const uint64_t probe_ns = daemonCounter(client, "health_probe_ns") - probe_ns_before;
+
+			const std::string name = "health_" + probe;
+			report.add(name + "_daemon_cpu_percent", (usage.cpu_us - usage_before.cpu_us) / (seconds * 1e4));
+			if(probe != "none"){
+				report.add(name + "_probes_per_s", static_cast<double>(probes) / seconds);
+				report.add(name + "_probe_failures", static_cast<double>(failures));
+				report.add(name + "_probe_ns_per_second", static_cast<double>(probe_ns) / seconds);
+			}
+		}
+	}
+}
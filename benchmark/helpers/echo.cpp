@@ -0,0 +1,17 @@
+#include <cstdio>
+#include <cstring>
+
+/*
+ * Answers every "ping <token>" line with "pong <token>" right away
+ */
+int main(){
+	char line[4096];
+	while(std::fgets(line, sizeof(line), stdin)){
+		if(std::strncmp(line, "ping ", 5) == 0){
+			std::fputs("pong ", stdout);
+			std::fputs(line + 5, stdout);
+			std::fflush(stdout);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,39 @@
+#include <time.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <vector>
+
+/*
+ * Writes the given number of MiB to stdout as fast as the reader takes them.
+ * 0 writes until it is killed. With a rate in KiB/s blocks of 4KiB are paced to it.
+ */
+int main(int argc, char** argv){
+	const size_t mib = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 64;
+	const size_t kib_per_s = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 0;
+	const size_t block_kib = kib_per_s > 0 ? 4 : 64;
+	std::vector<char> block(block_kib * 1024, 'x');
+	struct ::timespec next;
+	::clock_gettime(CLOCK_MONOTONIC, &next);
+	for(size_t i = 0; mib == 0 || i < 1024 / block_kib * mib; ++i){
+		size_t written = 0;
+		while(written < block.size()){
+			ssize_t n = ::write(STDOUT_FILENO, block.data() + written, block.size() - written);
+			if(n < 0){
+				if(errno == EINTR){
+					continue;
+				}
+				return 1;
+			}
+			written += static_cast<size_t>(n);
+		}
+		if(kib_per_s > 0){
+			next.tv_nsec += static_cast<long>(block_kib * 1000000000 / kib_per_s);
+			next.tv_sec += next.tv_nsec / 1000000000;
+			next.tv_nsec %= 1000000000;
+			while(::clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr) == EINTR){}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,40 @@
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+/*
+ * Writes the given number of MiB to stdout as numbered lines of 100
+ * bytes, as fast as the reader takes them
+ */
+int main(int argc, char** argv){
+	const size_t mib = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 64;
+	const size_t line_size = 100;
+	std::vector<char> block;
+	unsigned long long line = 0;
+	for(size_t total = 0; total < mib * 1024 * 1024;){
+		block.clear();
+		while(block.size() + line_size <= 64 * 1024 && total + block.size() < mib * 1024 * 1024){
+			char text[line_size + 1];
+			const int n = std::snprintf(text, sizeof(text), "line %llu ", ++line);
+			block.insert(block.end(), text, text + n);
+			block.insert(block.end(), line_size - 1 - static_cast<size_t>(n), 'x');
+			block.push_back('\n');
+		}
+		size_t written = 0;
+		while(written < block.size()){
+			ssize_t n = ::write(STDOUT_FILENO, block.data() + written, block.size() - written);
+			if(n < 0){
+				if(errno == EINTR){
+					continue;
+				}
+				return 1;
+			}
+			written += static_cast<size_t>(n);
+		}
+		total += block.size();
+	}
+	return 0;
+}
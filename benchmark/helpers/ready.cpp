@@ -0,0 +1,18 @@
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+
+/*
+ * Prints the given line after the given seconds of startup time and
+ * runs until it is killed, like a service which takes a while to be ready
+ */
+int main(int argc, char** argv){
+	const double seconds = argc > 1 ? std::strtod(argv[1], nullptr) : 1.0;
+	::usleep(static_cast<useconds_t>(seconds * 1e6));
+	std::printf("%s\n", argc > 2 ? argv[2] : "ready");
+	std::fflush(stdout);
+	while(true){
+		::pause();
+	}
+}
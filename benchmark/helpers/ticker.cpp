@@ -0,0 +1,21 @@
+#include <time.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+
+/*
+ * Prints the CLOCK_MONOTONIC nanoseconds every 5ms without flushing, the
+ * given number of lines. stdio buffers by line on a terminal and by block
+ * on a pipe, so the parent sees how long a line waits in the buffer.
+ */
+int main(int argc, char** argv){
+	const long lines = argc > 1 ? std::strtol(argv[1], nullptr, 10) : 400;
+	for(long i = 0; i < lines; ++i){
+		struct ::timespec now;
+		::clock_gettime(CLOCK_MONOTONIC, &now);
+		std::printf("%lld\n", static_cast<long long>(now.tv_sec) * 1000000000LL + now.tv_nsec);
+		::usleep(5000);
+	}
+	return 0;
+}
@@ -0,0 +1,128 @@
+#include <unistd.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "benchmarks.h"
+#include "report.h"
+#include "devoured/signal_handler.h"
+
+/*
+ * devoured-bench [-n iterations] [-d daemon] [-h helper directory] [-p backend,...] [benchmark...]
+ *
+ * Runs the process lifecycle and metrics benchmarks and prints the report to stdout.
+ * Without names all benchmarks run: spawn reap relay latency restart command control throughput oneshot fanout coldstart health output metrics timers.
+ * The daemon and the helpers are looked up next to the binary by default.
+ * With -p epoll,io_uring relay, control and throughput run once per poll
+ * backend, see DVR_POLL_BACKEND, and their results are prefixed with it.
+ */
+int main(int argc, char** argv){
+	const std::filesystem::path self = std::filesystem::read_symlink("/proc/self/exe").parent_path();
+	dvr::BenchEnvironment env{(self / "bench").string(), (self / "devoured").string(), 200};
+
+	std::vector<std::string> backends;
+	int opt;
+	while((opt = ::getopt(argc, argv, "n:d:h:p:")) != -1){
+		switch(opt){
+			case 'n': env.iterations = std::max(1ul, std::strtoul(optarg, nullptr, 10)); break;
+			case 'd': env.daemon = optarg; break;
+			case 'h': env.helpers = optarg; break;
+			case 'p':{
+				std::istringstream list{optarg};
+				std::string backend;
+				while(std::getline(list, backend, ',')){
+					backends.push_back(backend);
+				}
+			}
+			break;
+			default:
+				std::cerr<<"usage: "<<argv[0]<<" [-n iterations] [-d daemon] [-h helper directory] [-p backend,...] [spawn|reap|relay|latency|restart|command|control|throughput|oneshot|fanout|coldstart|health|output|metrics|timers...]"<<std::endl;
+				return 1;
+		}
+	}
+	auto selected = [&](const char* name){
+		if(optind >= argc){
+			return true;
+		}
+		for(int i = optind; i < argc; ++i){
+			if(std::strcmp(argv[i], name) == 0){
+				return true;
+			}
+		}
+		return false;
+	};
+
+	// The poll backend is chosen when a poll is created, by the benchmark and by the daemons it starts
+	auto perBackend = [&](dvr::BenchReport& report, void (*bench)(const dvr::BenchEnvironment&, dvr::BenchReport&)){
+		if(backends.empty()){
+			bench(env, report);
+			return;
+		}
+		for(const std::string& backend : backends){
+			::setenv("DVR_POLL_BACKEND", backend.c_str(), 1);
+			dvr::BenchReport backend_report;
+			bench(env, backend_report);
+			report.append(backend_report, backend + "_");
+		}
+		::unsetenv("DVR_POLL_BACKEND");
+	};
+
+	// The reap benchmark depends on the SIGCHLD handler of the daemon
+	register_signal_handlers();
+
+	dvr::BenchReport report;
+	report.add("iterations", static_cast<double>(env.iterations));
+	// Spawn runs last, it leaves the parent with its largest RSS
+	if(selected("reap")){
+		dvr::benchReap(env, report);
+	}
+	if(selected("relay")){
+		perBackend(report, dvr::benchRelay);
+	}
+	if(selected("latency")){
+		dvr::benchLatency(env, report);
+	}
+	if(selected("restart")){
+		dvr::benchRestart(env, report);
+	}
+	if(selected("command")){
+		dvr::benchCommand(env, report);
+	}
+	if(selected("control")){
+		perBackend(report, dvr::benchControl);
+	}
+	if(selected("throughput")){
+		perBackend(report, dvr::benchThroughput);
+	}
+	if(selected("oneshot")){
+		dvr::benchOneShot(env, report);
+	}
+	if(selected("fanout")){
+		dvr::benchFanout(env, report);
+	}
+	if(selected("coldstart")){
+		dvr::benchColdStart(env, report);
+	}
+	if(selected("health")){
+		dvr::benchHealth(env, report);
+	}
+	if(selected("output")){
+		dvr::benchOutput(env, report);
+	}
+	if(selected("metrics")){
+		dvr::benchMetrics(env, report);
+	}
+	if(selected("timers")){
+		dvr::benchTimers(env, report);
+	}
+	if(selected("spawn")){
+		dvr::benchSpawn(env, report);
+	}
+	report.print(std::cout);
+	return 0;
+}
@@ -0,0 +1,79 @@
+#include "benchmarks.h"
+
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+#include "metrics/metrics.h"
+
+// Calls per thread and sample
+const size_t metrics_calls = 1000000;
+// Threads of the contended runs, each writes to its own shard
+const size_t metrics_threads = 4;
+
+namespace dvr {
+	namespace {
+		/*
+		 * CPU nanoseconds per call of f, averaged over the threads started
+		 * together. Thread CPU time stays comparable with fewer cores than threads.
+		 */
+		template<typename Function>
+		double nsPerCall(size_t threads, Function f){
+			std::atomic<bool> go{false};
+			std::vector<double> cpu_ns(threads);
+			std::vector<std::thread> workers;
+			for(size_t t = 0; t < threads; ++t){
+				workers.emplace_back([&, t]{
+					while(!go.load(std::memory_order_acquire)){
+						std::this_thread::yield();
+					}
+					struct ::timespec begin;
+					struct ::timespec end;
+					::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &begin);
+					for(size_t i = 0; i < metrics_calls; ++i){
+						f(i);
+						// Keeps the loop from being folded into one addition
+						asm volatile("" ::: "memory");
+					}
+					::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+					cpu_ns[t] = static_cast<double>(end.tv_sec - begin.tv_sec) * 1e9 + static_cast<double>(end.tv_nsec - begin.tv_nsec);
+				});
+			}
+			go.store(true, std::memory_order_release);
+			for(std::thread& worker : workers){
+				worker.join();
+			}
+			return std::accumulate(cpu_ns.begin(), cpu_ns.end(), 0.0) / static_cast<double>(threads * metrics_calls);
+		}
+	}
+
+	void benchMetrics(const BenchEnvironment& env, BenchReport& report){
+		// What the shards avoid, a counter shared by all threads
+		std::atomic<uint64_t> shared{0};
+		const size_t samples = std::max<size_t>(1, env.iterations / 20);
+		for(size_t threads : {size_t{1}, metrics_threads}){
+			std::vector<double> increments;
+			std::vector<double> observes;
+			std::vector<double> shared_adds;
+			for(size_t i = 0; i < samples; ++i){
+				increments.push_back(nsPerCall(threads, [](size_t){
+					increment(Counter::EPOLL_EVENTS);
+				}));
+				observes.push_back(nsPerCall(threads, [](size_t i){
+					observe(Histogram::EVENTS_PER_WAKEUP, i & 255);
+				}));
+				shared_adds.push_back(nsPerCall(threads, [&](size_t){
+					shared.fetch_add(1, std::memory_order_relaxed);
+				}));
+			}
+			const std::string suffix = "_threads" + std::to_string(threads) + "_ns";
+			report.addSamples("metrics_increment" + suffix, std::move(increments));
+			report.addSamples("metrics_observe" + suffix, std::move(observes));
+			report.addSamples("metrics_shared_atomic" + suffix, std::move(shared_adds));
+		}
+	}
+}
@@ -0,0 +1,90 @@
+#include "benchmarks.h"
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "bench_daemon.h"
+#include "client/client.h"
+
+extern char** environ;
+
+namespace dvr {
+	namespace {
+		/*
+		 * Wall clock microseconds from spawning args until they were reaped.
+		 * Output goes to /dev/null. Nothing if it couldn't run or failed.
+		 */
+		std::optional<double> runToExit(const std::vector<std::string>& args){
+			std::vector<char*> argv;
+			for(const std::string& arg : args){
+				argv.push_back(const_cast<char*>(arg.c_str()));
+			}
+			argv.push_back(nullptr);
+
+			::posix_spawn_file_actions_t actions;
+			::posix_spawn_file_actions_init(&actions);
+			::posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+			const auto begin = std::chrono::steady_clock::now();
+			pid_t pid;
+			const int error = ::posix_spawn(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+			::posix_spawn_file_actions_destroy(&actions);
+			if(error != 0){
+				return std::nullopt;
+			}
+			int status;
+			if(::waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0){
+				return std::nullopt;
+			}
+			return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+		}
+	}
+
+	void benchOneShot(const BenchEnvironment& env, BenchReport& report){
+		// The client commands only talk to the default socket, which may belong to a real daemon
+		const std::string address = "/tmp/devoured/default-" + std::to_string(::getuid());
+		if(std::filesystem::exists(address)){
+			Client probe;
+			if(probe.connect(address)){
+				std::cerr<<"A daemon listens on "<<address<<", skipping oneshot"<<std::endl;
+				return;
+			}
+		}
+		std::error_code error;
+		std::filesystem::create_directories("/tmp/devoured", error);
+
+		BenchDaemon daemon{env, {{"echo", "echo", {}}}, "error", true};
+		Client client;
+		if(!connectBenchDaemon(daemon, env, client)){
+			return;
+		}
+
+		// STATUS is answered from the status page, METRICS by the daemon through its socket
+		const std::vector<std::pair<std::string, std::vector<std::string>>> commands = {
+			{"oneshot_exec_us", {"/bin/true"}},
+			{"oneshot_status_us", {env.daemon, "-s", "-t", "echo"}},
+			{"oneshot_metrics_us", {env.daemon, "--metrics"}}
+		};
+		for(auto& command : commands){
+			std::vector<double> samples;
+			for(size_t i = 0; i < env.iterations; ++i){
+				auto elapsed = runToExit(command.second);
+				if(!elapsed){
+					std::cerr<<"Couldn't run "<<command.second.front()<<" "<<(command.second.size() > 1 ? command.second[1] : "")<<std::endl;
+					return;
+				}
+				samples.push_back(*elapsed);
+			}
+			report.addSamples(command.first, std::move(samples));
+		}
+	}
+}
@@ -0,0 +1,176 @@
+#include "benchmarks.h"
+
+#include <stdlib.h>
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench_daemon.h"
+#include "client/client.h"
+#include "devoured/output_store.h"
+
+// Filled in the benchmark process, in segments of 256MiB
+const size_t output_store_mib = 2048;
+const size_t output_segment_mib = 256;
+// Output arrives in chunks of 4000 bytes of lines, one chunk per simulated millisecond
+const size_t output_chunk_size = 4000;
+const size_t output_line_size = 100;
+// Time range queries cover 50ms of output, about 200KB
+const auto output_query_window = std::chrono::milliseconds{50};
+// Relayed by a daemon into its store and streamed back with OUTPUT
+const size_t output_stream_mib = 256;
+const auto output_relay_timeout = std::chrono::seconds{60};
+// Until the relay thread has handed the last output to the store
+const auto output_relay_settle = std::chrono::milliseconds{200};
+
+namespace dvr {
+	namespace {
+		double elapsedUs(std::chrono::steady_clock::time_point begin){
+			return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+		}
+
+		/*
+		 * Timing of the queries on a store filled in this process
+		 */
+		void benchStoreQueries(const BenchEnvironment& env, BenchReport& report){
+			char dir_template[] = "/tmp/devoured-bench-XXXXXX";
+			if(!::mkdtemp(dir_template)){
+				return;
+			}
+			const std::filesystem::path directory = dir_template;
+			{
+				OutputStore store;
+				if(!store.open((directory / "output").string(), output_segment_mib * 1024 * 1024, std::chrono::seconds{0}, 0)){
+					std::cerr<<"Couldn't open an OutputStore in "<<directory.string()<<std::endl;
+					std::error_code error;
+					std::filesystem::remove_all(directory, error);
+					return;
+				}
+
+				const size_t chunks = output_store_mib * 1024 * 1024 / output_chunk_size;
+				const auto base = std::chrono::system_clock::now() - std::chrono::milliseconds{static_cast<int64_t>(chunks)};
+				std::vector<uint8_t> chunk;
+				uint64_t line = 0;
+				const auto fill_begin = std::chrono::steady_clock::now();
+				for(size_t i = 0; i < chunks; ++i){
+					chunk.clear();
+					while(chunk.size() < output_chunk_size){
+						char text[output_line_size + 1];
+						const int n = std::snprintf(text, sizeof(text), "line %llu ", static_cast<unsigned long long>(++line));
+						chunk.insert(chunk.end(), text, text + n);
+						chunk.insert(chunk.end(), output_line_size - 1 - static_cast<size_t>(n), 'x');
+						chunk.push_back('\n');
+					}
+					store.append(chunk.data(), chunk.size(), base + std::chrono::milliseconds{static_cast<int64_t>(i)});
+				}
+				store.flush();
+				const double fill_seconds = elapsedUs(fill_begin) / 1e6;
+				report.add("output_store_fill_mib_per_s", static_cast<double>(output_store_mib) / fill_seconds);
+
+				std::mt19937_64 random{1};
+				std::uniform_int_distribution<uint64_t> at_chunk{0, chunks - static_cast<uint64_t>(output_query_window.count()) - 1};
+				std::uniform_int_distribution<uint64_t> at_line{1, line - 2};
+				std::vector<double> time_samples;
+				std::vector<double> line_samples;
+				std::vector<uint8_t> buffer;
+				for(size_t i = 0; i < env.iterations; ++i){
+					const auto from = base + std::chrono::milliseconds{static_cast<int64_t>(at_chunk(random))};
+					buffer.clear();
+					auto begin = std::chrono::steady_clock::now();
+					OutputRange range = store.timeRange(from, from + output_query_window);
+					while(!range.empty()){
+						range.read(buffer, range.size());
+					}
+					time_samples.push_back(elapsedUs(begin));
+
+					const uint64_t first = at_line(random);
+					buffer.clear();
+					begin = std::chrono::steady_clock::now();
+					range = store.lineRange(first, first + 2);
+					while(!range.empty()){
+						range.read(buffer, range.size());
+					}
+					line_samples.push_back(elapsedUs(begin));
+				}
+				report.addSamples("output_time_range_us", std::move(time_samples));
+				report.addSamples("output_line_range_us", std::move(line_samples));
+			}
+			std::error_code error;
+			std::filesystem::remove_all(directory, error);
+		}
+
+		/*
+		 * OUTPUT requests to a daemon which stored the output of a service
+		 */
+		void benchOutputRequests(const BenchEnvironment& env, BenchReport& report){
+			const std::string settings = "OutputStore = \"output\"\nOutputSegmentSize = " + std::to_string(output_segment_mib) + "\n";
+			BenchDaemon daemon{env, {{"lines", "lines", {std::to_string(output_stream_mib)}, settings}}};
+			Client client;
+			if(!connectBenchDaemon(daemon, env, client)){
+				return;
+			}
+			const auto give_up = std::chrono::steady_clock::now() + output_relay_timeout;
+			while(true){
+				auto metrics = client.request(Devoured::Mode::METRICS, "lines", "");
+				uint64_t relayed = 0;
+				if(metrics && !metrics->empty()){
+					std::istringstream ss{metrics->front().content};
+					std::string key;
+					ss>>key>>relayed;
+				}
+				if(relayed >= output_stream_mib * 1024 * 1024){
+					break;
+				}
+				if(std::chrono::steady_clock::now() > give_up){
+					std::cerr<<"The daemon relayed "<<relayed<<" bytes of "<<output_stream_mib<<"MiB"<<std::endl;
+					return;
+				}
+				std::this_thread::sleep_for(std::chrono::milliseconds{50});
+			}
+			std::this_thread::sleep_for(output_relay_settle);
+
+			// Lines around the middle, through the socket and the daemon
+			const uint64_t lines = output_stream_mib * 1024 * 1024 / output_line_size;
+			std::vector<double> samples;
+			for(size_t i = 0; i < env.iterations; ++i){
+				const uint64_t first = lines / 4 + i * (lines / 2 / env.iterations);
+				const auto begin = std::chrono::steady_clock::now();
+				auto resp = client.request(Devoured::Mode::OUTPUT, "lines", "lines " + std::to_string(first) + " " + std::to_string(first + 2));
+				if(!resp || resp->empty() || resp->back().return_code != static_cast<uint8_t>(ReturnCode::OK)){
+					std::cerr<<"Couldn't read lines "<<first<<" to "<<first + 2<<" of the store"<<std::endl;
+					return;
+				}
+				samples.push_back(elapsedUs(begin));
+			}
+			report.addSamples("output_request_lines_us", std::move(samples));
+
+			uint64_t received = 0;
+			bool finished = false;
+			const auto begin = std::chrono::steady_clock::now();
+			client.send(Devoured::Mode::OUTPUT, "lines", "lines 1 -1", [&](const MessageResponse& resp){
+				received += resp.content.size();
+				finished = resp.return_code != static_cast<uint8_t>(ReturnCode::PARTIAL);
+			});
+			while(!finished){
+				if(!client.poll(1000)){
+					std::cerr<<"Lost the connection to the daemon"<<std::endl;
+					return;
+				}
+			}
+			const double seconds = elapsedUs(begin) / 1e6;
+			report.add("output_stream_mib_per_s", static_cast<double>(received) / (1024.0 * 1024.0) / seconds);
+		}
+	}
+
+	void benchOutput(const BenchEnvironment& env, BenchReport& report){
+		benchStoreQueries(env, report);
+		benchOutputRequests(env, report);
+	}
+}
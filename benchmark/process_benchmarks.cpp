@@ -0,0 +1,255 @@
+#include "benchmarks.h"
+
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#include "coro/scheduler.h"
+#include "devoured/process_stream.h"
+#include "devoured/relay_thread.h"
+#include "devoured/service.h"
+#include "devoured/signal_handler.h"
+#include "network/network.h"
+
+// Parent RSS levels of the spawn benchmark
+const size_t spawn_rss_mib[] = {0, 256, 1024};
+const size_t relay_pipe_mib = 1024;
+const size_t relay_terminal_mib = 128;
+// Lines of the ticker, 5ms apart. More than a pipe buffer of stdio holds
+const size_t latency_lines = 400;
+
+namespace dvr {
+	namespace {
+		int64_t monotonicNs(){
+			struct ::timespec now;
+			::clock_gettime(CLOCK_MONOTONIC, &now);
+			return static_cast<int64_t>(now.tv_sec) * 1000000000LL + now.tv_nsec;
+		}
+
+		/*
+		 * Runs a single service the way the daemon does. Output is read by a
+		 * relay thread and delivered from the poll, children are reaped with
+		 * wait4 after SIGCHLD.
+		 */
+		class ServiceLoop final : public IServiceStateObserver, public IServiceOutputObserver {
+		private:
+			EventPoll poll;
+			RelayThread relay_thread;
+			Scheduler scheduler;
+			Service service;
+			bool exited;
+
+			static ServiceConfig makeConfig(const std::string& exec, const std::vector<std::string>& args, bool pty){
+				ServiceConfig config;
+				config.exec = exec;
+				config.args = args;
+				config.pty = pty;
+				return config;
+			}
+
+			void reapChildren(){
+				if(!children_exited()){
+					return;
+				}
+				int status;
+				struct ::rusage usage;
+				pid_t pid;
+				while((pid = ::wait4(-1, &status, WNOHANG, &usage)) > 0){
+					if(pid == service.getPID()){
+						auto cpu = std::chrono::seconds{usage.ru_utime.tv_sec + usage.ru_stime.tv_sec}
+							+ std::chrono::microseconds{usage.ru_utime.tv_usec + usage.ru_stime.tv_usec};
+						service.onExit(status, cpu);
+					}
+				}
+			}
+		public:
+			// First output line of the current run
+			std::string line;
+			// Called with all output, if set
+			std::function<void(const uint8_t*, size_t)> on_output;
+			// CLOCK_MONOTONIC when the exit was noticed
+			int64_t exit_ns;
+
+			ServiceLoop(const std::string& exec, const std::vector<std::string>& args = {}, bool pty = false):
+				relay_thread{poll},
+				service{relay_thread, scheduler, "bench", makeConfig(exec, args, pty), *this},
+				exited{false},
+				exit_ns{0}
+			{
+				service.follow(*this);
+			}
+
+			~ServiceLoop(){
+				service.unfollow(*this);
+			}
+
+			void notify(Service&, Service::State state) override {
+				if(state == Service::State::EXITED || state == Service::State::FAILED){
+					exit_ns = monotonicNs();
+					exited = true;
+				}
+			}
+
+			void notify(Service&, const uint8_t* data, size_t n) override {
+				if(line.empty() || line.back() != '\n'){
+					line.append(reinterpret_cast<const char*>(data), std::min<size_t>(n, 64));
+				}
+				if(on_output){
+					on_output(data, n);
+				}
+			}
+
+			/*
+			 * Starts the service and runs the loop until it exited. Returns
+			 * false if the service couldn't be started.
+			 */
+			bool run(){
+				exited = false;
+				line.clear();
+				if(!service.start()){
+					return false;
+				}
+				while(!exited){
+					poll.poll(scheduler.timeout(1000));
+					reapChildren();
+					scheduler.run();
+				}
+				return service.getState() == Service::State::EXITED;
+			}
+
+			uint64_t relayedBytes() const {
+				return service.relayedBytes();
+			}
+		};
+
+		/*
+		 * Reads the first line of the child's stdout. -1 if it closed it before
+		 */
+		int64_t readTimestamp(int fd){
+			std::string line;
+			::pollfd pfd{fd, POLLIN, 0};
+			char buffer[64];
+			while(line.find('\n') == std::string::npos && ::poll(&pfd, 1, 1000) > 0){
+				ssize_t n = ::read(fd, buffer, sizeof(buffer));
+				if(n <= 0){
+					break;
+				}
+				line.append(buffer, static_cast<size_t>(n));
+			}
+			return line.empty() ? -1 : std::stoll(line);
+		}
+	}
+
+	void benchSpawn(const BenchEnvironment& env, BenchReport& report){
+		const std::string helper = env.helpers + "/exit_now";
+		std::vector<char> ballast;
+		for(size_t rss : spawn_rss_mib){
+			// Touched, so the pages and their page table entries exist
+			ballast.resize(rss * 1024 * 1024);
+			std::memset(ballast.data(), 1, ballast.size());
+
+			std::vector<double> call_samples;
+			std::vector<double> exec_samples;
+			for(size_t i = 0; i < env.iterations; ++i){
+				const int64_t begin = monotonicNs();
+				auto process = createProcessStream(helper);
+				const int64_t returned = monotonicNs();
+				if(!process){
+					std::cerr<<"Couldn't spawn "<<helper<<std::endl;
+					return;
+				}
+				const int64_t started = readTimestamp(process->getFD()[1]);
+				int status;
+				::waitpid(process->getPID(), &status, 0);
+				call_samples.push_back(static_cast<double>(returned - begin) / 1000.0);
+				if(started > 0){
+					exec_samples.push_back(static_cast<double>(started - begin) / 1000.0);
+				}
+			}
+			const std::string level = "rss" + std::to_string(rss) + "mib";
+			report.addSamples("spawn_" + level + "_us", std::move(call_samples));
+			report.addSamples("spawn_exec_" + level + "_us", std::move(exec_samples));
+		}
+	}
+
+	void benchReap(const BenchEnvironment& env, BenchReport& report){
+		ServiceLoop loop{env.helpers + "/exit_now"};
+		std::vector<double> samples;
+		for(size_t i = 0; i < env.iterations; ++i){
+			if(!loop.run()){
+				std::cerr<<"Couldn't run "<<env.helpers<<"/exit_now"<<std::endl;
+				return;
+			}
+			// The helper exits right after printing its start time
+			if(!loop.line.empty()){
+				samples.push_back(static_cast<double>(loop.exit_ns - std::stoll(loop.line)) / 1000.0);
+			}
+		}
+		report.addSamples("reap_us", std::move(samples));
+	}
+
+	void benchRelay(const BenchEnvironment& env, BenchReport& report){
+		for(bool pty : {false, true}){
+			const size_t mib = pty ? relay_terminal_mib : relay_pipe_mib;
+			ServiceLoop loop{env.helpers + "/flood", {std::to_string(mib)}, pty};
+			const int64_t begin = monotonicNs();
+			if(!loop.run()){
+				std::cerr<<"Couldn't run "<<env.helpers<<"/flood"<<std::endl;
+				return;
+			}
+			const double seconds = static_cast<double>(loop.exit_ns - begin) / 1e9;
+			const double relayed = static_cast<double>(loop.relayedBytes()) / (1024.0 * 1024.0);
+			report.add(pty ? "relay_terminal_mib_per_s" : "relay_pipe_mib_per_s", relayed / seconds);
+		}
+	}
+
+	void benchLatency(const BenchEnvironment& env, BenchReport& report){
+		for(bool pty : {false, true}){
+			ServiceLoop loop{env.helpers + "/ticker", {std::to_string(latency_lines)}, pty};
+			std::vector<double> samples;
+			std::string pending;
+			loop.on_output = [&](const uint8_t* data, size_t n){
+				const int64_t now = monotonicNs();
+				pending.append(reinterpret_cast<const char*>(data), n);
+				size_t end;
+				while((end = pending.find('\n')) != std::string::npos){
+					// A terminal ends the lines with \r\n, stoll stops at the \r
+					if(end > 1){
+						samples.push_back(static_cast<double>(now - std::stoll(pending.substr(0, end))) / 1000.0);
+					}
+					pending.erase(0, end + 1);
+				}
+			};
+			if(!loop.run()){
+				std::cerr<<"Couldn't run "<<env.helpers<<"/ticker"<<std::endl;
+				return;
+			}
+			report.addSamples(pty ? "latency_terminal_us" : "latency_pipe_us", std::move(samples));
+		}
+	}
+
+	void benchRestart(const BenchEnvironment& env, BenchReport& report){
+		ServiceLoop loop{env.helpers + "/exit_now"};
+		std::vector<double> samples;
+		const int64_t begin = monotonicNs();
+		for(size_t i = 0; i < env.iterations; ++i){
+			const int64_t start = monotonicNs();
+			if(!loop.run()){
+				std::cerr<<"Couldn't run "<<env.helpers<<"/exit_now"<<std::endl;
+				return;
+			}
+			samples.push_back(static_cast<double>(loop.exit_ns - start) / 1000.0);
+		}
+		const double seconds = static_cast<double>(monotonicNs() - begin) / 1e9;
+		report.addSamples("restart_cycle_us", std::move(samples));
+		report.add("restarts_per_s", static_cast<double>(env.iterations) / seconds);
+	}
+}
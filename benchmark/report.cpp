@@ -0,0 +1,42 @@
+#include "report.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <numeric>
+
+namespace dvr {
+	void BenchReport::add(const std::string& name, double value){
+		values.emplace_back(name, value);
+	}
+
+	void BenchReport::addSamples(const std::string& name, std::vector<double> samples){
+		if(samples.empty()){
+			return;
+		}
+		std::sort(samples.begin(), samples.end());
+		auto quantile = [&](double q){
+			return samples[std::min(samples.size() - 1, static_cast<size_t>(q * static_cast<double>(samples.size())))];
+		};
+		// "spawn_us" -> "spawn" and "_us"
+		const size_t unit = name.rfind('_');
+		const std::string base = unit == std::string::npos ? name : name.substr(0, unit);
+		const std::string suffix = unit == std::string::npos ? "" : name.substr(unit);
+		add(base + "_p50" + suffix, quantile(0.5));
+		add(base + "_p99" + suffix, quantile(0.99));
+		add(base + "_mean" + suffix, std::accumulate(samples.begin(), samples.end(), 0.0) / static_cast<double>(samples.size()));
+	}
+
+	void BenchReport::append(const BenchReport& other, const std::string& prefix){
+		for(auto& entry : other.values){
+			add(prefix + entry.first, entry.second);
+		}
+	}
+
+	void BenchReport::print(std::ostream& stream) const {
+		stream<<std::fixed<<std::setprecision(1);
+		for(auto& entry : values){
+			stream<<entry.first<<" "<<entry.second<<"\n";
+		}
+		stream.flush();
+	}
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dvr {
+	/*
+	 * Results of one benchmark run. Printed as "<name> <value>" lines in the
+	 * order they were added, so two reports can be compared line by line, see
+	 * tools/benchcompare.py. The unit is the suffix of the name.
+	 */
+	class BenchReport {
+	private:
+		std::vector<std::pair<std::string, double>> values;
+	public:
+		void add(const std::string& name, double value);
+		/*
+		 * Adds <name>_p50, <name>_p99 and <name>_mean. Names end with the unit,
+		 * e.g. "spawn_us" becomes "spawn_p50_us".
+		 */
+		void addSamples(const std::string& name, std::vector<double> samples);
+		/*
+		 * Adds the values of other with prefix before their names, e.g. for
+		 * runs of the same benchmarks with another poll backend
+		 */
+		void append(const BenchReport& other, const std::string& prefix);
+
+		void print(std::ostream& stream) const;
+	};
+}
@@ -0,0 +1,139 @@
+#include "benchmarks.h"
+
+#include <time.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "coro/timing_wheel.h"
+
+// Armed at once, like deadlines and health intervals of thousands of services
+const size_t timer_count = 100000;
+// Deadlines of the arm, rearm and cancel runs, spread over all levels of the wheel
+const auto timer_max_deadline = std::chrono::minutes{10};
+// Deadlines of the expiry run, the wheel advances once per millisecond until then
+const auto timer_max_expiry = std::chrono::seconds{10};
+
+namespace dvr {
+	namespace {
+		class BenchTimer final : public TimingWheel::Entry {
+		public:
+			size_t& expired;
+
+			BenchTimer(size_t& e):
+				expired{e}
+			{}
+
+			void onExpiry() override {
+				++expired;
+			}
+		};
+
+		int64_t threadCpuNs(){
+			struct ::timespec now;
+			::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+			return static_cast<int64_t>(now.tv_sec) * 1000000000LL + now.tv_nsec;
+		}
+
+		/*
+		 * CPU nanoseconds of f divided by the number of timers
+		 */
+		template<typename Function>
+		double nsPerTimer(Function f){
+			const int64_t begin = threadCpuNs();
+			f();
+			return static_cast<double>(threadCpuNs() - begin) / static_cast<double>(timer_count);
+		}
+	}
+
+	void benchTimers(const BenchEnvironment& env, BenchReport& report){
+		std::mt19937_64 random{1};
+		std::uniform_int_distribution<int64_t> spread{1, std::chrono::duration_cast<std::chrono::milliseconds>(timer_max_deadline).count()};
+		std::uniform_int_distribution<int64_t> soon{1, std::chrono::duration_cast<std::chrono::milliseconds>(timer_max_expiry).count()};
+
+		std::vector<double> arms;
+		std::vector<double> rearms;
+		std::vector<double> cancels;
+		std::vector<double> expiries;
+		std::vector<double> tree_inserts;
+		std::vector<double> tree_erases;
+		const size_t samples = std::max<size_t>(1, env.iterations / 20);
+		for(size_t i = 0; i < samples; ++i){
+			TimingWheel wheel;
+			const TimingWheel::Clock::time_point base = TimingWheel::Clock::now();
+			size_t expired = 0;
+			std::vector<std::unique_ptr<BenchTimer>> timers;
+			timers.reserve(timer_count);
+			for(size_t t = 0; t < timer_count; ++t){
+				timers.push_back(std::make_unique<BenchTimer>(expired));
+			}
+			std::vector<TimingWheel::Clock::time_point> deadlines(timer_count);
+			auto spreadDeadlines = [&](std::uniform_int_distribution<int64_t>& distribution){
+				for(auto& deadline : deadlines){
+					deadline = base + std::chrono::milliseconds{distribution(random)};
+				}
+			};
+
+			spreadDeadlines(spread);
+			arms.push_back(nsPerTimer([&]{
+				for(size_t t = 0; t < timer_count; ++t){
+					wheel.arm(*timers[t], deadlines[t]);
+				}
+			}));
+			// Armed timers move, like a health interval started again after each probe
+			spreadDeadlines(spread);
+			rearms.push_back(nsPerTimer([&]{
+				for(size_t t = 0; t < timer_count; ++t){
+					wheel.arm(*timers[t], deadlines[t]);
+				}
+			}));
+			cancels.push_back(nsPerTimer([&]{
+				for(auto& timer : timers){
+					wheel.cancel(*timer);
+				}
+			}));
+
+			// The clock is simulated, a run takes the CPU time of the wheel instead of 10 seconds
+			spreadDeadlines(soon);
+			for(size_t t = 0; t < timer_count; ++t){
+				wheel.arm(*timers[t], deadlines[t]);
+			}
+			expiries.push_back(nsPerTimer([&]{
+				for(auto now = base; wheel.size() > 0; now += std::chrono::milliseconds{1}){
+					wheel.advance(now);
+				}
+			}));
+			if(expired != timer_count){
+				std::cerr<<"Expired "<<expired<<" of "<<timer_count<<" timers"<<std::endl;
+				return;
+			}
+
+			// What the scheduler kept its timers in before the wheel
+			std::multimap<TimingWheel::Clock::time_point, BenchTimer*> tree;
+			std::vector<std::multimap<TimingWheel::Clock::time_point, BenchTimer*>::iterator> positions;
+			positions.reserve(timer_count);
+			spreadDeadlines(spread);
+			tree_inserts.push_back(nsPerTimer([&]{
+				for(size_t t = 0; t < timer_count; ++t){
+					positions.push_back(tree.emplace(deadlines[t], timers[t].get()));
+				}
+			}));
+			tree_erases.push_back(nsPerTimer([&]{
+				for(auto position : positions){
+					tree.erase(position);
+				}
+			}));
+		}
+		report.addSamples("timers_arm_ns", std::move(arms));
+		report.addSamples("timers_rearm_ns", std::move(rearms));
+		report.addSamples("timers_cancel_ns", std::move(cancels));
+		report.addSamples("timers_expire_ns", std::move(expiries));
+		report.addSamples("timers_multimap_insert_ns", std::move(tree_inserts));
+		report.addSamples("timers_multimap_erase_ns", std::move(tree_erases));
+	}
+}
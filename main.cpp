@@ -3,6 +3,7 @@
 
 #include "devoured/process_stream.h"
 #include "devoured/devoured.h"
+#include "devoured/oneshot.h"
 
 /*
 	Even though I know that copy on write is implemented for linux when executing fork
@@ -11,7 +12,11 @@
 */
 
 int main(int argc, char** argv){
-
+	// Single requests don't need the option parser and the event loop
+	auto oneshot_status = dvr::runOneShot(argc, argv);
+	if(oneshot_status.has_value()){
+		return *oneshot_status;
+	}
 
 	//createContext always creates a valid pointer
 	std::unique_ptr<dvr::Devoured> devoured = dvr::createContext(argc,argv);
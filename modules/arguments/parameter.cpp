@@ -9,11 +9,25 @@ namespace dvr {
 		options.add_options()
 			("i,interactive", "open interactive", cxxopts::value<bool>(params.interactive))
 			("s,status", "shows status", cxxopts::value<bool>(params.status))
+			("metrics", "shows daemon metrics", cxxopts::value<bool>(params.metrics))
+			("trace", "dumps the trace of the daemon", cxxopts::value<bool>(params.trace))
+			("subscribe", "prints pushed service events: \"state exit match <pattern>\"", cxxopts::value<std::optional<std::string>>(params.subscribe))
+			("output", "prints the stored output of the target between two times: from,to as unix seconds, HH:MM[:SS] of today or YYYY-MM-DD HH:MM[:SS]", cxxopts::value<std::optional<std::string>>(params.output))
+			("lines", "prints stored lines of the target: first,last counted from 1, negative from the end", cxxopts::value<std::optional<std::string>>(params.lines))
+			("b,batch", "sends the requests of a file, - reads stdin", cxxopts::value<std::optional<std::string>>(params.batch))
+			("tagged", "prints batch results prefixed with their line as they arrive", cxxopts::value<bool>(params.tagged))
+			("r,run", "runs the test jobs of a manifest, - reads stdin", cxxopts::value<std::optional<std::string>>(params.run))
+			("jobs", "test jobs running at once, 0 is one per core", cxxopts::value<unsigned>(params.jobs)->default_value("0"))
+			("replay", "replays a recorded session against a new instance and compares its output", cxxopts::value<std::optional<std::string>>(params.replay))
+			("speed", "replay speed, 1 is real time and 0 as fast as possible", cxxopts::value<double>(params.speed)->default_value("0"))
 			("c,command", "sends a command", cxxopts::value<std::optional<std::string>>(params.command))
 			("a,alias", "an aliased command", cxxopts::value<std::optional<std::string>>(params.alias))
 			("d,devour", "wrap a binary and execute it", cxxopts::value<bool>(params.devour))
 			("t,target", "name of the session", cxxopts::value<std::optional<std::string>>(params.target))
-			("n,new", "create a new devoured session", cxxopts::value<bool>(params.spawn))
+			("daemons", "queries several daemons at once: socket,socket,...", cxxopts::value<std::optional<std::string>>(params.daemons))
+			("timeout", "milliseconds every daemon has to answer", cxxopts::value<unsigned>(params.timeout)->default_value("1000"))
+			("n,new", "creates the target from a service table file, - reads stdin", cxxopts::value<std::optional<std::string>>(params.spawn))
+			("destroy", "stops and removes the target and its instances", cxxopts::value<bool>(params.destroy))
 		;
 
 		return options;
@@ -30,6 +44,38 @@ namespace dvr {
 			++counter;
 			config.mode = Parameter::Mode::STATUS;
 		}
+		if(config.metrics){
+			++counter;
+			config.mode = Parameter::Mode::METRICS;
+		}
+		if(config.trace){
+			++counter;
+			config.mode = Parameter::Mode::TRACE;
+		}
+		if(config.subscribe.has_value()){
+			++counter;
+			config.mode = Parameter::Mode::SUBSCRIBE;
+		}
+		if(config.output.has_value()){
+			++counter;
+			config.mode = Parameter::Mode::OUTPUT;
+		}
+		if(config.lines.has_value()){
+			++counter;
+			config.mode = Parameter::Mode::OUTPUT;
+		}
+		if(config.batch.has_value()){
+			++counter;
+			config.mode = Parameter::Mode::BATCH;
+		}
+		if(config.run.has_value()){
+			++counter;
+			config.mode = Parameter::Mode::RUN;
+		}
+		if(config.replay.has_value()){
+			++counter;
+			config.mode = Parameter::Mode::REPLAY;
+		}
 		if(config.command.has_value()){
 			++counter;
 			config.mode = Parameter::Mode::COMMAND;
@@ -38,6 +84,14 @@ namespace dvr {
 			++counter;
 			config.mode = Parameter::Mode::ALIAS;
 		}
+		if(config.spawn.has_value()){
+			++counter;
+			config.mode = Parameter::Mode::CREATE;
+		}
+		if(config.destroy){
+			++counter;
+			config.mode = Parameter::Mode::DESTROY;
+		}
 		if(config.devour){
 			++counter;
 			config.mode = Parameter::Mode::DAEMON;
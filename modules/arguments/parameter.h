@@ -18,7 +18,15 @@ namespace dvr {
 			ALIAS,
 			CREATE,
 			DESTROY,
-			MANAGE
+			MANAGE,
+			RESIZE,
+			METRICS,
+			TRACE,
+			SUBSCRIBE,
+			OUTPUT,
+			BATCH,
+			RUN,
+			REPLAY
 		};
 
 		//CONFIG VALUES
@@ -28,12 +36,32 @@ namespace dvr {
 
 		bool interactive;
 		bool status;
+		bool metrics;
+		bool trace;
+		std::optional<std::string> subscribe;
+		// "<from>,<to>" times of the stored output, either may be empty
+		std::optional<std::string> output;
+		// "<first>,<last>" lines of the stored output, either may be empty
+		std::optional<std::string> lines;
+		std::optional<std::string> batch;
+		bool tagged;
+		std::optional<std::string> run;
+		unsigned jobs;
+		std::optional<std::string> replay;
+		// 1 replays in real time, 0 as fast as possible
+		double speed;
 		std::optional<std::string> alias;
 		std::optional<std::string> command;
 		bool devour;
-		bool spawn;
+		// Service table of the target to create, - reads stdin
+		std::optional<std::string> spawn;
+		bool destroy;
 
 		std::optional<std::string> target;
+		// Comma separated control sockets of several daemons
+		std::optional<std::string> daemons;
+		// Milliseconds every daemon has to answer
+		unsigned timeout;
 	};
 
 	const Parameter parseParams(int argc, char** argv);
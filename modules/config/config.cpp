@@ -3,6 +3,7 @@
 #include <cpptoml.h>
 
 #include <filesystem>
+#include <sstream>
 
 namespace dvr{
 
@@ -13,6 +14,49 @@ namespace dvr{
 		std::filesystem::path full_path{c_iloc.string() + c_name.string()};
 	}
 
+	ServiceConfig parseServiceConfig(const std::string& name, const std::shared_ptr<cpptoml::table>& table){
+		ServiceConfig service;
+		service.exec = table->get_as<std::string>("Exec").value_or(name);
+		service.args = table->get_array_of<std::string>("Args").value_or(service.args);
+		service.autostart = table->get_as<bool>("Autostart").value_or(service.autostart);
+		service.pty = table->get_as<bool>("Pty").value_or(service.pty);
+		service.rows = static_cast<uint16_t>(table->get_as<int64_t>("Rows").value_or(service.rows));
+		service.columns = static_cast<uint16_t>(table->get_as<int64_t>("Columns").value_or(service.columns));
+		service.time_limit = static_cast<uint32_t>(table->get_as<int64_t>("TimeLimit").value_or(service.time_limit));
+		service.cpu_limit = static_cast<uint32_t>(table->get_as<int64_t>("CpuLimit").value_or(service.cpu_limit));
+		service.stop_timeout = static_cast<uint32_t>(table->get_as<int64_t>("StopTimeout").value_or(service.stop_timeout));
+		service.stop_commands = table->get_array_of<std::string>("StopCommands").value_or(service.stop_commands);
+		service.stop_output = table->get_as<std::string>("StopOutput").value_or(service.stop_output);
+		service.stop_command_timeout = static_cast<uint32_t>(table->get_as<int64_t>("StopCommandTimeout").value_or(service.stop_command_timeout));
+		service.after = table->get_array_of<std::string>("After").value_or(service.after);
+		service.ready_output = table->get_as<std::string>("ReadyOutput").value_or(service.ready_output);
+		service.ready_delay = static_cast<uint32_t>(table->get_as<int64_t>("ReadyDelay").value_or(service.ready_delay));
+		service.ready_timeout = static_cast<uint32_t>(table->get_as<int64_t>("ReadyTimeout").value_or(service.ready_timeout));
+		service.cpus = table->get_as<std::string>("Cpus").value_or(service.cpus);
+		if(auto nice = table->get_as<int64_t>("Nice")){
+			service.nice = static_cast<int32_t>(*nice);
+		}
+		service.scheduler = table->get_as<std::string>("Scheduler").value_or(service.scheduler);
+		service.io_priority = table->get_as<std::string>("IoPriority").value_or(service.io_priority);
+		if(auto oom_score_adj = table->get_as<int64_t>("OomScoreAdj")){
+			service.oom_score_adj = static_cast<int32_t>(*oom_score_adj);
+		}
+		service.health_interval = static_cast<uint32_t>(table->get_as<int64_t>("HealthInterval").value_or(service.health_interval));
+		service.health_probe = table->get_as<std::string>("HealthProbe").value_or(service.health_probe);
+		service.health_command = table->get_as<std::string>("HealthCommand").value_or(service.health_command);
+		service.health_output = table->get_as<std::string>("HealthOutput").value_or(service.health_output);
+		service.health_timeout = static_cast<uint32_t>(table->get_as<int64_t>("HealthTimeout").value_or(service.health_timeout));
+		service.health_retries = static_cast<uint32_t>(table->get_as<int64_t>("HealthRetries").value_or(service.health_retries));
+		service.restart = table->get_as<std::string>("Restart").value_or(service.restart);
+		service.restart_delay = static_cast<uint32_t>(table->get_as<int64_t>("RestartDelay").value_or(service.restart_delay));
+		service.record = table->get_as<std::string>("Record").value_or(service.record);
+		service.output_store = table->get_as<std::string>("OutputStore").value_or(service.output_store);
+		service.output_segment_size = static_cast<uint32_t>(table->get_as<int64_t>("OutputSegmentSize").value_or(service.output_segment_size));
+		service.output_segment_age = static_cast<uint32_t>(table->get_as<int64_t>("OutputSegmentAge").value_or(service.output_segment_age));
+		service.output_segments = static_cast<uint32_t>(table->get_as<int64_t>("OutputSegments").value_or(service.output_segments));
+		return service;
+	}
+
 	const Config parseConfig(const std::string& path){
 		Config config;
 		std::filesystem::path config_path{path};
@@ -27,6 +71,52 @@ namespace dvr{
 			config.control_name = table->get_as<std::string>("Name").value_or(config.control_name);
 			config.control_iloc = table->get_as<std::string>("Path").value_or(config.control_iloc);
 		}
+		{
+			auto table = toml_table->get_table("Log");
+			if(table){
+				config.log_path = table->get_as<std::string>("Path").value_or(config.log_path);
+				config.log_level = table->get_as<std::string>("Level").value_or(config.log_level);
+			}
+		}
+		{
+			auto table = toml_table->get_table("Shutdown");
+			if(table){
+				config.shutdown_timeout = static_cast<uint32_t>(table->get_as<int64_t>("Timeout").value_or(config.shutdown_timeout));
+			}
+		}
+		{
+			auto table = toml_table->get_table("service");
+			if(table){
+				for(auto& entry : *table){
+					if(!entry.second->is_table()){
+						continue;
+					}
+					config.services.insert(std::make_pair(entry.first, parseServiceConfig(entry.first, entry.second->as_table())));
+				}
+			}
+		}
 		return config;
 	}
+
+	std::optional<ServiceTemplate> parseServiceTemplate(const std::string& name, const std::string& table, std::string& error){
+		const size_t first = table.find_first_not_of(" \t\r\n");
+		const bool inline_table = first != std::string::npos && table[first] == '{';
+		std::shared_ptr<cpptoml::table> toml_table;
+		try {
+			std::istringstream stream{inline_table ? "service = " + table : table};
+			cpptoml::parser parser{stream};
+			toml_table = parser.parse();
+		}catch(const cpptoml::parse_exception& e){
+			error = e.what();
+			return std::nullopt;
+		}
+		if(inline_table){
+			toml_table = toml_table->get_table("service");
+		}
+
+		ServiceTemplate service_template;
+		service_template.config = parseServiceConfig(name, toml_table);
+		service_template.instances = static_cast<uint32_t>(toml_table->get_as<int64_t>("Instances").value_or(service_template.instances));
+		return service_template;
+	}
 }
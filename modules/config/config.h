@@ -1,15 +1,123 @@
 #pragma once
 
+#include <cstdint>
+#include <map>
+#include <optional>
 #include <string>
+#include <vector>
 
 namespace dvr {
+	struct ServiceConfig {
+		std::string exec;
+		std::vector<std::string> args;
+
+		// Start the service when the daemon starts
+		bool autostart = true;
+
+		// Run the service on a pseudo terminal instead of pipes
+		bool pty = false;
+		uint16_t rows = 24;
+		uint16_t columns = 80;
+
+		// Seconds until the service is stopped. 0 is unlimited
+		uint32_t time_limit = 0;
+		// CPU seconds of one run, enforced by the kernel with RLIMIT_CPU. 0 is unlimited
+		uint32_t cpu_limit = 0;
+		// Seconds between SIGTERM and SIGKILL when stopping the service
+		uint32_t stop_timeout = 5;
+		// Lines written to stdin before SIGTERM when the daemon shuts down, e.g. "save" and "exit"
+		std::vector<std::string> stop_commands;
+		// After the stop commands SIGTERM follows once a line contains this or the service exited. Empty waits for the exit
+		std::string stop_output;
+		// Seconds to wait for the stop output or the exit after the stop commands
+		uint32_t stop_command_timeout = 10;
+
+		// Services which have to be ready before this one is started
+		std::vector<std::string> after;
+		// Ready once an output line contains this. Empty is ready when started
+		std::string ready_output;
+		// Milliseconds after the start or the ready output until the service counts as ready
+		uint32_t ready_delay = 0;
+		// Seconds to wait for the ready output. Dependents aren't started afterwards
+		uint32_t ready_timeout = 60;
+
+		// Applied before the exec. Unset keeps the value of the daemon
+		// CPUs the service may run on, a list like "0-3,6" or a hex mask like "0xf"
+		std::string cpus;
+		std::optional<int32_t> nice;
+		// "other", "batch" or "idle"
+		std::string scheduler;
+		// "idle", "best-effort" or "realtime" with an optional level 0-7, e.g. "best-effort:7"
+		std::string io_priority;
+		// -1000 to 1000. Lowering it needs CAP_SYS_RESOURCE
+		std::optional<int32_t> oom_score_adj;
+
+		// Seconds between health probes of the running service. 0 disables them
+		uint32_t health_interval = 0;
+		// "alive", "state" (not stuck in D or T) or "command"
+		std::string health_probe = "alive";
+		// Written to stdin by the command probe. The probe passes once a line contains health_output
+		std::string health_command;
+		std::string health_output;
+		// Seconds the command probe waits for health_output
+		uint32_t health_timeout = 5;
+		// Failed probes in a row until the service is unhealthy and stopped
+		uint32_t health_retries = 3;
+
+		// "no", "on-failure" (non zero exit, signal or unhealthy) or "always"
+		std::string restart = "no";
+		// Seconds between the exit and the restart
+		uint32_t restart_delay = 1;
+
+		// Records stdin and the output of every run to this file for "devoured --replay". Overwritten by each start
+		std::string record;
+
+		// Directory of a segmented store of the output, queried with "devoured --output". Empty stores nothing
+		std::string output_store;
+		// MiB after which a segment is closed at the next line end
+		uint32_t output_segment_size = 64;
+		// Seconds after which a segment is closed at the next line end. 0 is unlimited
+		uint32_t output_segment_age = 3600;
+		// Newest segments kept, older ones are deleted. 0 keeps all
+		uint32_t output_segments = 0;
+	};
+
 	struct Config {
 		//Flag to set/check invalid config
 		int valid = 0;
 
 		std::string control_iloc = "/tmp/devoured/";
 		std::string control_name = "default";
+
+		// "stdout", "stderr" or a file path
+		std::string log_path = "stdout";
+		// "debug", "info", "warning", "error" or "off"
+		std::string log_level = "info";
+
+		// Seconds all services together get to stop on SIGINT or SIGTERM. Afterwards they are killed
+		uint32_t shutdown_timeout = 30;
+
+		/*
+		 * Key - Service name from [service.<name>]
+		 */
+		std::map<std::string, ServiceConfig> services;
 	};
 
 	const Config parseConfig(const std::string& path);
+
+	/*
+	 * Service table of a CREATE request, with the keys of [service.<name>]
+	 */
+	struct ServiceTemplate {
+		ServiceConfig config;
+		// More than 1 creates <name>-0 to <name>-<instances - 1>
+		uint32_t instances = 1;
+	};
+
+	/*
+	 * The table is a TOML document or an inline table like
+	 * {Exec = "sleep", Args = ["60"], Instances = 100}. Returns std::nullopt
+	 * and sets error if it isn't valid TOML.
+	 */
+	std::optional<ServiceTemplate> parseServiceTemplate(const std::string& name, const std::string& table, std::string& error);
 }
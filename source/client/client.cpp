@@ -0,0 +1,197 @@
+#include "client.h"
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+namespace dvr {
+	Client::Client():
+		owned_network{std::make_unique<Network>()},
+		network{*owned_network},
+		connection{nullptr},
+		next_request_id{0},
+		unsolicited_handler{nullptr}
+	{}
+
+	Client::Client(Network& shared_network):
+		owned_network{nullptr},
+		network{shared_network},
+		connection{nullptr},
+		next_request_id{0},
+		unsolicited_handler{nullptr}
+	{}
+
+	void Client::notify(Connection& conn, ConnectionState state){
+		switch(state){
+			case ConnectionState::ReadReady:{
+				for(auto opt_msg = asyncReadResponse(conn); opt_msg.has_value(); opt_msg = asyncReadResponse(conn)){
+					const MessageResponse& resp = *opt_msg;
+					auto find = pending.find(resp.request_id);
+					if(find == pending.end()){
+						if(unsolicited_handler){
+							unsolicited_handler(resp);
+						}
+						continue;
+					}
+					// The handler may send further requests and invalidate the iterator
+					ResponseHandler handler = find->second;
+					if(resp.return_code != static_cast<uint8_t>(ReturnCode::PARTIAL)){
+						pending.erase(find);
+					}
+					handler(resp);
+				}
+			}
+			break;
+			case ConnectionState::Broken:
+			case ConnectionState::WriteReady:
+			break;
+		}
+	}
+
+	bool Client::connect(const std::string& address){
+		connection = network.connect(address, *this);
+		return connected();
+	}
+
+	bool Client::connected() const {
+		return connection && !connection->broken();
+	}
+
+	std::optional<uint16_t> Client::send(Devoured::Mode type, const std::string& target, const std::string& content, ResponseHandler handler){
+		if(!connected()){
+			return std::nullopt;
+		}
+		// Skip ids of unfinished requests and the id of pushed events
+		uint16_t id = next_request_id;
+		while(id == event_request_id || pending.count(id) > 0){
+			++id;
+			if(id == next_request_id){
+				return std::nullopt;
+			}
+		}
+		next_request_id = id + 1;
+
+		MessageRequest msg{
+			id,
+			static_cast<uint8_t>(type),
+			target,
+			content
+		};
+		if(!asyncWriteRequest(*connection, msg)){
+			return std::nullopt;
+		}
+		if(handler){
+			pending.insert(std::make_pair(id, std::move(handler)));
+		}
+		return id;
+	}
+
+	void Client::onUnsolicited(ResponseHandler handler){
+		unsolicited_handler = std::move(handler);
+	}
+
+	bool Client::poll(int timeout_ms){
+		if(!connected()){
+			return false;
+		}
+		network.poll(timeout_ms);
+		return connected();
+	}
+
+	bool Client::wait(){
+		while(!pending.empty()){
+			if(!poll()){
+				return false;
+			}
+		}
+		return true;
+	}
+
+	size_t Client::pendingRequests() const {
+		return pending.size();
+	}
+
+	std::optional<std::vector<MessageResponse>> Client::request(Devoured::Mode type, const std::string& target, const std::string& content){
+		std::vector<MessageResponse> responses;
+		bool finished = false;
+		auto id = send(type, target, content, [&responses, &finished](const MessageResponse& resp){
+			responses.push_back(resp);
+			finished = resp.return_code != static_cast<uint8_t>(ReturnCode::PARTIAL);
+		});
+		if(!id.has_value()){
+			return std::nullopt;
+		}
+		while(!finished){
+			if(!poll()){
+				pending.erase(*id);
+				return std::nullopt;
+			}
+		}
+		return responses;
+	}
+
+	std::optional<std::vector<MessageResponse>> blockingRequest(const std::string& address, const MessageRequest& request, int timeout_ms){
+		std::vector<uint8_t> buffer;
+		struct ::sockaddr_un sock_addr;
+		if(!serializeMessageRequest(buffer, request) || address.size() >= sizeof(sock_addr.sun_path)){
+			return std::nullopt;
+		}
+
+		int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if(fd < 0){
+			return std::nullopt;
+		}
+		// Closes the socket on every return
+		std::unique_ptr<int, void(*)(int*)> guard{&fd, [](int* f){ ::close(*f); }};
+
+		// Unix sockets apply the send timeout to connect as well
+		struct ::timeval timeout;
+		timeout.tv_sec = timeout_ms / 1000;
+		timeout.tv_usec = (timeout_ms % 1000) * 1000;
+		::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+		::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+		std::memset(&sock_addr, 0, sizeof(sock_addr));
+		sock_addr.sun_family = AF_UNIX;
+		std::strncpy(sock_addr.sun_path, address.c_str(), sizeof(sock_addr.sun_path) - 1);
+		if(::connect(fd, reinterpret_cast<struct ::sockaddr*>(&sock_addr), sizeof(sock_addr)) != 0){
+			return std::nullopt;
+		}
+
+		for(size_t written = 0; written < buffer.size();){
+			ssize_t n = ::send(fd, buffer.data() + written, buffer.size() - written, MSG_NOSIGNAL);
+			if(n < 0 && errno != EINTR){
+				return std::nullopt;
+			}
+			written += n > 0 ? static_cast<size_t>(n) : 0;
+		}
+
+		std::vector<MessageResponse> responses;
+		std::vector<uint8_t> read_buffer;
+		uint8_t chunk[4096];
+		while(true){
+			MessageResponse resp;
+			while(deserializeMessageResponse(read_buffer, resp)){
+				if(resp.request_id != request.request_id){
+					continue;
+				}
+				responses.push_back(resp);
+				if(resp.return_code != static_cast<uint8_t>(ReturnCode::PARTIAL)){
+					return responses;
+				}
+			}
+			ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+			if(n < 0 && errno == EINTR){
+				continue;
+			}
+			if(n <= 0){
+				return std::nullopt;
+			}
+			read_buffer.insert(read_buffer.end(), chunk, chunk + n);
+		}
+	}
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "devoured/devoured.h"
+#include "network/network.h"
+#include "network/protocol.h"
+
+namespace dvr {
+	/*
+	 * Sends requests to the daemon over one connection. Requests are
+	 * pipelined, responses are passed to the handler of their request.
+	 * A request is finished with its first response which isn't PARTIAL.
+	 *
+	 * Client client;
+	 * client.connect("/tmp/devoured/default-1000");
+	 * client.send(Devoured::Mode::STATUS, "", "", [](const MessageResponse& resp){ ... });
+	 * client.wait();
+	 *
+	 * Clients may share one Network, e.g. to talk to several daemons at once.
+	 * The owner of a shared Network polls it instead of the clients.
+	 */
+	class Client final : public IConnectionStateObserver {
+	public:
+		typedef std::function<void(const MessageResponse&)> ResponseHandler;
+	private:
+		std::unique_ptr<Network> owned_network;
+		Network& network;
+
+		std::unique_ptr<Connection> connection;
+
+		uint16_t next_request_id;
+		/*
+		 * Key - Request ID
+		 * Value - Handler of its responses
+		 */
+		std::map<uint16_t, ResponseHandler> pending;
+
+		// Responses without a pending request, like subscription events
+		ResponseHandler unsolicited_handler;
+	public:
+		Client();
+		explicit Client(Network& shared_network);
+
+		void notify(Connection& conn, ConnectionState state) override;
+
+		bool connect(const std::string& address);
+		bool connected() const;
+
+		/*
+		 * Queues the request and returns its id. Without a handler no
+		 * response is expected, e.g. for RESIZE.
+		 */
+		std::optional<uint16_t> send(Devoured::Mode type, const std::string& target, const std::string& content, ResponseHandler handler = nullptr);
+
+		void onUnsolicited(ResponseHandler handler);
+
+		/*
+		 * Handles the responses arriving within timeout_ms.
+		 * Returns false if the connection is broken.
+		 */
+		bool poll(int timeout_ms = -1);
+		/*
+		 * Polls until all sent requests are finished. Returns false if the
+		 * connection broke before.
+		 */
+		bool wait();
+
+		size_t pendingRequests() const;
+
+		/*
+		 * Sends a single request and waits for all of its responses
+		 */
+		std::optional<std::vector<MessageResponse>> request(Devoured::Mode type, const std::string& target, const std::string& content);
+	};
+
+	/*
+	 * Sends a single request without an event loop. Connects, writes and
+	 * reads blocking, each step limited to timeout_ms. Meant for one-shot
+	 * invocations where creating the epoll instance dominates.
+	 * Returns std::nullopt if the daemon isn't reachable or doesn't answer in time.
+	 */
+	std::optional<std::vector<MessageResponse>> blockingRequest(const std::string& address, const MessageRequest& request, int timeout_ms);
+}
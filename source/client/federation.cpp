@@ -0,0 +1,72 @@
+#include "federation.h"
+
+#include <memory>
+
+#include "client.h"
+
+namespace dvr {
+	const char* daemonStatusName(DaemonResult::Status status){
+		switch(status){
+			case DaemonResult::Status::OK: return "ok";
+			case DaemonResult::Status::UNREACHABLE: return "unreachable";
+			case DaemonResult::Status::TIMEOUT: return "timeout";
+			case DaemonResult::Status::BROKEN: return "broken";
+		}
+		return "unknown";
+	}
+
+	std::vector<DaemonResult> federatedRequest(const std::vector<std::string>& addresses, Devoured::Mode type, const std::string& target, const std::string& content, std::chrono::milliseconds timeout){
+		const auto begin = std::chrono::steady_clock::now();
+		const auto deadline = begin + timeout;
+
+		Network network;
+		std::vector<DaemonResult> results;
+		// Same index as results. nullptr once the daemon is done
+		std::vector<std::unique_ptr<Client>> clients;
+		size_t outstanding = 0;
+
+		for(size_t i = 0; i < addresses.size(); ++i){
+			results.push_back(DaemonResult{addresses[i], DaemonResult::Status::UNREACHABLE, {}, std::chrono::microseconds{0}});
+			clients.push_back(std::make_unique<Client>(network));
+			if(!clients[i]->connect(addresses[i])){
+				clients[i].reset();
+				continue;
+			}
+			auto sent = clients[i]->send(type, target, content, [&results, &outstanding, i, begin](const MessageResponse& resp){
+				results[i].responses.push_back(resp);
+				if(resp.return_code != static_cast<uint8_t>(ReturnCode::PARTIAL)){
+					results[i].status = DaemonResult::Status::OK;
+					results[i].latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin);
+					--outstanding;
+				}
+			});
+			if(!sent.has_value()){
+				clients[i].reset();
+				continue;
+			}
+			results[i].status = DaemonResult::Status::TIMEOUT;
+			++outstanding;
+		}
+
+		while(outstanding > 0){
+			auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+			if(remaining <= 0){
+				break;
+			}
+			network.poll(static_cast<int>(remaining));
+			for(size_t i = 0; i < clients.size(); ++i){
+				if(!clients[i]){
+					continue;
+				}
+				if(results[i].status == DaemonResult::Status::OK){
+					clients[i].reset();
+				}else if(!clients[i]->connected()){
+					results[i].status = DaemonResult::Status::BROKEN;
+					clients[i].reset();
+					--outstanding;
+				}
+			}
+		}
+		return results;
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "devoured/devoured.h"
+#include "network/protocol.h"
+
+namespace dvr {
+	struct DaemonResult {
+		enum class Status : uint8_t {
+			// All responses arrived
+			OK,
+			// Connecting or sending failed
+			UNREACHABLE,
+			// No final response within the timeout
+			TIMEOUT,
+			// The connection broke before the final response
+			BROKEN
+		};
+
+		std::string address;
+		Status status;
+		std::vector<MessageResponse> responses;
+		// Until the final response
+		std::chrono::microseconds latency;
+	};
+
+	const char* daemonStatusName(DaemonResult::Status status);
+
+	/*
+	 * Sends the same request to several daemons at once over one event poll.
+	 * Every daemon has timeout to answer, counted from the start, so a slow
+	 * or stopped daemon delays the whole query by at most timeout.
+	 * The results are in the order of the addresses.
+	 */
+	std::vector<DaemonResult> federatedRequest(const std::vector<std::string>& addresses, Devoured::Mode type, const std::string& target, const std::string& content, std::chrono::milliseconds timeout);
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <optional>
+
+#include "network/network.h"
+#include "network/protocol.h"
+#include "scheduler.h"
+
+namespace dvr {
+	/*
+	 * Awaitables on a Connection. The owner of the connection observer has to
+	 * call scheduler.wake(connection.id()) on every notification and once
+	 * more before the connection is destroyed. After a failed await the
+	 * connection must not be used anymore.
+	 */
+
+	/*
+	 * Resumes with true when the write queue is empty, false if the connection broke
+	 */
+	class WriteAwaiter final : public Scheduler::Waiter {
+	private:
+		Scheduler& scheduler;
+		Connection& connection;
+		bool ok;
+	public:
+		WriteAwaiter(Scheduler& s, Connection& conn):
+			scheduler{s},
+			connection{conn},
+			ok{true}
+		{}
+
+		bool ready() override {
+			ok = !connection.broken();
+			return !ok || !connection.hasWriteQueued();
+		}
+
+		bool await_ready(){
+			return ready();
+		}
+		void await_suspend(std::coroutine_handle<> h){
+			handle = h;
+			scheduler.wait(connection.id(), *this);
+		}
+		bool await_resume() noexcept {
+			return ok;
+		}
+	};
+
+	inline WriteAwaiter written(Scheduler& scheduler, Connection& connection){
+		return WriteAwaiter{scheduler, connection};
+	}
+
+	/*
+	 * Resumes with the next message or std::nullopt if the connection broke.
+	 * Only for connections whose owner doesn't read the messages itself.
+	 */
+	template<typename Message, std::optional<Message>(*Read)(Connection&)>
+	class ReadAwaiter final : public Scheduler::Waiter {
+	private:
+		Scheduler& scheduler;
+		Connection& connection;
+		std::optional<Message> message;
+	public:
+		ReadAwaiter(Scheduler& s, Connection& conn):
+			scheduler{s},
+			connection{conn}
+		{}
+
+		bool ready() override {
+			message = Read(connection);
+			return message.has_value() || connection.broken();
+		}
+
+		bool await_ready(){
+			return ready();
+		}
+		void await_suspend(std::coroutine_handle<> h){
+			handle = h;
+			scheduler.wait(connection.id(), *this);
+		}
+		std::optional<Message> await_resume(){
+			return std::move(message);
+		}
+	};
+
+	inline ReadAwaiter<MessageRequest, asyncReadRequest> readRequest(Scheduler& scheduler, Connection& connection){
+		return ReadAwaiter<MessageRequest, asyncReadRequest>{scheduler, connection};
+	}
+
+	inline ReadAwaiter<MessageResponse, asyncReadResponse> readResponse(Scheduler& scheduler, Connection& connection){
+		return ReadAwaiter<MessageResponse, asyncReadResponse>{scheduler, connection};
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <coroutine>
+#include <vector>
+
+#include "scheduler.h"
+
+namespace dvr {
+	/*
+	 * Set once with a result. Every co_await event.wait() resumes with it,
+	 * the waiting ones in the next Scheduler::run().
+	 */
+	class Event {
+	private:
+		Scheduler& scheduler;
+		bool is_set;
+		bool result;
+		std::vector<std::coroutine_handle<>> waiting;
+	public:
+		class WaitAwaiter {
+		private:
+			Event& event;
+		public:
+			WaitAwaiter(Event& e):
+				event{e}
+			{}
+
+			bool await_ready() const noexcept {
+				return event.is_set;
+			}
+			void await_suspend(std::coroutine_handle<> h){
+				event.waiting.push_back(h);
+			}
+			bool await_resume() const noexcept {
+				return event.result;
+			}
+		};
+
+		Event(Scheduler& s):
+			scheduler{s},
+			is_set{false},
+			result{false}
+		{}
+
+		Event(const Event&) = delete;
+		Event& operator=(const Event&) = delete;
+
+		WaitAwaiter wait(){
+			return WaitAwaiter{*this};
+		}
+
+		/*
+		 * Later calls are ignored
+		 */
+		void set(bool res){
+			if(is_set){
+				return;
+			}
+			is_set = true;
+			result = res;
+			for(std::coroutine_handle<> handle : waiting){
+				scheduler.defer(handle);
+			}
+			waiting.clear();
+		}
+
+		bool isSet() const {
+			return is_set;
+		}
+	};
+}
@@ -0,0 +1,72 @@
+#include "frame_pool.h"
+
+#include <array>
+#include <new>
+
+// Smallest class is 2^min_class_shift bytes
+const size_t min_class_shift = 7;
+const size_t class_count = 6;
+
+namespace dvr {
+	namespace {
+		struct FreeFrame {
+			FreeFrame* next;
+		};
+
+		struct FramePool {
+			std::array<FreeFrame*, class_count> free_lists{};
+			FramePoolStats stats{0, 0};
+
+			~FramePool(){
+				for(FreeFrame* head : free_lists){
+					while(head){
+						FreeFrame* next = head->next;
+						::operator delete(head);
+						head = next;
+					}
+				}
+			}
+		};
+
+		thread_local FramePool pool;
+
+		size_t sizeClass(size_t size){
+			size_t index = 0;
+			while((size_t{1} << (min_class_shift + index)) < size){
+				++index;
+			}
+			return index;
+		}
+	}
+
+	void* allocateFrame(size_t size){
+		++pool.stats.allocations;
+		if(size > max_pooled_frame_size){
+			++pool.stats.heap_allocations;
+			return ::operator new(size);
+		}
+		size_t index = sizeClass(size);
+		FreeFrame* frame = pool.free_lists[index];
+		if(frame){
+			pool.free_lists[index] = frame->next;
+			return frame;
+		}
+		++pool.stats.heap_allocations;
+		return ::operator new(size_t{1} << (min_class_shift + index));
+	}
+
+	void deallocateFrame(void* frame, size_t size){
+		if(size > max_pooled_frame_size){
+			::operator delete(frame);
+			return;
+		}
+		size_t index = sizeClass(size);
+		FreeFrame* free_frame = static_cast<FreeFrame*>(frame);
+		free_frame->next = pool.free_lists[index];
+		pool.free_lists[index] = free_frame;
+	}
+
+	FramePoolStats framePoolStats(){
+		return pool.stats;
+	}
+}
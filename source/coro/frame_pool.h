@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace dvr {
+	/*
+	 * Recycles coroutine frames of the calling thread. Frames are grouped
+	 * in power of two size classes up to max_pooled_frame_size. Freed frames
+	 * are kept in a free list of their class, so a steady stream of requests
+	 * stops allocating after the first few. Larger frames use the heap.
+	 */
+	const size_t max_pooled_frame_size = 4096;
+
+	void* allocateFrame(size_t size);
+	void deallocateFrame(void* frame, size_t size);
+
+	struct FramePoolStats {
+		uint64_t allocations;
+		// Allocations which had to go to the heap
+		uint64_t heap_allocations;
+	};
+
+	FramePoolStats framePoolStats();
+}
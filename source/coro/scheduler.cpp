@@ -0,0 +1,76 @@
+#include "scheduler.h"
+
+#include <algorithm>
+
+namespace dvr {
+	void Scheduler::wait(uint64_t key, Waiter& waiter){
+		waiters.insert(std::make_pair(key, &waiter));
+	}
+
+	void Scheduler::cancel(uint64_t key, Waiter& waiter){
+		auto range = waiters.equal_range(key);
+		for(auto iter = range.first; iter != range.second; ++iter){
+			if(iter->second == &waiter){
+				waiters.erase(iter);
+				return;
+			}
+		}
+	}
+
+	void Scheduler::wake(uint64_t key){
+		std::vector<Waiter*> resumable;
+		auto range = waiters.equal_range(key);
+		for(auto iter = range.first; iter != range.second;){
+			if(iter->second->ready()){
+				resumable.push_back(iter->second);
+				iter = waiters.erase(iter);
+			}else{
+				++iter;
+			}
+		}
+		// A resumed coroutine may wait on the same key again
+		for(Waiter* waiter : resumable){
+			waiter->handle.resume();
+		}
+	}
+
+	void Scheduler::arm(Timer& timer, Clock::time_point deadline){
+		timers.arm(timer, deadline);
+	}
+
+	void Scheduler::cancel(Timer& timer){
+		timers.cancel(timer);
+	}
+
+	void Scheduler::defer(std::coroutine_handle<> handle){
+		deferred.push_back(handle);
+	}
+
+	int Scheduler::timeout(int max_ms) const {
+		if(!deferred.empty()){
+			return 0;
+		}
+		if(timers.size() == 0){
+			return max_ms;
+		}
+		// A day is as good as forever for a poll
+		const Clock::duration max = max_ms < 0 ? std::chrono::hours{24} : std::chrono::milliseconds{max_ms};
+		// Rounded up, so the timer has expired after the poll
+		return static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(timers.timeout(Clock::now(), max)).count());
+	}
+
+	void Scheduler::run(){
+		timers.advance(Clock::now());
+
+		// Resumed coroutines may defer again. Those run in the next iteration
+		std::vector<std::coroutine_handle<>> current;
+		current.swap(deferred);
+		for(std::coroutine_handle<> handle : current){
+			handle.resume();
+		}
+	}
+
+	bool Scheduler::idle() const {
+		return waiters.empty() && timers.size() == 0 && deferred.empty();
+	}
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "timing_wheel.h"
+
+namespace dvr {
+	/*
+	 * Resumes suspended coroutines of the event loop thread. Coroutines wait
+	 * for a timer, for a key to be woken up, e.g. a connection id, or are
+	 * deferred to the end of the current loop iteration.
+	 *
+	 * The loop calls timeout() for the poll and run() after it. Timers have a
+	 * resolution of one millisecond.
+	 */
+	class Scheduler {
+	public:
+		typedef std::chrono::steady_clock Clock;
+
+		/*
+		 * Waits for wake(key). Resumed once ready() returns true.
+		 */
+		class Waiter {
+		public:
+			std::coroutine_handle<> handle;
+
+			virtual ~Waiter() = default;
+			virtual bool ready() = 0;
+		};
+
+		/*
+		 * Resumes its handle at the deadline unless cancelled before. Timers
+		 * without a handle only call expired(). Destroying a timer cancels it.
+		 */
+		class Timer : public TimingWheel::Entry {
+		public:
+			std::coroutine_handle<> handle;
+
+			/*
+			 * Called before the handle is resumed, e.g. to cancel a competing wait
+			 */
+			virtual void expired(){}
+
+			void onExpiry() override final {
+				expired();
+				if(handle){
+					handle.resume();
+				}
+			}
+		};
+	private:
+		std::multimap<uint64_t, Waiter*> waiters;
+		TimingWheel timers;
+		std::vector<std::coroutine_handle<>> deferred;
+	public:
+		void wait(uint64_t key, Waiter& waiter);
+		void cancel(uint64_t key, Waiter& waiter);
+		/*
+		 * Resumes the ready waiters of key before returning.
+		 * Called while the object behind the key still exists.
+		 */
+		void wake(uint64_t key);
+
+		void arm(Timer& timer, Clock::time_point deadline);
+		void cancel(Timer& timer);
+
+		/*
+		 * Resumes the handle in run(). Used by callbacks which must not
+		 * resume inline, like service output observers.
+		 */
+		void defer(std::coroutine_handle<> handle);
+
+		/*
+		 * Milliseconds until the next timer, at most max_ms. 0 if coroutines are deferred.
+		 */
+		int timeout(int max_ms) const;
+		/*
+		 * Fires expired timers and resumes deferred coroutines
+		 */
+		void run();
+
+		bool idle() const;
+	};
+
+	/*
+	 * co_await sleep(scheduler, std::chrono::milliseconds{100});
+	 */
+	class SleepAwaiter final : public Scheduler::Timer {
+	private:
+		Scheduler& scheduler;
+		Scheduler::Clock::time_point deadline;
+	public:
+		SleepAwaiter(Scheduler& s, Scheduler::Clock::duration duration):
+			scheduler{s},
+			deadline{Scheduler::Clock::now() + duration}
+		{}
+
+		bool await_ready() const noexcept {
+			return false;
+		}
+		void await_suspend(std::coroutine_handle<> h){
+			handle = h;
+			scheduler.arm(*this, deadline);
+		}
+		void await_resume() noexcept {}
+	};
+
+	inline SleepAwaiter sleep(Scheduler& scheduler, Scheduler::Clock::duration duration){
+		return SleepAwaiter{scheduler, duration};
+	}
+
+	/*
+	 * co_await yield(scheduler) resumes in the next run(), after every
+	 * coroutine deferred before it.
+	 */
+	class YieldAwaiter {
+	private:
+		Scheduler& scheduler;
+	public:
+		YieldAwaiter(Scheduler& s):
+			scheduler{s}
+		{}
+
+		bool await_ready() const noexcept {
+			return false;
+		}
+		void await_suspend(std::coroutine_handle<> h){
+			scheduler.defer(h);
+		}
+		void await_resume() noexcept {}
+	};
+
+	inline YieldAwaiter yield(Scheduler& scheduler){
+		return YieldAwaiter{scheduler};
+	}
+}
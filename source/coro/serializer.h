@@ -0,0 +1,60 @@
+#pragma once
+
+#include <coroutine>
+#include <deque>
+
+#include "scheduler.h"
+
+namespace dvr {
+	/*
+	 * Lets one coroutine at a time pass, the others wait in order.
+	 * Every passed co_await serializer.enter() needs a leave().
+	 */
+	class Serializer {
+	private:
+		Scheduler& scheduler;
+		bool busy;
+		std::deque<std::coroutine_handle<>> waiting;
+	public:
+		class EnterAwaiter {
+		private:
+			Serializer& serializer;
+		public:
+			EnterAwaiter(Serializer& s):
+				serializer{s}
+			{}
+
+			bool await_ready() const noexcept {
+				return !serializer.busy;
+			}
+			void await_suspend(std::coroutine_handle<> h){
+				serializer.waiting.push_back(h);
+			}
+			void await_resume() noexcept {
+				serializer.busy = true;
+			}
+		};
+
+		Serializer(Scheduler& s):
+			scheduler{s},
+			busy{false}
+		{}
+
+		EnterAwaiter enter(){
+			return EnterAwaiter{*this};
+		}
+
+		/*
+		 * The next waiting coroutine passes in the next Scheduler::run()
+		 */
+		void leave(){
+			busy = false;
+			if(!waiting.empty()){
+				// Taken now, so nobody passes in between
+				busy = true;
+				scheduler.defer(waiting.front());
+				waiting.pop_front();
+			}
+		}
+	};
+}
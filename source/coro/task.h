@@ -0,0 +1,45 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+
+#include "frame_pool.h"
+
+namespace dvr {
+	/*
+	 * Return type of request handlers which may suspend. The coroutine starts
+	 * immediately and runs until its first suspension. Nobody awaits it, the
+	 * frame is freed when the coroutine finishes.
+	 *
+	 * Task handleStop(Connection& connection, const MessageRequest& req){
+	 *     ...
+	 *     bool ok = co_await written(scheduler, connection);
+	 * }
+	 */
+	class Task {
+	public:
+		struct promise_type {
+			Task get_return_object() noexcept {
+				return {};
+			}
+			std::suspend_never initial_suspend() noexcept {
+				return {};
+			}
+			std::suspend_never final_suspend() noexcept {
+				return {};
+			}
+			void return_void() noexcept {}
+			// Handlers don't throw. An escaping exception is a bug
+			void unhandled_exception() noexcept {
+				std::terminate();
+			}
+
+			static void* operator new(size_t size){
+				return allocateFrame(size);
+			}
+			static void operator delete(void* frame, size_t size){
+				deallocateFrame(frame, size);
+			}
+		};
+	};
+}
@@ -0,0 +1,185 @@
+#include "timing_wheel.h"
+
+#include <algorithm>
+#include <bit>
+#include <limits>
+
+namespace dvr {
+	TimingWheel::Entry::~Entry(){
+		if(wheel){
+			wheel->cancel(*this);
+		}
+	}
+
+	bool TimingWheel::Entry::armed() const {
+		return wheel != nullptr;
+	}
+
+	TimingWheel::TimingWheel(Clock::duration tick_duration):
+		start{Clock::now()},
+		tick{tick_duration},
+		current{0},
+		occupied{},
+		count{0}
+	{
+		for(auto& level : wheel){
+			level.fill(nullptr);
+		}
+	}
+
+	TimingWheel::~TimingWheel(){
+		for(auto& level : wheel){
+			for(Entry*& head : level){
+				for(Entry* entry = head; entry; entry = entry->next){
+					entry->wheel = nullptr;
+				}
+				head = nullptr;
+			}
+		}
+	}
+
+	uint64_t TimingWheel::toTick(Clock::time_point time, bool round_up) const {
+		if(time <= start){
+			return 0;
+		}
+		const Clock::duration elapsed = time - start;
+		uint64_t ticks = static_cast<uint64_t>(elapsed / tick);
+		if(round_up && elapsed % tick != Clock::duration::zero()){
+			++ticks;
+		}
+		return ticks;
+	}
+
+	void TimingWheel::link(Entry& entry, uint64_t earliest){
+		const uint64_t deadline = std::max(entry.deadline, earliest);
+		// The lowest level whose slots still tell the deadline apart from now
+		size_t level = levels - 1;
+		size_t slot = ((current >> (level * slot_bits)) + slots - 1) & (slots - 1);
+		for(size_t l = 0; l < levels; ++l){
+			const size_t shift = l * slot_bits;
+			if((deadline >> shift) - (current >> shift) < slots){
+				level = l;
+				slot = (deadline >> shift) & (slots - 1);
+				break;
+			}
+		}
+
+		Entry*& head = wheel[level][slot];
+		entry.prev = nullptr;
+		entry.next = head;
+		if(head){
+			head->prev = &entry;
+		}
+		head = &entry;
+		entry.level = static_cast<uint8_t>(level);
+		entry.slot = static_cast<uint8_t>(slot);
+		occupied[level] |= uint64_t{1} << slot;
+		++count;
+	}
+
+	void TimingWheel::unlink(Entry& entry){
+		Entry*& head = wheel[entry.level][entry.slot];
+		if(entry.prev){
+			entry.prev->next = entry.next;
+		}else{
+			head = entry.next;
+		}
+		if(entry.next){
+			entry.next->prev = entry.prev;
+		}
+		if(!head){
+			occupied[entry.level] &= ~(uint64_t{1} << entry.slot);
+		}
+		entry.prev = nullptr;
+		entry.next = nullptr;
+		--count;
+	}
+
+	void TimingWheel::cascade(size_t level, size_t slot){
+		Entry* entry = wheel[level][slot];
+		wheel[level][slot] = nullptr;
+		occupied[level] &= ~(uint64_t{1} << slot);
+		while(entry){
+			Entry* next = entry->next;
+			--count;
+			// Relative to the tick being processed, expiring ones land in its level 0 slot
+			link(*entry, current);
+			entry = next;
+		}
+	}
+
+	void TimingWheel::process(uint64_t t){
+		current = t;
+		for(size_t level = levels - 1; level > 0; --level){
+			const size_t shift = level * slot_bits;
+			if((t & ((uint64_t{1} << shift) - 1)) == 0){
+				cascade(level, (t >> shift) & (slots - 1));
+			}
+		}
+
+		// Entries armed by a callback land in later slots, so this ends
+		Entry*& head = wheel[0][t & (slots - 1)];
+		while(head){
+			Entry* entry = head;
+			unlink(*entry);
+			entry->wheel = nullptr;
+			entry->onExpiry();
+		}
+	}
+
+	uint64_t TimingWheel::nextTick() const {
+		uint64_t next = std::numeric_limits<uint64_t>::max();
+		for(size_t level = 0; level < levels; ++level){
+			if(!occupied[level]){
+				continue;
+			}
+			const size_t shift = level * slot_bits;
+			const uint64_t base = (current >> shift) + 1;
+			// Distance of the first occupied slot from the next one
+			const int distance = std::countr_zero(std::rotr(occupied[level], static_cast<int>(base & (slots - 1))));
+			next = std::min(next, (base + static_cast<uint64_t>(distance)) << shift);
+		}
+		return next;
+	}
+
+	void TimingWheel::arm(Entry& entry, Clock::time_point deadline){
+		cancel(entry);
+		entry.wheel = this;
+		entry.deadline = toTick(deadline, true);
+		// The current tick is processed already
+		link(entry, current + 1);
+	}
+
+	void TimingWheel::cancel(Entry& entry){
+		if(entry.wheel == this){
+			unlink(entry);
+			entry.wheel = nullptr;
+		}
+	}
+
+	void TimingWheel::advance(Clock::time_point now){
+		const uint64_t target = toTick(now, false);
+		for(uint64_t next = nextTick(); next <= target; next = nextTick()){
+			// Nothing happens in the skipped ticks
+			current = next - 1;
+			process(next);
+		}
+		current = std::max(current, target);
+	}
+
+	TimingWheel::Clock::duration TimingWheel::timeout(Clock::time_point now, Clock::duration max) const {
+		const uint64_t next = nextTick();
+		if(next == std::numeric_limits<uint64_t>::max()){
+			return max;
+		}
+		const Clock::time_point due = start + tick * static_cast<Clock::rep>(next);
+		if(due <= now){
+			return Clock::duration::zero();
+		}
+		return std::min(max, due - now);
+	}
+
+	size_t TimingWheel::size() const {
+		return count;
+	}
+}
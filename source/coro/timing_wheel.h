@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+namespace dvr {
+	/*
+	 * Hierarchical timing wheel with a resolution of one tick. Arming and
+	 * cancelling are O(1): entries are intrusive list nodes in one slot.
+	 *
+	 * Level 0 has one slot per tick, every slot of level n spans all of level
+	 * n-1. A slot of a higher level is moved down (cascaded) when the wheel
+	 * reaches its start, so an entry is touched at most once per level.
+	 * Deadlines beyond the top level wait in its last slot and are placed
+	 * again on every cascade.
+	 */
+	class TimingWheel {
+	public:
+		typedef std::chrono::steady_clock Clock;
+
+		static const size_t slot_bits = 6;
+		static const size_t slots = 1 << slot_bits;
+		static const size_t levels = 5;
+
+		class Entry {
+		private:
+			friend class TimingWheel;
+
+			TimingWheel* wheel = nullptr;
+			Entry* prev = nullptr;
+			Entry* next = nullptr;
+			uint64_t deadline = 0;
+			uint8_t level = 0;
+			uint8_t slot = 0;
+		public:
+			Entry() = default;
+			Entry(const Entry&) = delete;
+			Entry& operator=(const Entry&) = delete;
+			virtual ~Entry();
+
+			bool armed() const;
+			/*
+			 * Called after the entry has been disarmed. May arm or cancel any entry.
+			 */
+			virtual void onExpiry() = 0;
+		};
+	private:
+		const Clock::time_point start;
+		const Clock::duration tick;
+
+		// All ticks up to this one are processed
+		uint64_t current;
+		std::array<std::array<Entry*, slots>, levels> wheel;
+		// Bit n is set if slot n of the level has entries
+		std::array<uint64_t, levels> occupied;
+		size_t count;
+
+		uint64_t toTick(Clock::time_point time, bool round_up) const;
+		/*
+		 * Deadlines before earliest are placed at earliest
+		 */
+		void link(Entry& entry, uint64_t earliest);
+		void unlink(Entry& entry);
+		void cascade(size_t level, size_t slot);
+		void process(uint64_t tick);
+		/*
+		 * First tick at which an entry expires or a slot cascades. UINT64_MAX if empty
+		 */
+		uint64_t nextTick() const;
+	public:
+		TimingWheel(Clock::duration tick_duration = std::chrono::milliseconds{1});
+		~TimingWheel();
+
+		TimingWheel(const TimingWheel&) = delete;
+		TimingWheel& operator=(const TimingWheel&) = delete;
+
+		/*
+		 * Arms again if the entry is armed. Deadlines in the past expire with the next advance.
+		 */
+		void arm(Entry& entry, Clock::time_point deadline);
+		void cancel(Entry& entry);
+
+		/*
+		 * Expires all entries up to now
+		 */
+		void advance(Clock::time_point now);
+
+		/*
+		 * Time until the wheel needs to advance, at most max. Can be earlier
+		 * than the next deadline when a slot has to cascade.
+		 */
+		Clock::duration timeout(Clock::time_point now, Clock::duration max) const;
+
+		size_t size() const;
+	};
+}
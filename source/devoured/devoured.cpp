@@ -1,30 +1,85 @@
 #include "devoured.h"
 
+#include <algorithm>
 #include <iostream>
 #include <chrono>
+#include <deque>
+#include <fstream>
 #include <list>
 #include <thread>
 #include <sstream>
 #include <map>
+#include <optional>
+#include <set>
 #include <functional>
 #include <cassert>
+#include <ctime>
+#include <limits>
 #include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <signal.h>
 
 #include "arguments/parameter.h"
+#include "client/client.h"
+#include "client/federation.h"
+#include "coro/connection_awaitables.h"
+#include "coro/event.h"
+#include "coro/scheduler.h"
+#include "coro/serializer.h"
+#include "coro/task.h"
+#include "health_monitor.h"
+#include "output_fanout.h"
+#include "output_store.h"
+#include "relay_thread.h"
 #include "signal_handler.h"
+#include "startup.h"
+#include "service.h"
+#include "service_awaitables.h"
+#include "session_recording.h"
+#include "status_page.h"
+#include "status_snapshot.h"
+#include "subscriptions.h"
+#include "test_runner.h"
+#include "log/log.h"
+#include "metrics/metrics.h"
 #include "network/protocol.h"
+#include "trace/trace.h"
+
+// Initial entries of the status page, it grows when all are in use
+const uint32_t status_page_entries = 1024;
+// A command is answered once its service was quiet this long
+const auto command_quiet_period = std::chrono::milliseconds{100};
+// or after this at the latest
+const auto command_time_limit = std::chrono::milliseconds{2000};
+// Killed services are waited for this long after the shutdown timeout
+const auto shutdown_kill_grace = std::chrono::milliseconds{1000};
+// Instances one CREATE request may register
+const uint32_t max_created_instances = 65536;
+// Stored output queued on a connection before waiting until it was sent
+const size_t output_batch_size = 256 * 1024;
 
 namespace dvr {
 	// TODO integrate in non static way. Maybe integrate this in the devoured base class
 	static uid_t user_id = 0;
 	static std::string user_id_string = "";
 
-	class DaemonDevoured final : public Devoured, public IConnectionStateObserver, public IServerStateObserver {
+	class DaemonDevoured final : public Devoured, public IConnectionStateObserver, public IServerStateObserver, public IServiceStateObserver, public IHealthObserver {
 	private:
 		Network network;
+		/*
+		 * Reads the output of the services. Outlives them, they detach on destruction
+		 */
+		RelayThread relay_thread;
 
 		std::map<Devoured::Mode, std::function<void(Connection&,const MessageRequest&)>> request_handlers;
+		/*
+		 * Broken connections are removed after the poll, because they are
+		 * reported while the connection is still on the stack
+		 */
+		std::vector<ConnectionId> broken_connections;
 		/*
 		 * Key - ConnId - Connection ID
 		 * Value - the connection ptr
@@ -35,26 +90,68 @@ namespace dvr {
 		 * Key - Target - String
 		 * Value - Target Configuration and State
 		 */
-		std::map<std::string, int> targets;
+		std::map<std::string, std::unique_ptr<Service>> services;
+		/*
+		 * Key - Target - String
+		 * Value - Destroyed services which are stopped and wait until nothing refers to them
+		 */
+		std::map<std::string, std::unique_ptr<Service>> retiring;
+		/*
+		 * Key - Target - String
+		 * Value - Connections attached to the output of the service
+		 */
+		std::map<std::string, std::unique_ptr<OutputFanout>> fanouts;
+		/*
+		 * Key - Target of a CREATE with several Instances
+		 * Value - Its instances which haven't been destroyed yet
+		 */
+		std::map<std::string, std::set<std::string>> created_instances;
+
+		StatusSnapshot status_snapshot;
+		StatusPage status_page;
+		SubscriptionHub subscriptions;
+		/*
+		 * Resumes the suspended request handlers. Connection ids are the wait keys
+		 */
+		Scheduler scheduler;
+		/*
+		 * Key - Target - String
+		 * Value - Commands to the service run one after another, so output isn't mixed
+		 */
+		std::map<std::string, std::unique_ptr<Serializer>> command_queues;
+		HealthMonitor health;
+		// Stopped after failed health probes. Their exit counts as a failure for the restart policy
+		std::set<std::string> unhealthy_services;
+		/*
+		 * Key - Target - String
+		 * Value - Set once the service is ready or will never be, see bringUp
+		 */
+		std::map<std::string, Event> readiness;
 		
 		std::chrono::steady_clock::time_point next_update;
 
-		void handleStatus(Connection& connection, const MessageRequest& req){
-			std::cout<<"Handling status messages"<<std::endl;
-			auto t_find = targets.find(req.target);
-			if(t_find != targets.end()){
+		// Updated every second
+		uint64_t last_wakeups;
+		uint64_t wakeups_per_second;
+		// Set during the shutdown, nothing is started anymore
+		bool stopping;
 
-			}else if(req.target.empty()){
+		void handleStatus(Connection& connection, const MessageRequest& req){
+			DVR_LOG(Debug, "Handling status request from connection "<<connection.id());
+			auto t_find = services.find(req.target);
+			if(t_find != services.end()){
 				MessageResponse resp{
 					req.request_id,
 					static_cast<uint8_t>(ReturnCode::OK),
 					req.target,
-					"Currently no service registered"
+					t_find->second->describe()
 				};
 				if(!asyncWriteResponse(connection, resp)){
-					std::cerr<<"Response in error mode"<<std::endl;
+					DVR_LOG(Error, "Response in error mode");
 					stop();
 				}
+			}else if(req.target.empty()){
+				status_snapshot.send(connection, req.request_id);
 			}else if(req.target == "devoured"){
 				MessageResponse resp{
 					req.request_id,
@@ -63,7 +160,7 @@ namespace dvr {
 					"Devoured feels ok. Thanks for asking"
 				};
 				if(!asyncWriteResponse(connection, resp)){
-					std::cerr<<"Response in error mode"<<std::endl;
+					DVR_LOG(Error, "Response in error mode");
 					stop();
 				}
 			}else{
@@ -74,40 +171,471 @@ namespace dvr {
 					"No matching service found"
 				};
 				if(!asyncWriteResponse(connection, resp)){
-					std::cerr<<"Response in error mode"<<std::endl;
+					DVR_LOG(Error, "Response in error mode");
 					stop();
 				}
 			}
 		}
+
+		void respondNoService(Connection& connection, const MessageRequest& req){
+			MessageResponse resp{
+				req.request_id,
+				static_cast<uint8_t>(ReturnCode::NOSERVICE),
+				req.target,
+				"No matching service found"
+			};
+			asyncWriteResponse(connection, resp);
+		}
+
+		void respondFailed(Connection& connection, const MessageRequest& req, const std::string& reason){
+			MessageResponse resp{
+				req.request_id,
+				static_cast<uint8_t>(ReturnCode::FAILED),
+				req.target,
+				reason
+			};
+			asyncWriteResponse(connection, resp);
+		}
+
+		void handleInteractive(Connection& connection, const MessageRequest& req){
+			auto t_find = services.find(req.target);
+			if(t_find == services.end()){
+				respondNoService(connection, req);
+				return;
+			}
+			MessageResponse resp{
+				req.request_id,
+				static_cast<uint8_t>(ReturnCode::OK),
+				req.target,
+				""
+			};
+			asyncWriteResponse(connection, resp);
+			auto& fanout = fanouts[req.target];
+			if(!fanout){
+				fanout = std::make_unique<OutputFanout>(*t_find->second);
+			}
+			fanout->add(connection, req.request_id);
+		}
+
+		void handleMetrics(Connection& connection, const MessageRequest& req){
+			std::string content;
+			if(!req.target.empty()){
+				auto t_find = services.find(req.target);
+				if(t_find == services.end()){
+					respondNoService(connection, req);
+					return;
+				}
+				std::stringstream ss;
+				ss<<"bytes_relayed "<<t_find->second->relayedBytes()<<"\n";
+				ss<<"cpu_seconds "<<std::chrono::duration<double>(t_find->second->cpuTime()).count()<<"\n";
+				content = ss.str();
+			}else if(req.content == "binary"){
+				std::vector<uint8_t> buffer;
+				serializeMetrics(buffer, collectMetrics());
+				content.assign(buffer.begin(), buffer.end());
+			}else{
+				std::stringstream ss;
+				ss<<"epoll_wakeups_per_second "<<wakeups_per_second<<"\n";
+				FramePoolStats frames = framePoolStats();
+				ss<<"coroutine_frames "<<frames.allocations<<"\n";
+				ss<<"coroutine_frames_heap "<<frames.heap_allocations<<"\n";
+				ss<<formatMetrics(collectMetrics());
+				content = ss.str();
+			}
+			MessageResponse resp{
+				req.request_id,
+				static_cast<uint8_t>(ReturnCode::OK),
+				req.target,
+				content
+			};
+			if(!asyncWriteResponse(connection, resp)){
+				DVR_LOG(Warning, "Metrics don't fit into a response");
+			}
+		}
+
+		void handleTrace(Connection& connection, const MessageRequest& req){
+			bool dumped = dumpTrace(trace_path);
+			MessageResponse resp{
+				req.request_id,
+				static_cast<uint8_t>(dumped ? ReturnCode::OK : ReturnCode::FAILED),
+				req.target,
+				dumped ? trace_path : (traceEnabled() ? "Couldn't write trace to " + trace_path : "Tracing is disabled. Build with scons trace=yes")
+			};
+			asyncWriteResponse(connection, resp);
+		}
+
+		void handleSubscribe(Connection& connection, const MessageRequest& req){
+			if(!req.target.empty() && services.find(req.target) == services.end()){
+				respondNoService(connection, req);
+				return;
+			}
+			bool valid = subscriptions.subscribe(connection, req.target, req.content);
+			MessageResponse resp{
+				req.request_id,
+				static_cast<uint8_t>(valid ? ReturnCode::OK : ReturnCode::FAILED),
+				req.target,
+				valid ? "" : "Invalid subscription. Use \"state\", \"exit\" and \"match <pattern>\""
+			};
+			asyncWriteResponse(connection, resp);
+		}
+
+		/*
+		 * Streams a range of the stored output. The next batch of responses
+		 * waits until the last one was sent, so a range of gigabytes doesn't
+		 * pile up in memory, and other requests are served in between.
+		 */
+		Task handleOutput(Connection& connection, MessageRequest req){
+			auto t_find = services.find(req.target);
+			if(t_find == services.end()){
+				respondNoService(connection, req);
+				co_return;
+			}
+			OutputStore* store = t_find->second->outputStore();
+			if(!store){
+				respondFailed(connection, req, req.target + " has no OutputStore");
+				co_return;
+			}
+			std::istringstream ss{req.content};
+			std::string kind;
+			int64_t first = 0;
+			int64_t last = 0;
+			if(!(ss>>kind>>first>>last) || (kind != "time" && kind != "lines")){
+				respondFailed(connection, req, "Invalid range. Use \"time <from> <to>\" or \"lines <first> <last>\"");
+				co_return;
+			}
+
+			store->flush();
+			OutputRange range;
+			if(kind == "time"){
+				// Open bounds are sent as the extreme values
+				const int64_t limit = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::duration::max()).count();
+				auto at = [limit](int64_t us){
+					return std::chrono::system_clock::time_point{std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::microseconds{std::clamp(us, -limit, limit)})};
+				};
+				range = store->timeRange(at(first), at(last));
+			}else{
+				// -1 is the last line
+				const int64_t count = static_cast<int64_t>(store->lineCount());
+				auto resolve = [count](int64_t line){
+					return static_cast<uint64_t>(line < 0 ? std::max<int64_t>(0, count + 1 + line) : line);
+				};
+				range = store->lineRange(resolve(first), resolve(last));
+			}
+
+			const ConnectionId id = connection.id();
+			const size_t content_size = maxResponseContentSize() - req.target.size();
+			std::vector<uint8_t> header;
+			std::vector<uint8_t> content;
+			content.reserve(content_size);
+			bool finished = false;
+			while(!finished){
+				auto c_find = connection_map.find(id);
+				if(c_find == connection_map.end() || c_find->second->broken()){
+					co_return;
+				}
+				std::vector<uint8_t> batch;
+				batch.reserve(output_batch_size + content_size + header.capacity());
+				while(batch.size() < output_batch_size && !finished){
+					content.clear();
+					range.read(content, content_size);
+					finished = range.empty();
+					serializeResponseHeader(header, req.request_id, static_cast<uint8_t>(finished ? ReturnCode::OK : ReturnCode::PARTIAL), req.target, content.size());
+					batch.insert(batch.end(), header.begin(), header.end());
+					batch.insert(batch.end(), content.begin(), content.end());
+				}
+				c_find->second->write(std::move(batch));
+				if(!finished){
+					if(!co_await written(scheduler, *c_find->second)){
+						co_return;
+					}
+					co_await yield(scheduler);
+				}
+			}
+		}
+
+		/*
+		 * Writes the content as a line to the stdin of the service and responds
+		 * with the output the line produced
+		 */
+		Task handleCommand(Connection& connection, MessageRequest req){
+			auto t_find = services.find(req.target);
+			if(t_find == services.end()){
+				respondNoService(connection, req);
+				co_return;
+			}
+			Service& service = *t_find->second;
+			const ConnectionId id = connection.id();
+			Serializer& serializer = commandQueue(req.target);
+
+			co_await serializer.enter();
+			std::optional<std::string> output;
+			if(service.getState() == Service::State::RUNNING && service.write(req.content + "\n")){
+				output = co_await collectOutput(scheduler, service, command_quiet_period, command_time_limit, maxResponseContentSize() - req.target.size());
+			}
+			serializer.leave();
+
+			// The client may have gone away in the meantime
+			auto c_find = connection_map.find(id);
+			if(c_find == connection_map.end() || c_find->second->broken()){
+				co_return;
+			}
+			MessageResponse resp{
+				req.request_id,
+				static_cast<uint8_t>(output ? ReturnCode::OK : ReturnCode::FAILED),
+				req.target,
+				output ? *output : "Service doesn't accept input"
+			};
+			asyncWriteResponse(*c_find->second, resp);
+		}
+
+		Serializer& commandQueue(const std::string& name){
+			auto& queue = command_queues[name];
+			if(!queue){
+				queue = std::make_unique<Serializer>(scheduler);
+			}
+			return *queue;
+		}
+
+		/*
+		 * Registers the service or all its instances at once and brings up
+		 * the autostarted ones. Nothing is created if one of them is invalid.
+		 */
+		void handleCreate(Connection& connection, const MessageRequest& req){
+			if(stopping){
+				respondFailed(connection, req, "Shutting down");
+				return;
+			}
+			if(req.target.empty()){
+				respondFailed(connection, req, "Creating needs a target");
+				return;
+			}
+			std::string error;
+			auto service_template = parseServiceTemplate(req.target, req.content, error);
+			if(!service_template){
+				respondFailed(connection, req, "Invalid service table: " + error);
+				return;
+			}
+			const ServiceConfig& conf = service_template->config;
+			const uint32_t instances = service_template->instances;
+			if(instances == 0 || instances > max_created_instances){
+				respondFailed(connection, req, "Instances must be between 1 and " + std::to_string(max_created_instances));
+				return;
+			}
+			if(!parseRestartPolicy(conf.restart)){
+				respondFailed(connection, req, "Unknown Restart \"" + conf.restart + "\"");
+				return;
+			}
+			if(conf.health_interval > 0 && !parseHealthProbe(conf.health_probe)){
+				respondFailed(connection, req, "Unknown HealthProbe \"" + conf.health_probe + "\"");
+				return;
+			}
+			for(const std::string& dependency : conf.after){
+				if(services.find(dependency) == services.end()){
+					respondFailed(connection, req, "Unknown dependency " + dependency);
+					return;
+				}
+			}
+
+			std::vector<std::string> names;
+			if(instances == 1){
+				names.push_back(req.target);
+			}else{
+				names.reserve(instances);
+				for(uint32_t i = 0; i < instances; ++i){
+					names.push_back(req.target + "-" + std::to_string(i));
+				}
+			}
+			// Destroying the target destroys the instances of the earlier CREATE as well
+			if(created_instances.find(req.target) != created_instances.end()){
+				respondFailed(connection, req, req.target + " exists already");
+				return;
+			}
+			for(const std::string& name : names){
+				if(services.find(name) != services.end() || retiring.find(name) != retiring.end()){
+					respondFailed(connection, req, name + " exists already");
+					return;
+				}
+			}
+			if(instances > 1){
+				created_instances[req.target].insert(names.begin(), names.end());
+			}
+
+			for(const std::string& name : names){
+				ServiceConfig& entry = config.services.insert_or_assign(name, conf).first->second;
+				// Instances share the template, each stores its output below its directory
+				if(instances > 1 && !entry.output_store.empty()){
+					entry.output_store += "/" + name;
+				}
+				Service& service = registerService(name, entry);
+				if(entry.autostart){
+					bringUp(service, entry);
+				}else{
+					readiness.at(name).set(false);
+				}
+			}
+			DVR_LOG(Info, "Created "<<names.size()<<" services as "<<req.target);
+			MessageResponse resp{
+				req.request_id,
+				static_cast<uint8_t>(ReturnCode::OK),
+				req.target,
+				"Created " + std::to_string(names.size()) + " services"
+			};
+			asyncWriteResponse(connection, resp);
+		}
+
+		/*
+		 * Destroys the target and the instances its CREATE registered at
+		 * once and responds after the last one is gone
+		 */
+		Task handleDestroy(Connection& connection, MessageRequest req){
+			if(stopping){
+				respondFailed(connection, req, "Shutting down");
+				co_return;
+			}
+			std::vector<std::string> names;
+			if(services.find(req.target) != services.end()){
+				names.push_back(req.target);
+				// A single instance leaves the set of its CREATE
+				const size_t dash = req.target.rfind('-');
+				if(dash != std::string::npos){
+					auto i_find = created_instances.find(req.target.substr(0, dash));
+					if(i_find != created_instances.end() && i_find->second.erase(req.target) > 0 && i_find->second.empty()){
+						created_instances.erase(i_find);
+					}
+				}
+			}
+			auto i_find = created_instances.find(req.target);
+			if(i_find != created_instances.end()){
+				names.insert(names.end(), i_find->second.begin(), i_find->second.end());
+				created_instances.erase(i_find);
+			}
+			if(req.target.empty() || names.empty()){
+				respondNoService(connection, req);
+				co_return;
+			}
+			const ConnectionId id = connection.id();
+
+			Event destroyed{scheduler};
+			size_t remaining = names.size();
+			for(const std::string& name : names){
+				destroyService(name, remaining, destroyed);
+			}
+			co_await destroyed.wait();
+
+			auto c_find = connection_map.find(id);
+			if(c_find == connection_map.end() || c_find->second->broken()){
+				co_return;
+			}
+			MessageResponse resp{
+				req.request_id,
+				static_cast<uint8_t>(ReturnCode::OK),
+				req.target,
+				"Destroyed " + std::to_string(names.size()) + " services"
+			};
+			asyncWriteResponse(*c_find->second, resp);
+		}
+
+		void handleResize(Connection& connection, const MessageRequest& req){
+			auto t_find = services.find(req.target);
+			if(t_find == services.end()){
+				respondNoService(connection, req);
+				return;
+			}
+			std::istringstream ss{req.content};
+			uint16_t rows = 0;
+			uint16_t columns = 0;
+			if(ss>>rows>>columns){
+				t_find->second->resize(rows, columns);
+			}
+		}
 	public:
 		DaemonDevoured(const std::string& f):
 			Devoured(true, 0),
+			relay_thread{network.eventPoll()},
 			request_handlers{
-				{Devoured::Mode::STATUS,std::bind(&DaemonDevoured::handleStatus, this, std::placeholders::_1, std::placeholders::_2)}
+				{Devoured::Mode::STATUS,std::bind(&DaemonDevoured::handleStatus, this, std::placeholders::_1, std::placeholders::_2)},
+				{Devoured::Mode::INTERACTIVE,std::bind(&DaemonDevoured::handleInteractive, this, std::placeholders::_1, std::placeholders::_2)},
+				{Devoured::Mode::RESIZE,std::bind(&DaemonDevoured::handleResize, this, std::placeholders::_1, std::placeholders::_2)},
+				{Devoured::Mode::METRICS,std::bind(&DaemonDevoured::handleMetrics, this, std::placeholders::_1, std::placeholders::_2)},
+				{Devoured::Mode::TRACE,std::bind(&DaemonDevoured::handleTrace, this, std::placeholders::_1, std::placeholders::_2)},
+				{Devoured::Mode::SUBSCRIBE,std::bind(&DaemonDevoured::handleSubscribe, this, std::placeholders::_1, std::placeholders::_2)},
+				{Devoured::Mode::CREATE,std::bind(&DaemonDevoured::handleCreate, this, std::placeholders::_1, std::placeholders::_2)},
+				{Devoured::Mode::COMMAND,[this](Connection& connection, const MessageRequest& req){ handleCommand(connection, req); }},
+				{Devoured::Mode::DESTROY,[this](Connection& connection, const MessageRequest& req){ handleDestroy(connection, req); }},
+				{Devoured::Mode::OUTPUT,[this](Connection& connection, const MessageRequest& req){ handleOutput(connection, req); }}
 			},
+			health{scheduler, *this},
 			next_update{std::chrono::steady_clock::now()},
+			last_wakeups{0},
+			wakeups_per_second{0},
+			stopping{false},
 			config_path{f}
     	{}
     
 		void notify(Connection& conn, ConnectionState state) override {
 			switch(state){
 				case ConnectionState::Broken:{
-					connection_map.erase(conn.id());
-					std::cout<<"Connection unregistered in DaemonDevoured"<<std::endl;
+					broken_connections.push_back(conn.id());
 				}
 				break;
+				case ConnectionState::WriteReady:
+				break;
 				case ConnectionState::ReadReady:{
-					auto opt_msg = asyncReadRequest(conn);
-					if(opt_msg){
+					// Clients may pipeline requests. The edge is only reported once for all of them
+					for(auto opt_msg = asyncReadRequest(conn); opt_msg; opt_msg = asyncReadRequest(conn)){
 						auto& msg = *opt_msg;
 						auto func_find = request_handlers.find(static_cast<Devoured::Mode>(msg.type));
 						if(func_find != request_handlers.end()){
+							auto begin = std::chrono::steady_clock::now();
 							func_find->second(conn,msg);
+							auto duration = std::chrono::steady_clock::now() - begin;
+							increment(Counter::REQUESTS);
+							observeRequest(msg.type, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()));
+						}else{
+							MessageResponse resp{
+								msg.request_id,
+								static_cast<uint8_t>(ReturnCode::FAILED),
+								msg.target,
+								"Unsupported request type"
+							};
+							asyncWriteResponse(conn, resp);
 						}
 					}
 				}
 				break;
 			}
+			// Suspended handlers awaiting this connection
+			scheduler.wake(conn.id());
+		}
+
+		void notify(Service& service, Service::State state) override {
+			status_snapshot.update(service.name(), service.describe());
+			status_page.update(service.name(), makeStatusRecord(service));
+			subscriptions.onStateChange(service, state);
+			if(state == Service::State::RUNNING){
+				health.started(service);
+			}
+			// Dependents of a service which ended before it was ready don't wait for the ready timeout
+			if(state == Service::State::EXITED || state == Service::State::FAILED){
+				auto r_find = readiness.find(service.name());
+				if(r_find != readiness.end()){
+					r_find->second.set(false);
+				}
+				const bool unhealthy = unhealthy_services.erase(service.name()) > 0;
+				const std::optional<int> status = state == Service::State::EXITED ? std::optional<int>{service.exitStatus()} : std::nullopt;
+				auto c_find = config.services.find(service.name());
+				if(!stopping && c_find != config.services.end()){
+					auto policy = parseRestartPolicy(c_find->second.restart);
+					if(policy && shouldRestart(*policy, status, unhealthy)){
+						restartService(service.name(), std::chrono::seconds{c_find->second.restart_delay});
+					}
+				}
+			}
+		}
+
+		void unhealthy(Service& service) override {
+			unhealthy_services.insert(service.name());
+			service.terminate();
 		}
 
 		void notify(Server& server, ServerState state) override {
@@ -116,7 +644,7 @@ namespace dvr {
 				if(connection){
 					ConnectionId id = connection->id();
 					connection_map.insert(std::make_pair(id, std::move(connection)));
-					std::cout<<"Connection registered in DaemonDevoured"<<std::endl;
+					DVR_LOG(Debug, "Connection "<<id<<" registered in DaemonDevoured");
 				}
 			}
 		}
@@ -124,20 +652,356 @@ namespace dvr {
 		void loop() override {
 			setup();
 			while(isActive()){
-				std::this_thread::sleep_until(next_update);
-				next_update += std::chrono::milliseconds{1000};
-
-				// Update all subsystems like network ...
-				network.poll();
+				step(next_update);
 			}
+			shutdownServices();
+			stopLogger();
 		}
 
 		std::string config_path;
 	private:
+		/*
+		 * One iteration of the event loop. The poll returns at limit at the latest
+		 */
+		void step(std::chrono::steady_clock::time_point limit){
+			auto now = std::chrono::steady_clock::now();
+			if(now >= next_update){
+				next_update = now + std::chrono::milliseconds{1000};
+				updateRates();
+			}
+
+			// Update all subsystems like network ...
+			// Child output and requests wake up the poll, SIGCHLD interrupts it
+			auto wait = std::chrono::ceil<std::chrono::milliseconds>(std::min(limit, next_update) - now);
+			network.poll(scheduler.timeout(static_cast<int>(std::max<int64_t>(0, wait.count()))));
+			reapChildren();
+			scheduler.run();
+			removeBrokenConnections();
+			subscriptions.flush();
+			if(trace_dump_requested() && !dumpTrace(trace_path)){
+				DVR_LOG(Error, "Couldn't dump trace to "<<trace_path);
+			}
+		}
+
+		size_t runningServices() const {
+			size_t running = 0;
+			for(auto* registry : {&services, &retiring}){
+				for(auto& entry : *registry){
+					if(entry.second->getState() == Service::State::RUNNING){
+						++running;
+					}
+				}
+			}
+			return running;
+		}
+
+		/*
+		 * Runs the stop sequence of all running services at once, so the
+		 * slowest one and not the sum of all bounds the shutdown. Requests are
+		 * still served meanwhile. Whatever runs at the shutdown timeout is killed.
+		 */
+		void shutdownServices(){
+			stopping = true;
+			const auto begin = std::chrono::steady_clock::now();
+			const auto deadline = begin + std::chrono::seconds{config.shutdown_timeout};
+			DVR_LOG(Info, "Stopping "<<runningServices()<<" services");
+			for(auto& entry : services){
+				if(entry.second->getState() == Service::State::RUNNING){
+					stopService(*entry.second, config.services.at(entry.first));
+				}
+			}
+			while(runningServices() > 0 && std::chrono::steady_clock::now() < deadline){
+				step(deadline);
+			}
+
+			if(runningServices() > 0){
+				DVR_LOG(Warning, "Killing "<<runningServices()<<" services after the shutdown timeout");
+				for(auto* registry : {&services, &retiring}){
+					for(auto& entry : *registry){
+						entry.second->kill();
+					}
+				}
+				const auto grace = std::chrono::steady_clock::now() + shutdown_kill_grace;
+				while(runningServices() > 0 && std::chrono::steady_clock::now() < grace){
+					step(grace);
+				}
+			}
+			auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin);
+			DVR_LOG(Info, "Services stopped after "<<duration.count()<<"ms");
+		}
+
+		/*
+		 * Writes the stop commands and waits for the stop output or the exit.
+		 * SIGTERM and after the stop timeout SIGKILL follow if it still runs.
+		 */
+		Task stopService(Service& service, const ServiceConfig& conf){
+			if(!conf.stop_commands.empty()){
+				const auto timeout = std::chrono::seconds{conf.stop_command_timeout};
+				// Matching starts before the commands, the relay thread may read the answer right away
+				std::optional<MatchAwaiter> stopped;
+				if(!conf.stop_output.empty()){
+					stopped.emplace(scheduler, service, conf.stop_output, timeout);
+				}
+				for(const std::string& command : conf.stop_commands){
+					if(!service.write(command + "\n")){
+						break;
+					}
+				}
+				if(stopped){
+					// GCC copies the awaiter of co_await *stopped
+					MatchAwaiter& match = *stopped;
+					co_await match;
+				}else{
+					co_await exited(scheduler, service, timeout);
+				}
+			}
+			if(service.getState() == Service::State::RUNNING){
+				service.terminate();
+			}
+		}
+
 		void setup(){
 			config = parseConfig(config_path);
+			if(!startLogger(config.log_path, parseLogLevel(config.log_level))){
+				std::cerr<<"Couldn't open log "<<config.log_path<<std::endl;
+			}
 			
+			DVR_LOG(Info, "Polling with "<<network.eventPoll().backend());
+			raiseFileLimit();
 			setupControlInterface();
+			setupServices();
+		}
+
+		/*
+		 * Every service holds a few fds for its pipes, so the common soft
+		 * limit of 1024 allows only a few hundred services
+		 */
+		void raiseFileLimit(){
+			struct ::rlimit limit;
+			if(::getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max){
+				limit.rlim_cur = limit.rlim_max;
+				if(::setrlimit(RLIMIT_NOFILE, &limit) != 0){
+					DVR_LOG(Warning, "Couldn't raise the file limit to "<<limit.rlim_max);
+				}
+			}
+		}
+
+		/*
+		 * conf has to be the entry in config.services
+		 */
+		Service& registerService(const std::string& name, const ServiceConfig& conf){
+			auto service = std::make_unique<Service>(relay_thread, scheduler, name, conf, *this);
+			status_snapshot.update(name, service->describe());
+			status_page.update(name, makeStatusRecord(*service));
+			subscriptions.addService(*service);
+			if(!health.add(*service, conf, commandQueue(name))){
+				DVR_LOG(Warning, "Not probing "<<name<<", unknown HealthProbe \""<<conf.health_probe<<"\"");
+			}
+			readiness.try_emplace(name, scheduler);
+			return *services.insert(std::make_pair(name, std::move(service))).first->second;
+		}
+
+		void setupServices(){
+			for(auto& entry : config.services){
+				registerService(entry.first, entry.second);
+				if(!parseRestartPolicy(entry.second.restart)){
+					DVR_LOG(Warning, "Not restarting "<<entry.first<<", unknown Restart \""<<entry.second.restart<<"\"");
+				}
+			}
+
+			std::string error;
+			auto order = startupOrder(config.services, error);
+			if(!order){
+				DVR_LOG(Error, "Not starting any service. "<<error);
+				// Nothing is brought up, so nothing becomes ready
+				for(auto& entry : readiness){
+					entry.second.set(false);
+				}
+				return;
+			}
+			for(const std::string& name : *order){
+				const ServiceConfig& conf = config.services.at(name);
+				if(conf.autostart){
+					bringUp(*services.at(name), conf);
+				}else{
+					// Dependents don't wait for a start by hand
+					readiness.at(name).set(false);
+				}
+			}
+		}
+
+		/*
+		 * Starts the service once all its dependencies are ready and sets
+		 * its readiness. Services without dependencies start right away, so
+		 * independent ones come up in parallel.
+		 */
+		Task bringUp(Service& service, const ServiceConfig& conf){
+			Event& ready = readiness.at(service.name());
+			for(const std::string& dependency : conf.after){
+				if(!co_await readiness.at(dependency).wait()){
+					DVR_LOG(Error, "Not starting "<<service.name()<<", because "<<dependency<<" isn't ready");
+					ready.set(false);
+					co_return;
+				}
+			}
+			if(stopping){
+				ready.set(false);
+				co_return;
+			}
+			// Matching starts before the child, it may print the line right away
+			std::optional<MatchAwaiter> ready_line;
+			if(!conf.ready_output.empty()){
+				ready_line.emplace(scheduler, service, conf.ready_output, std::chrono::seconds{conf.ready_timeout});
+			}
+			if(!service.start()){
+				DVR_LOG(Error, "Couldn't start service "<<service.name());
+				ready.set(false);
+				co_return;
+			}
+			if(ready_line){
+				// GCC copies the awaiter of co_await *ready_line
+				MatchAwaiter& match = *ready_line;
+				auto line = co_await match;
+				if(!line){
+					if(service.getState() != Service::State::RUNNING){
+						DVR_LOG(Error, service.name()<<" exited before it was ready");
+					}else{
+						DVR_LOG(Error, service.name()<<" didn't print \""<<conf.ready_output<<"\" within "<<conf.ready_timeout<<"s");
+					}
+					ready.set(false);
+					co_return;
+				}
+			}
+			if(conf.ready_delay > 0){
+				co_await sleep(scheduler, std::chrono::milliseconds{conf.ready_delay});
+			}
+			const bool running = service.getState() == Service::State::RUNNING;
+			if(running){
+				DVR_LOG(Info, service.name()<<" is ready");
+			}else{
+				DVR_LOG(Error, service.name()<<" exited before it was ready");
+			}
+			ready.set(running);
+		}
+
+		/*
+		 * Dependencies were ready for the first start, so they aren't waited
+		 * for again. Looked up by name, the service may be destroyed meanwhile.
+		 */
+		Task restartService(std::string name, std::chrono::seconds delay){
+			co_await sleep(scheduler, delay);
+			auto s_find = services.find(name);
+			if(stopping || s_find == services.end() || s_find->second->getState() == Service::State::RUNNING){
+				co_return;
+			}
+			DVR_LOG(Info, "Restarting "<<name);
+			if(!s_find->second->start()){
+				DVR_LOG(Error, "Couldn't restart service "<<name);
+			}
+		}
+
+		/*
+		 * Stops the service like on shutdown and deletes it once nothing
+		 * refers to it anymore: its bring up has finished, the commands and
+		 * probes queued for it have passed and everything its exit resumed
+		 * has run. Requests don't find it from the start.
+		 */
+		Task destroyService(std::string name, size_t& remaining, Event& destroyed){
+			auto s_find = services.find(name);
+			Service& service = *s_find->second;
+			retiring.insert(std::make_pair(name, std::move(s_find->second)));
+			services.erase(s_find);
+			// No restarts from here on
+			auto c_node = config.services.extract(name);
+			const ServiceConfig& conf = c_node.mapped();
+			health.remove(name);
+			fanouts.erase(name);
+
+			if(service.getState() == Service::State::RUNNING){
+				stopService(service, conf);
+			}
+			while(service.getState() == Service::State::RUNNING){
+				co_await exited(scheduler, service, std::chrono::seconds{conf.stop_command_timeout + conf.stop_timeout + 1});
+			}
+			co_await readiness.at(name).wait();
+			Serializer& commands = commandQueue(name);
+			co_await commands.enter();
+			commands.leave();
+			co_await yield(scheduler);
+
+			unhealthy_services.erase(name);
+			command_queues.erase(name);
+			readiness.erase(name);
+			subscriptions.removeService(name);
+			status_snapshot.remove(name);
+			status_page.remove(name);
+			retiring.erase(name);
+			if(--remaining == 0){
+				destroyed.set(true);
+			}
+		}
+
+		void updateRates(){
+			uint64_t wakeups = collectMetrics().counters[static_cast<size_t>(Counter::EPOLL_WAKEUPS)];
+			wakeups_per_second = wakeups - last_wakeups;
+			last_wakeups = wakeups;
+
+			// Samples the relayed bytes and the cpu time and writes the stored output
+			for(auto& entry : services){
+				entry.second->sampleCpuTime();
+				if(OutputStore* store = entry.second->outputStore()){
+					store->flush();
+				}
+				status_page.update(entry.first, makeStatusRecord(*entry.second));
+			}
+		}
+
+		/*
+		 * Only after SIGCHLD. A signal between the check and the poll is
+		 * handled with the next wakeup, at the latest with the next second.
+		 */
+		void reapChildren(){
+			if(!children_exited()){
+				return;
+			}
+			int status;
+			struct ::rusage usage;
+			pid_t pid;
+			while((pid = ::wait4(-1, &status, WNOHANG, &usage)) > 0){
+				auto cpu = std::chrono::seconds{usage.ru_utime.tv_sec + usage.ru_stime.tv_sec}
+					+ std::chrono::microseconds{usage.ru_utime.tv_usec + usage.ru_stime.tv_usec};
+				bool found = false;
+				for(auto* registry : {&services, &retiring}){
+					for(auto& entry : *registry){
+						if(entry.second->getPID() == pid){
+							entry.second->onExit(status, cpu);
+							found = true;
+							break;
+						}
+					}
+					if(found){
+						break;
+					}
+				}
+			}
+		}
+
+		void removeBrokenConnections(){
+			for(ConnectionId id : broken_connections){
+				scheduler.wake(id);
+				for(auto it = fanouts.begin(); it != fanouts.end();){
+					it->second->remove(id);
+					if(it->second->empty()){
+						it = fanouts.erase(it);
+					}else{
+						++it;
+					}
+				}
+				subscriptions.unsubscribe(id);
+				connection_map.erase(id);
+				DVR_LOG(Debug, "Connection "<<id<<" unregistered in DaemonDevoured");
+			}
+			broken_connections.clear();
 		}
 
 		void setupControlInterface(){
@@ -147,6 +1011,11 @@ namespace dvr {
 			// unix_socket_address = std::make_unique<UnixSocketAddress>(poll, socket_path);
 			// TODO: Check correct file path somewhere
 
+			trace_path = socket_path + ".trace";
+			if(!status_page.open(socket_path + ".status", status_page_entries)){
+				DVR_LOG(Warning, "Couldn't create the status page "<<socket_path<<".status");
+			}
+
 			control_server = network.listen(socket_path,*this);
 			if(!control_server){
 				stop();
@@ -154,6 +1023,7 @@ namespace dvr {
 		}
 
 		Config config;
+		std::string trace_path;
 
 		std::unique_ptr<Server> control_server;
 		std::list<std::unique_ptr<Connection>> control_streams;
@@ -168,46 +1038,593 @@ namespace dvr {
 		void loop(){}
 	};
 
-	class SpawnDevoured final : public Devoured {
+	/*
+	 * Sends a single request of the given type and prints the response
+	 */
+	class RequestDevoured final : public Devoured {
+	private:
+		Client client;
+		
+		const Devoured::Mode type;
+
+		const std::string target;
+		const std::string content;
+	public:
+		RequestDevoured(const Parameter& params, Devoured::Mode t, const std::string& c = ""):
+			Devoured(true, 0),
+			type{t},
+			target{params.target.has_value()?(*params.target):""},
+			content{c}
+		{}
+	protected:
+		void loop()override{
+			if(!client.connect(std::string{"/tmp/devoured/default"}+user_id_string)){
+				setStatus(-1);
+				return;
+			}
+			auto sent = client.send(type, target, content, [](const MessageResponse& resp){
+				std::cout<<resp<<std::endl;
+			});
+			if(!sent.has_value()){
+				setStatus(-1);
+				return;
+			}
+			while(isActive() && client.pendingRequests() > 0){
+				if(!client.poll(1000)){
+					setStatus(-1);
+					break;
+				}
+			}
+		}
+	};
+
+	/*
+	 * Sends one request to several daemons at once. Every line of a response
+	 * is printed prefixed with the socket of its daemon, daemons which didn't
+	 * answer get a line with the reason. Metrics of all daemons are merged.
+	 */
+	class FederatedDevoured final : public Devoured {
+	private:
+		const Devoured::Mode type;
+		const std::string target;
+		const std::string content;
+		std::vector<std::string> addresses;
+		const std::chrono::milliseconds timeout;
+
+		void printMergedMetrics(const std::vector<DaemonResult>& results){
+			MetricsSnapshot total;
+			size_t merged = 0;
+			for(const DaemonResult& result : results){
+				MetricsSnapshot snapshot;
+				if(result.status == DaemonResult::Status::OK && result.responses.size() == 1
+					&& deserializeMetrics(std::vector<uint8_t>{result.responses[0].content.begin(), result.responses[0].content.end()}, snapshot)){
+					mergeMetrics(total, snapshot);
+					++merged;
+				}else{
+					std::cout<<result.address<<" "<<daemonStatusName(result.status)<<"\n";
+					setStatus(1);
+				}
+			}
+			std::cout<<"daemons "<<merged<<"/"<<results.size()<<"\n";
+			std::cout<<formatMetrics(total);
+		}
+	public:
+		FederatedDevoured(const Parameter& params, Devoured::Mode t, const std::string& c = ""):
+			Devoured(true, 0),
+			type{t},
+			target{params.target.has_value()?(*params.target):""},
+			content{c},
+			timeout{params.timeout}
+		{
+			std::istringstream ss{*params.daemons};
+			std::string address;
+			while(std::getline(ss, address, ',')){
+				if(!address.empty()){
+					addresses.push_back(address);
+				}
+			}
+		}
+	protected:
+		void loop()override{
+			const bool merge_metrics = type == Devoured::Mode::METRICS && target.empty();
+			auto results = federatedRequest(addresses, type, target, merge_metrics ? "binary" : content, timeout);
+			if(merge_metrics){
+				printMergedMetrics(results);
+				return;
+			}
+			for(const DaemonResult& result : results){
+				if(result.status != DaemonResult::Status::OK){
+					std::cout<<result.address<<" "<<daemonStatusName(result.status)<<"\n";
+					setStatus(1);
+					continue;
+				}
+				for(const MessageResponse& resp : result.responses){
+					if(resp.return_code != static_cast<uint8_t>(ReturnCode::OK) && resp.return_code != static_cast<uint8_t>(ReturnCode::PARTIAL)){
+						setStatus(1);
+					}
+					std::istringstream lines{resp.content};
+					std::string line;
+					while(std::getline(lines, line)){
+						std::cout<<result.address<<" "<<line<<"\n";
+					}
+				}
+			}
+			std::cout.flush();
+		}
+	};
+
+	/*
+	 * Reads one request per line from a file or stdin and pipelines them over
+	 * a single connection. "<type> [<target>|- [<content>]]", e.g. "status foo"
+	 * or "metrics - binary". Empty lines and lines starting with # are skipped.
+	 * The content of the responses is printed in the order of the requests or,
+	 * tagged with the line number of the request, as soon as it arrives.
+	 */
+	class BatchDevoured final : public Devoured {
+	private:
+		// Unfinished requests at once. Bounds the buffered output of in order mode
+		static const size_t window = 256;
+
+		struct Result {
+			size_t line;
+			std::string output;
+			bool finished;
+		};
+
+		Client client;
+
+		const std::string path;
+		const bool tagged;
+
+		std::deque<Result> results;
+		size_t failures;
+
+		void print(size_t line, const std::string& content){
+			if(!tagged){
+				std::cout<<content;
+				if(!content.empty() && content.back() != '\n'){
+					std::cout<<'\n';
+				}
+				return;
+			}
+			std::istringstream ss{content};
+			std::string output_line;
+			while(std::getline(ss, output_line)){
+				std::cout<<line<<": "<<output_line<<'\n';
+			}
+		}
+
+		void flushResults(){
+			while(!results.empty() && results.front().finished){
+				if(!tagged){
+					print(results.front().line, results.front().output);
+				}
+				results.pop_front();
+			}
+			std::cout.flush();
+		}
+
+		bool sendLine(size_t line_number, const std::string& line){
+			static const std::map<std::string, Devoured::Mode> types{
+				{"status", Devoured::Mode::STATUS},
+				{"metrics", Devoured::Mode::METRICS},
+				{"trace", Devoured::Mode::TRACE},
+				{"resize", Devoured::Mode::RESIZE},
+				{"command", Devoured::Mode::COMMAND},
+				{"create", Devoured::Mode::CREATE},
+				{"destroy", Devoured::Mode::DESTROY},
+				{"output", Devoured::Mode::OUTPUT}
+			};
+			std::istringstream ss{line};
+			std::string type;
+			std::string target;
+			std::string content;
+			ss>>type;
+			if(type.empty() || type.front() == '#'){
+				return true;
+			}
+			ss>>target;
+			ss>>std::ws;
+			std::getline(ss, content);
+			if(target == "-"){
+				target.clear();
+			}
+
+			auto type_find = types.find(type);
+			if(type_find == types.end()){
+				std::cerr<<line_number<<": unknown request type "<<type<<std::endl;
+				++failures;
+				return true;
+			}
+			// Resizing has no response on success
+			if(type_find->second == Devoured::Mode::RESIZE){
+				return client.send(type_find->second, target, content).has_value();
+			}
+
+			results.push_back(Result{line_number, "", false});
+			Result* result = &results.back();
+			auto sent = client.send(type_find->second, target, content, [this, result](const MessageResponse& resp){
+				if(resp.return_code != static_cast<uint8_t>(ReturnCode::OK) && resp.return_code != static_cast<uint8_t>(ReturnCode::PARTIAL)){
+					++failures;
+				}
+				if(tagged){
+					print(result->line, resp.content);
+				}else{
+					result->output += resp.content;
+				}
+				result->finished = resp.return_code != static_cast<uint8_t>(ReturnCode::PARTIAL);
+			});
+			return sent.has_value();
+		}
+	public:
+		BatchDevoured(const Parameter& params):
+			Devoured(true, 0),
+			path{*params.batch},
+			tagged{params.tagged},
+			failures{0}
+		{}
+	protected:
+		void loop()override{
+			std::ifstream file;
+			if(path != "-"){
+				file.open(path);
+				if(!file){
+					std::cerr<<"Couldn't open "<<path<<std::endl;
+					setStatus(-1);
+					return;
+				}
+			}
+			std::istream& input = path == "-" ? std::cin : file;
+
+			if(!client.connect(std::string{"/tmp/devoured/default"}+user_id_string)){
+				std::cerr<<"Couldn't connect to the daemon"<<std::endl;
+				setStatus(-1);
+				return;
+			}
+
+			std::string line;
+			size_t line_number = 0;
+			while(isActive() && std::getline(input, line)){
+				if(!sendLine(++line_number, line)){
+					break;
+				}
+				// Print what already arrived and keep the number of requests in flight bounded
+				do {
+					if(!client.poll(client.pendingRequests() < window ? 0 : -1)){
+						break;
+					}
+					flushResults();
+				}while(client.pendingRequests() >= window);
+			}
+			while(isActive() && client.pendingRequests() > 0 && client.poll()){
+				flushResults();
+			}
+			flushResults();
+
+			if(!client.connected() || !results.empty()){
+				std::cerr<<"Connection to the daemon broke"<<std::endl;
+				setStatus(-1);
+			}else if(failures > 0){
+				setStatus(1);
+			}
+		}
+	};
+
+	/*
+	 * Runs the jobs of a test manifest in parallel. Prints one line per job as
+	 * it finishes, "line=<n> result=<pass|fail|timeout|error> status=<exit code>
+	 * signal=<n> time_us=<n> [mismatch=<offset>]", and a summary on stderr.
+	 */
+	class RunDevoured final : public Devoured {
+	private:
+		const std::string path;
+		TestRunner runner;
+	public:
+		RunDevoured(const Parameter& params):
+			Devoured(true, 0),
+			path{*params.run},
+			runner{params.jobs}
+		{}
+	protected:
+		void loop()override{
+			std::ifstream file;
+			if(path != "-"){
+				file.open(path);
+				if(!file){
+					std::cerr<<"Couldn't open "<<path<<std::endl;
+					setStatus(-1);
+					return;
+				}
+			}
+			std::string error;
+			auto jobs = parseTestManifest(path == "-" ? std::cin : file, error);
+			if(!jobs){
+				std::cerr<<"Invalid job: "<<error<<std::endl;
+				setStatus(-1);
+				return;
+			}
+
+			size_t passed = 0;
+			auto begin = std::chrono::steady_clock::now();
+			runner.run(*jobs, [&passed](const TestJob& job, const TestResult& result){
+				std::cout<<"line="<<job.line<<" result="<<outcomeName(result.outcome);
+				if(result.status >= 0){
+					std::cout<<" status="<<(WIFEXITED(result.status) ? WEXITSTATUS(result.status) : -1);
+					std::cout<<" signal="<<(WIFSIGNALED(result.status) ? WTERMSIG(result.status) : 0);
+				}
+				std::cout<<" time_us="<<result.duration.count();
+				if(result.mismatch){
+					std::cout<<" mismatch="<<*result.mismatch;
+				}
+				std::cout<<'\n';
+				if(result.outcome == TestResult::Outcome::PASS){
+					++passed;
+				}
+			});
+			std::cout.flush();
+
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+			std::cerr<<passed<<"/"<<jobs->size()<<" passed in "<<seconds<<"s, "
+				<<static_cast<uint64_t>(seconds > 0 ? jobs->size() / seconds : 0)<<" jobs/s on "
+				<<runner.workerCount()<<" workers"<<std::endl;
+			if(passed != jobs->size()){
+				setStatus(1);
+			}
+		}
+	};
+
+	/*
+	 * Replays a recorded session against a new instance of its binary. Prints
+	 * "result=<pass|fail|error> status=<exit code> signal=<n> time_us=<n>
+	 * recorded_us=<n> [stdout_mismatch=<offset>] [stderr_mismatch=<offset>]"
+	 */
+	class ReplayDevoured final : public Devoured {
+	private:
+		const std::string path;
+		const double speed;
+	public:
+		ReplayDevoured(const Parameter& params):
+			Devoured(true, 0),
+			path{*params.replay},
+			speed{params.speed}
+		{}
+	protected:
+		void loop()override{
+			std::string error;
+			auto recording = readSessionRecording(path, error);
+			if(!recording){
+				std::cerr<<error<<std::endl;
+				setStatus(-1);
+				return;
+			}
+			// A child which doesn't read its input fails the write instead of killing us
+			::signal(SIGPIPE, SIG_IGN);
+			ReplayResult result = replaySession(*recording, speed);
+			if(!result.started){
+				std::cout<<"result=error"<<std::endl;
+				std::cerr<<"Couldn't start "<<recording->exec<<std::endl;
+				setStatus(-1);
+				return;
+			}
+			const bool passed = result.status_matches && !result.mismatch[0] && !result.mismatch[1];
+			std::cout<<"result="<<(passed ? "pass" : "fail");
+			if(result.status >= 0){
+				std::cout<<" status="<<(WIFEXITED(result.status) ? WEXITSTATUS(result.status) : -1);
+				std::cout<<" signal="<<(WIFSIGNALED(result.status) ? WTERMSIG(result.status) : 0);
+			}
+			std::cout<<" time_us="<<result.duration.count()<<" recorded_us="<<result.recorded.count();
+			if(result.mismatch[0]){
+				std::cout<<" stdout_mismatch="<<*result.mismatch[0];
+			}
+			if(result.mismatch[1]){
+				std::cout<<" stderr_mismatch="<<*result.mismatch[1];
+			}
+			std::cout<<std::endl;
+			if(!passed){
+				setStatus(1);
+			}
+		}
+	};
+
+	/*
+	 * Unix seconds, "HH:MM[:SS]" of today or "YYYY-MM-DD HH:MM[:SS]" in local
+	 * time as us since the epoch. Empty is the open bound.
+	 */
+	static std::optional<int64_t> parseOutputTime(const std::string& text, int64_t open){
+		if(text.empty()){
+			return open;
+		}
+		if(text.find_first_not_of("0123456789.") == std::string::npos){
+			try {
+				return static_cast<int64_t>(std::stod(text) * 1e6);
+			}catch(const std::exception&){
+				return std::nullopt;
+			}
+		}
+		const std::time_t now = std::time(nullptr);
+		std::tm today;
+		::localtime_r(&now, &today);
+		for(const char* format : {"%Y-%m-%d %H:%M:%S", "%Y-%m-%dT%H:%M:%S", "%Y-%m-%d %H:%M", "%Y-%m-%dT%H:%M", "%H:%M:%S", "%H:%M"}){
+			std::tm parsed = today;
+			parsed.tm_sec = 0;
+			const char* rest = ::strptime(text.c_str(), format, &parsed);
+			if(rest && *rest == '\0'){
+				parsed.tm_isdst = -1;
+				return static_cast<int64_t>(std::mktime(&parsed)) * 1000000;
+			}
+		}
+		return std::nullopt;
+	}
+
+	/*
+	 * Turns "--output <from>,<to>" or "--lines <first>,<last>" into the content of an OUTPUT request
+	 */
+	static std::optional<std::string> outputRange(const Parameter& params){
+		const bool lines = params.lines.has_value();
+		const std::string& range = lines ? *params.lines : *params.output;
+		const size_t comma = range.find(',');
+		const std::string first = range.substr(0, comma);
+		const std::string last = comma == std::string::npos ? "" : range.substr(comma + 1);
+		if(lines){
+			try {
+				return "lines " + (first.empty() ? "1" : std::to_string(std::stoll(first))) + " " + (last.empty() ? "-1" : std::to_string(std::stoll(last)));
+			}catch(const std::exception&){
+				return std::nullopt;
+			}
+		}
+		auto from = parseOutputTime(first, std::numeric_limits<int64_t>::min());
+		auto to = parseOutputTime(last, std::numeric_limits<int64_t>::max());
+		if(!from || !to){
+			return std::nullopt;
+		}
+		return "time " + std::to_string(*from) + " " + std::to_string(*to);
+	}
+
+	/*
+	 * Prints a range of the stored output of a service as it arrives
+	 */
+	class OutputDevoured final : public Devoured {
+	private:
+		Client client;
+
+		const std::string target;
+		const std::string range;
 	public:
-		SpawnDevoured():
-			Devoured(true, 0)
+		OutputDevoured(const Parameter& params, const std::string& r):
+			Devoured(true, 0),
+			target{*params.target},
+			range{r}
 		{}
 	protected:
-		void loop(){
+		void loop()override{
+			if(!client.connect(std::string{"/tmp/devoured/default"}+user_id_string)){
+				setStatus(-1);
+				return;
+			}
+			auto sent = client.send(Devoured::Mode::OUTPUT, target, range, [this](const MessageResponse& resp){
+				if(resp.return_code == static_cast<uint8_t>(ReturnCode::OK) || resp.return_code == static_cast<uint8_t>(ReturnCode::PARTIAL)){
+					std::cout.write(resp.content.data(), static_cast<std::streamsize>(resp.content.size()));
+				}else{
+					std::cerr<<resp.content<<std::endl;
+					setStatus(1);
+				}
+			});
+			if(!sent.has_value()){
+				setStatus(-1);
+				return;
+			}
+			while(isActive() && client.pendingRequests() > 0){
+				if(!client.poll(1000)){
+					setStatus(-1);
+					break;
+				}
+			}
+			std::cout.flush();
+		}
+	};
+
+	/*
+	 * Subscribes to service events and prints them until the connection breaks
+	 */
+	class SubscribeDevoured final : public Devoured, public IConnectionStateObserver {
+	private:
+		Network network;
+
+		std::unique_ptr<Connection> connection;
+
+		const std::string target;
+		const std::string spec;
+	public:
+		SubscribeDevoured(const Parameter& params):
+			Devoured(true, 0),
+			connection{nullptr},
+			target{params.target.has_value()?(*params.target):""},
+			spec{*params.subscribe}
+		{}
+
+		void notify(Connection& conn, ConnectionState state) override {
+			switch(state){
+				case ConnectionState::ReadReady:{
+					for(auto opt_msg = asyncReadResponse(conn); opt_msg.has_value(); opt_msg = asyncReadResponse(conn)){
+						if(opt_msg->return_code != static_cast<uint8_t>(ReturnCode::OK)){
+							std::cerr<<opt_msg->content<<std::endl;
+							setStatus(-1);
+							stop();
+							return;
+						}
+						if(opt_msg->request_id == event_request_id){
+							std::cout<<opt_msg->target<<": "<<opt_msg->content;
+							if(opt_msg->content.empty() || opt_msg->content.back() != '\n'){
+								std::cout<<"\n";
+							}
+						}
+					}
+					std::cout.flush();
+				}
+				break;
+				case ConnectionState::Broken:{
+					stop();
+				}
+				break;
+				case ConnectionState::WriteReady:{
+				}
+				break;
+			}
+		}
+	protected:
+		void loop()override{
+			setup();
 			while(isActive()){
+				network.poll(1000);
+			}
+		}
+	private:
+		void setup(){
+			connection = network.connect(std::string{"/tmp/devoured/default"}+user_id_string, *this);
+			MessageRequest msg{
+				0,
+				static_cast<uint8_t>(Devoured::Mode::SUBSCRIBE),
+				target,
+				spec
+			};
+			if(!connection || !asyncWriteRequest(*connection, msg)){
+				stop();
 			}
 		}
 	};
 
-	class StatusDevoured final : public Devoured, public IConnectionStateObserver {
+	/*
+	 * Attaches to a target and prints its output until the connection breaks
+	 */
+	class InteractiveDevoured final : public Devoured, public IConnectionStateObserver {
 	private:
 		Network network;
 
 		uint16_t req_id;
 
 		std::unique_ptr<Connection> connection;
-		
-		std::chrono::steady_clock::time_point next_update;
-		
+
 		const std::string target;
 	public:
-		StatusDevoured(const Parameter& params):
+		InteractiveDevoured(const Parameter& params):
 			Devoured(true, 0),
 			req_id{0},
 			connection{nullptr},
-			next_update{std::chrono::steady_clock::now()},
-			target{params.target.has_value()?(*params.target):""}
+			target{*params.target}
 		{}
 
 		void notify(Connection& conn, ConnectionState state) override {
 			switch(state){
 				case ConnectionState::ReadReady:{
-					auto opt_msg = asyncReadResponse(conn);
-					if(opt_msg.has_value()){
-						std::cout<<(*opt_msg)<<std::endl;
-						stop();
+					for(auto opt_msg = asyncReadResponse(conn); opt_msg.has_value(); opt_msg = asyncReadResponse(conn)){
+						if(opt_msg->return_code != static_cast<uint8_t>(ReturnCode::OK)){
+							std::cerr<<opt_msg->content<<std::endl;
+							stop();
+							return;
+						}
+						std::cout.write(opt_msg->content.data(), opt_msg->content.size());
 					}
+					std::cout.flush();
 				}
 				break;
 				case ConnectionState::Broken:{
@@ -223,17 +1640,18 @@ namespace dvr {
 		void loop()override{
 			setup();
 			while(isActive()){
-				std::this_thread::sleep_until(next_update);
-				next_update += std::chrono::milliseconds{1000};
-				network.poll();
+				network.poll(1000);
+				if(window_resized()){
+					sendWindowSize();
+				}
 			}
 		}
 	private:
 		void setup(){
 			connection = network.connect(std::string{"/tmp/devoured/default"}+user_id_string, *this);
 			MessageRequest msg{
-				0,
-				static_cast<uint8_t>(Parameter::Mode::STATUS),
+				req_id,
+				static_cast<uint8_t>(Devoured::Mode::INTERACTIVE),
 				target,
 				""
 			};
@@ -241,10 +1659,27 @@ namespace dvr {
 				if(!asyncWriteRequest(*connection, msg)){
 					stop();
 				}
+				sendWindowSize();
 			}else{
 				stop();
 			}
 		}
+
+		void sendWindowSize(){
+			struct ::winsize size;
+			if(!connection || ::ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) != 0){
+				return;
+			}
+			std::stringstream ss;
+			ss<<size.ws_row<<" "<<size.ws_col;
+			MessageRequest msg{
+				++req_id,
+				static_cast<uint8_t>(Devoured::Mode::RESIZE),
+				target,
+				ss.str()
+			};
+			asyncWriteRequest(*connection, msg);
+		}
 	};
 
 	Devoured::Devoured(bool act, int sta):
@@ -263,6 +1698,10 @@ namespace dvr {
 		active = false;
 	}
 
+	void Devoured::setStatus(int state){
+		status = state;
+	}
+
 	bool Devoured::isActive()const{
 		return active && !shutdown_requested();
 	}
@@ -289,11 +1728,105 @@ namespace dvr {
 				break;
 			}
 			case Parameter::Mode::CREATE:{
-				context = std::make_unique<SpawnDevoured>();
+				if(!parameter.target.has_value()){
+					std::cerr<<"Creating needs a target"<<std::endl;
+					context = std::make_unique<InvalidDevoured>();
+					break;
+				}
+				std::ifstream file;
+				if(*parameter.spawn != "-"){
+					file.open(*parameter.spawn);
+					if(!file){
+						std::cerr<<"Couldn't open "<<*parameter.spawn<<std::endl;
+						context = std::make_unique<InvalidDevoured>();
+						break;
+					}
+				}
+				std::stringstream table;
+				table<<(*parameter.spawn == "-" ? std::cin : file).rdbuf();
+				context = std::make_unique<RequestDevoured>(parameter, Devoured::Mode::CREATE, table.str());
+				break;
+			}
+			case Parameter::Mode::DESTROY:{
+				if(!parameter.target.has_value()){
+					std::cerr<<"Destroying needs a target"<<std::endl;
+					context = std::make_unique<InvalidDevoured>();
+					break;
+				}
+				context = std::make_unique<RequestDevoured>(parameter, Devoured::Mode::DESTROY);
+				break;
+			}
+			case Parameter::Mode::OUTPUT: {
+				if(!parameter.target.has_value()){
+					std::cerr<<"Reading the output needs a target"<<std::endl;
+					context = std::make_unique<InvalidDevoured>();
+					break;
+				}
+				auto range = outputRange(parameter);
+				if(!range){
+					std::cerr<<"Invalid range. Use --output <from>,<to> or --lines <first>,<last>"<<std::endl;
+					context = std::make_unique<InvalidDevoured>();
+					break;
+				}
+				context = std::make_unique<OutputDevoured>(parameter, *range);
 				break;
 			}
 			case Parameter::Mode::STATUS: {
-				context = std::make_unique<StatusDevoured>(parameter);
+				if(parameter.daemons.has_value()){
+					context = std::make_unique<FederatedDevoured>(parameter, Devoured::Mode::STATUS);
+					break;
+				}
+				context = std::make_unique<RequestDevoured>(parameter, Devoured::Mode::STATUS);
+				break;
+			}
+			case Parameter::Mode::BATCH: {
+				context = std::make_unique<BatchDevoured>(parameter);
+				break;
+			}
+			case Parameter::Mode::RUN: {
+				context = std::make_unique<RunDevoured>(parameter);
+				break;
+			}
+			case Parameter::Mode::REPLAY: {
+				context = std::make_unique<ReplayDevoured>(parameter);
+				break;
+			}
+			case Parameter::Mode::METRICS: {
+				if(parameter.daemons.has_value()){
+					context = std::make_unique<FederatedDevoured>(parameter, Devoured::Mode::METRICS);
+					break;
+				}
+				context = std::make_unique<RequestDevoured>(parameter, Devoured::Mode::METRICS);
+				break;
+			}
+			case Parameter::Mode::TRACE: {
+				context = std::make_unique<RequestDevoured>(parameter, Devoured::Mode::TRACE);
+				break;
+			}
+			case Parameter::Mode::COMMAND: {
+				if(!parameter.target.has_value()){
+					std::cerr<<"A command needs a target"<<std::endl;
+					context = std::make_unique<InvalidDevoured>();
+					break;
+				}
+				if(parameter.daemons.has_value()){
+					context = std::make_unique<FederatedDevoured>(parameter, Devoured::Mode::COMMAND, *parameter.command);
+					break;
+				}
+				context = std::make_unique<RequestDevoured>(parameter, Devoured::Mode::COMMAND, *parameter.command);
+				break;
+			}
+			case Parameter::Mode::SUBSCRIBE: {
+				context = std::make_unique<SubscribeDevoured>(parameter);
+				break;
+			}
+			case Parameter::Mode::INTERACTIVE: {
+				if(!parameter.target.has_value()){
+					std::cerr<<"Interactive mode needs a target"<<std::endl;
+					context = std::make_unique<InvalidDevoured>();
+					break;
+				}
+				context = std::make_unique<InteractiveDevoured>(parameter);
 				break;
 			}
 			default:{
@@ -9,10 +9,43 @@
 namespace dvr {
 	class Devoured {
 	public:
+		/*
+		 * Also used as the request type. Keep the values in sync with Parameter::Mode
+		 */
 		enum class Mode: uint8_t {
 			INVALID,
 			DAEMON,
-			STATUS
+			STATUS,
+			// Attaches to the target. Every output batch is sent as a response with the same request id
+			INTERACTIVE,
+			COMMAND,
+			ALIAS,
+			// Content is a service table like in the config, Instances = <n> creates <target>-0 to <target>-<n-1>.
+			// Created services start right away unless Autostart = false
+			CREATE,
+			// Stops the target and its instances and removes them. Answered once they are gone
+			DESTROY,
+			MANAGE,
+			// Content is "<rows> <columns>" of an attached terminal. Has no response on success
+			RESIZE,
+			// Daemon metrics as text. Content "binary" requests the compact form of serializeMetrics.
+			// With a target only the metrics of that service are sent
+			METRICS,
+			// Dumps the trace rings next to the control socket. Responds with the path
+			TRACE,
+			// Content is the event spec of SubscriptionHub::subscribe. Acknowledged with OK, afterwards
+			// events are pushed with request id event_request_id until the connection closes
+			SUBSCRIBE,
+			// Stored output of the target. Content is "time <from> <to>" in us since the epoch or
+			// "lines <first> <last>" counted from 1, negative from the end. Both bounds are included.
+			// Streamed as PARTIAL responses, the last one is OK
+			OUTPUT,
+			// Client side only. Pipelines the requests of a script over one connection
+			BATCH,
+			// Client side only. Runs the test jobs of a manifest without a daemon
+			RUN,
+			// Client side only. Replays a recorded session without a daemon
+			REPLAY
 		};
 		Devoured(bool act, int sta);
 		virtual ~Devoured() = default;
@@ -0,0 +1,186 @@
+#include "health_monitor.h"
+
+#include <signal.h>
+
+#include <algorithm>
+
+#include "log/log.h"
+#include "metrics/metrics.h"
+#include "service_awaitables.h"
+
+// Due times are rounded up to this, so probes of one tick share a pass
+const auto probe_tick = std::chrono::milliseconds{250};
+
+namespace dvr {
+	std::optional<HealthProbe> parseHealthProbe(const std::string& name){
+		if(name == "alive"){
+			return HealthProbe::ALIVE;
+		}else if(name == "state"){
+			return HealthProbe::STATE;
+		}else if(name == "command"){
+			return HealthProbe::COMMAND;
+		}
+		return std::nullopt;
+	}
+
+	HealthMonitor::HealthMonitor(Scheduler& s, IHealthObserver& obsrv):
+		scheduler{s},
+		observer{obsrv},
+		next_pass{Scheduler::Clock::time_point::max()}
+	{}
+
+	HealthMonitor::~HealthMonitor() = default;
+
+	bool HealthMonitor::add(Service& service, const ServiceConfig& config, Serializer& commands){
+		if(config.health_interval == 0){
+			return true;
+		}
+		auto probe = parseHealthProbe(config.health_probe);
+		if(!probe){
+			return false;
+		}
+		Entry entry{
+			service,
+			*probe,
+			std::chrono::seconds{config.health_interval},
+			std::chrono::seconds{config.health_timeout},
+			config.health_command,
+			config.health_output,
+			config.health_retries,
+			commands,
+			Scheduler::Clock::time_point::max(),
+			0,
+			false,
+			false
+		};
+		entries.erase(service.name());
+		entries.emplace(service.name(), std::move(entry));
+		if(service.getState() == Service::State::RUNNING){
+			started(service);
+		}
+		return true;
+	}
+
+	void HealthMonitor::remove(const std::string& name){
+		entries.erase(name);
+	}
+
+	void HealthMonitor::started(Service& service){
+		auto e_find = entries.find(service.name());
+		if(e_find == entries.end()){
+			return;
+		}
+		Entry& entry = e_find->second;
+		entry.due = Scheduler::Clock::now() + entry.interval;
+		entry.failures = 0;
+		entry.reported = false;
+		schedule(entry.due);
+	}
+
+	void HealthMonitor::schedule(Scheduler::Clock::time_point due){
+		const auto since = std::chrono::ceil<std::chrono::milliseconds>(due.time_since_epoch());
+		const auto rounded = Scheduler::Clock::time_point{((since + probe_tick - std::chrono::milliseconds{1}) / probe_tick) * probe_tick};
+		if(!armed() || rounded < next_pass){
+			next_pass = rounded;
+			scheduler.arm(*this, rounded);
+		}
+	}
+
+	void HealthMonitor::expired(){
+		const auto now = Scheduler::Clock::now();
+		auto next = Scheduler::Clock::time_point::max();
+		uint64_t probed = 0;
+		for(auto& [name, entry] : entries){
+			if(entry.service.getState() != Service::State::RUNNING || entry.reported){
+				continue;
+			}
+			if(!entry.pending && entry.due <= now){
+				entry.due = now + entry.interval;
+				++probed;
+				if(entry.probe == HealthProbe::COMMAND){
+					entry.pending = true;
+					// Runs up to the answer right away. Scheduled again once it is done
+					probeCommand(name);
+				}else{
+					report(entry, probe(entry));
+				}
+			}
+			if(!entry.pending && !entry.reported){
+				next = std::min(next, entry.due);
+			}
+		}
+		increment(Counter::HEALTH_PROBES, probed);
+		increment(Counter::HEALTH_PROBE_NS, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Scheduler::Clock::now() - now).count()));
+		if(next != Scheduler::Clock::time_point::max()){
+			schedule(next);
+		}
+	}
+
+	bool HealthMonitor::probe(Entry& entry){
+		const int pid = entry.service.getPID();
+		if(pid <= 0){
+			return false;
+		}
+		if(entry.probe == HealthProbe::ALIVE){
+			return ::kill(pid, 0) == 0;
+		}
+
+		switch(entry.service.schedulingState()){
+			case '\0':
+			case 'D':
+			case 'T':
+			case 't':
+			case 'Z':
+				return false;
+		}
+		return true;
+	}
+
+	Task HealthMonitor::probeCommand(std::string name){
+		Entry& entry = entries.at(name);
+		Service& service = entry.service;
+		Serializer& commands = entry.commands;
+		const std::string command = entry.command;
+		const std::string output = entry.output;
+		const auto timeout = entry.timeout;
+
+		co_await commands.enter();
+		std::optional<std::string> line;
+		if(service.getState() == Service::State::RUNNING){
+			// Matching starts before the command, the relay thread may read the answer right away
+			MatchAwaiter answer{scheduler, service, output, timeout};
+			if(service.write(command + "\n")){
+				line = co_await answer;
+			}
+		}
+		commands.leave();
+
+		auto e_find = entries.find(name);
+		if(e_find == entries.end()){
+			co_return;
+		}
+		e_find->second.pending = false;
+		// An exit isn't a failed probe, the next run starts over
+		if(service.getState() != Service::State::RUNNING){
+			co_return;
+		}
+		report(e_find->second, line.has_value());
+		if(!e_find->second.reported){
+			schedule(e_find->second.due);
+		}
+	}
+
+	void HealthMonitor::report(Entry& entry, bool healthy){
+		if(healthy){
+			entry.failures = 0;
+			return;
+		}
+		increment(Counter::HEALTH_PROBE_FAILURES);
+		if(++entry.failures < std::max<uint32_t>(1, entry.retries)){
+			return;
+		}
+		entry.reported = true;
+		DVR_LOG(Warning, entry.service.name()<<" failed "<<entry.failures<<" health probes in a row");
+		observer.unhealthy(entry.service);
+	}
+}
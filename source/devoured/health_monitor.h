@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+
+#include "config/config.h"
+#include "coro/scheduler.h"
+#include "coro/serializer.h"
+#include "coro/task.h"
+#include "service.h"
+
+namespace dvr {
+	enum class HealthProbe : uint8_t {
+		// The process exists
+		ALIVE,
+		// The process isn't stuck in uninterruptible sleep (D), stopped (T) or a zombie
+		STATE,
+		// A command written to stdin is answered with a matching line
+		COMMAND
+	};
+
+	std::optional<HealthProbe> parseHealthProbe(const std::string& name);
+
+	class IHealthObserver {
+	public:
+		virtual ~IHealthObserver() = default;
+
+		/*
+		 * Called once per run after the configured number of failed probes in a row
+		 */
+		virtual void unhealthy(Service& service) = 0;
+	};
+
+	/*
+	 * Probes running services periodically. A single timer drives all of
+	 * them: due times are rounded up to a common tick and every expiry is
+	 * one pass over the registry, so services with the same interval are
+	 * probed together instead of waking the loop one by one.
+	 *
+	 * Alive and state probes are a syscall or a read of /proc and run in the
+	 * pass. Command probes queue behind the commands of clients and only
+	 * start in the pass.
+	 */
+	class HealthMonitor final : private Scheduler::Timer {
+	private:
+		struct Entry {
+			Service& service;
+			HealthProbe probe;
+			Scheduler::Clock::duration interval;
+			Scheduler::Clock::duration timeout;
+			std::string command;
+			std::string output;
+			uint32_t retries;
+			// Serializes the command probe with the commands of clients
+			Serializer& commands;
+
+			Scheduler::Clock::time_point due;
+			uint32_t failures;
+			// A command probe waits for its answer
+			bool pending;
+			// Reported for the current run already
+			bool reported;
+		};
+
+		Scheduler& scheduler;
+		IHealthObserver& observer;
+		/*
+		 * Key - Service name
+		 */
+		std::map<std::string, Entry> entries;
+		// Deadline of the armed pass
+		Scheduler::Clock::time_point next_pass;
+
+		/*
+		 * The pass over all entries
+		 */
+		void expired() override;
+		void schedule(Scheduler::Clock::time_point due);
+		bool probe(Entry& entry);
+		Task probeCommand(std::string name);
+		void report(Entry& entry, bool healthy);
+	public:
+		HealthMonitor(Scheduler& s, IHealthObserver& obsrv);
+		~HealthMonitor();
+
+		/*
+		 * Does nothing if the interval of the config is 0. Returns false for an unknown probe.
+		 */
+		bool add(Service& service, const ServiceConfig& config, Serializer& commands);
+		void remove(const std::string& name);
+
+		/*
+		 * The first probe of a run is due an interval after the start
+		 */
+		void started(Service& service);
+	};
+}
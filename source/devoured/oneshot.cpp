@@ -0,0 +1,112 @@
+#include "oneshot.h"
+
+#include <unistd.h>
+
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "client/client.h"
+#include "devoured.h"
+#include "status_page.h"
+
+// Limit for connecting, writing and each read
+const int oneshot_timeout_ms = 5000;
+
+namespace dvr {
+	/*
+	 * Answers STATUS from the status page without waking the daemon.
+	 * Returns false if the socket has to be asked, e.g. for unknown targets
+	 * or status lines which didn't fit into their record.
+	 */
+	bool printStatusPage(const std::string& path, const std::string& target){
+		auto records = readStatusPage(path);
+		if(!records.has_value()){
+			return false;
+		}
+		std::string content;
+		for(const StatusRecord& record : *records){
+			if(target.empty()){
+				if(record.truncated){
+					return false;
+				}
+				content += record.description;
+				content += '\n';
+			}else if(target == record.name){
+				if(record.truncated){
+					return false;
+				}
+				content = record.description;
+				break;
+			}
+		}
+		if(content.empty()){
+			if(!target.empty()){
+				return false;
+			}
+			content = "Currently no service registered";
+		}
+		MessageResponse resp{
+			0,
+			static_cast<uint8_t>(ReturnCode::OK),
+			target,
+			content
+		};
+		std::cout<<resp<<std::endl;
+		return true;
+	}
+
+	std::optional<int> runOneShot(int argc, char** argv){
+		std::optional<Devoured::Mode> type;
+		std::string target;
+
+		// Only the plain spellings are handled here. Everything else goes through cxxopts
+		for(int i = 1; i < argc; ++i){
+			const char* arg = argv[i];
+			std::optional<Devoured::Mode> arg_type;
+			if(std::strcmp(arg, "-s") == 0 || std::strcmp(arg, "--status") == 0){
+				arg_type = Devoured::Mode::STATUS;
+			}else if(std::strcmp(arg, "--metrics") == 0){
+				arg_type = Devoured::Mode::METRICS;
+			}else if(std::strcmp(arg, "--trace") == 0){
+				arg_type = Devoured::Mode::TRACE;
+			}else if((std::strcmp(arg, "-t") == 0 || std::strcmp(arg, "--target") == 0) && i + 1 < argc){
+				target = argv[++i];
+				continue;
+			}else if(std::strncmp(arg, "--target=", 9) == 0){
+				target = arg + 9;
+				continue;
+			}else{
+				return std::nullopt;
+			}
+			if(type.has_value()){
+				return std::nullopt;
+			}
+			type = arg_type;
+		}
+		if(!type.has_value()){
+			return std::nullopt;
+		}
+
+		std::string address = "/tmp/devoured/default-" + std::to_string(::getuid());
+		if(*type == Devoured::Mode::STATUS && printStatusPage(address + ".status", target)){
+			return 0;
+		}
+
+		MessageRequest request{
+			0,
+			static_cast<uint8_t>(*type),
+			target,
+			""
+		};
+		auto responses = blockingRequest(address, request, oneshot_timeout_ms);
+		if(!responses.has_value()){
+			std::cerr<<"Couldn't get a response from the daemon at "<<address<<std::endl;
+			return -1;
+		}
+		for(const MessageResponse& resp : *responses){
+			std::cout<<resp<<std::endl;
+		}
+		return 0;
+	}
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <optional>
+
+namespace dvr {
+	/*
+	 * Fast path for single request invocations like "devoured -s -t foo".
+	 * Skips the option parser, the signal handlers and the event loop.
+	 * Returns the exit status or std::nullopt if the arguments need the
+	 * full path through createContext.
+	 */
+	std::optional<int> runOneShot(int argc, char** argv);
+}
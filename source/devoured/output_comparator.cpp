@@ -0,0 +1,208 @@
+#include "output_comparator.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Compared parts of the expected file are released in steps of this size. A multiple of the page size
+const size_t release_granularity = 1024 * 1024;
+
+namespace dvr {
+	namespace {
+		bool isSpace(uint8_t c){
+			return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+		}
+	}
+
+	size_t firstMismatch(const uint8_t* a, const uint8_t* b, size_t n){
+		size_t i = 0;
+#ifdef __SSE2__
+		// 16 bytes per compare. The mask has a bit for every equal byte
+		for(; i + 16 <= n; i += 16){
+			__m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+			__m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+			unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb))) ^ 0xFFFFu;
+			if(mask != 0){
+				return i + static_cast<size_t>(__builtin_ctz(mask));
+			}
+		}
+#else
+		// memcmp is vectorized by the libc, it only doesn't tell where
+		for(; i + 64 <= n && std::memcmp(a + i, b + i, 64) == 0; i += 64){}
+#endif
+		for(; i < n; ++i){
+			if(a[i] != b[i]){
+				return i;
+			}
+		}
+		return n;
+	}
+
+	OutputComparator::OutputComparator(Normalization norm):
+		normalization{norm},
+		expected{nullptr},
+		expected_size{0},
+		compared_size{0},
+		position{0},
+		released{0},
+		offset{0},
+		mismatch{std::nullopt},
+		pending_space{false},
+		started{false}
+	{}
+
+	OutputComparator::~OutputComparator(){
+		if(expected){
+			::munmap(const_cast<uint8_t*>(expected), expected_size);
+		}
+	}
+
+	bool OutputComparator::open(const std::string& path){
+		int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if(fd < 0){
+			return false;
+		}
+		struct ::stat st;
+		if(::fstat(fd, &st) != 0){
+			::close(fd);
+			return false;
+		}
+		expected_size = static_cast<size_t>(st.st_size);
+		// Empty files can't be mapped
+		if(expected_size > 0){
+			void* addr = ::mmap(nullptr, expected_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if(addr == MAP_FAILED){
+				::close(fd);
+				return false;
+			}
+			::madvise(addr, expected_size, MADV_SEQUENTIAL);
+			expected = static_cast<const uint8_t*>(addr);
+		}
+		::close(fd);
+
+		compared_size = expected_size;
+		if(normalization == Normalization::TRAILING){
+			while(compared_size > 0 && isSpace(expected[compared_size - 1])){
+				--compared_size;
+			}
+		}
+		return true;
+	}
+
+	/*
+	 * Drops the compared pages from memory, so a long output doesn't map
+	 * the whole expected file
+	 */
+	void OutputComparator::release(){
+		static const size_t page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+		const size_t end = position / release_granularity * release_granularity;
+		if(end > released){
+			::madvise(const_cast<uint8_t*>(expected) + released, (end - released) / page_size * page_size, MADV_DONTNEED);
+			released = end;
+		}
+	}
+
+	void OutputComparator::feedExact(const uint8_t* data, size_t n){
+		const size_t comparable = std::min(n, compared_size - position);
+		const size_t equal = firstMismatch(data, expected + position, comparable);
+		if(equal < comparable){
+			mismatch = offset + equal;
+			return;
+		}
+		position += comparable;
+		offset += comparable;
+		if(comparable == n){
+			return;
+		}
+		// Output beyond the expected file. TRAILING allows whitespace
+		for(size_t i = comparable; i < n; ++i){
+			if(normalization != Normalization::TRAILING || !isSpace(data[i])){
+				mismatch = offset + (i - comparable);
+				return;
+			}
+		}
+		offset += n - comparable;
+	}
+
+	void OutputComparator::feedWhitespace(const uint8_t* data, size_t n){
+		for(size_t i = 0; i < n; ++i, ++offset){
+			const uint8_t c = data[i];
+			if(isSpace(c)){
+				pending_space = true;
+				continue;
+			}
+			if(!started || pending_space){
+				// A run of whitespace in the output needs one in the expected file, except at the start
+				bool expected_space = false;
+				while(position < expected_size && isSpace(expected[position])){
+					++position;
+					expected_space = true;
+				}
+				if(started && !expected_space){
+					mismatch = offset;
+					return;
+				}
+			}else if(position < expected_size && isSpace(expected[position])){
+				mismatch = offset;
+				return;
+			}
+			if(position >= expected_size || expected[position] != c){
+				mismatch = offset;
+				return;
+			}
+			++position;
+			started = true;
+			pending_space = false;
+		}
+	}
+
+	bool OutputComparator::feed(const uint8_t* data, size_t n){
+		if(mismatch){
+			return false;
+		}
+		if(normalization == Normalization::WHITESPACE){
+			feedWhitespace(data, n);
+		}else{
+			feedExact(data, n);
+		}
+		release();
+		return !mismatch;
+	}
+
+	std::optional<uint64_t> OutputComparator::finish(){
+		if(mismatch){
+			return mismatch;
+		}
+		if(normalization == Normalization::WHITESPACE){
+			while(position < expected_size && isSpace(expected[position])){
+				++position;
+			}
+			if(position < expected_size){
+				mismatch = offset;
+			}
+		}else if(position < compared_size){
+			// The output ended early
+			mismatch = offset;
+		}
+		return mismatch;
+	}
+
+	std::optional<OutputComparator::Normalization> parseNormalization(const std::string& name){
+		if(name == "exact"){
+			return OutputComparator::Normalization::EXACT;
+		}else if(name == "trailing"){
+			return OutputComparator::Normalization::TRAILING;
+		}else if(name == "whitespace"){
+			return OutputComparator::Normalization::WHITESPACE;
+		}
+		return std::nullopt;
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace dvr {
+	/*
+	 * Index of the first differing byte of a and b, n if they are equal
+	 */
+	size_t firstMismatch(const uint8_t* a, const uint8_t* b, size_t n);
+
+	/*
+	 * Compares output with an expected file while the output arrives. The
+	 * expected file is mapped, so the memory doesn't grow with the output.
+	 */
+	class OutputComparator {
+	public:
+		enum class Normalization : uint8_t {
+			EXACT,
+			// Whitespace at the end of the output and of the expected file is ignored
+			TRAILING,
+			// Every run of whitespace equals every other, leading and trailing runs are ignored
+			WHITESPACE
+		};
+	private:
+		const Normalization normalization;
+
+		const uint8_t* expected;
+		size_t expected_size;
+		// TRAILING compares up to here, the rest is whitespace
+		size_t compared_size;
+
+		size_t position;
+		// Compared pages before this are given back
+		size_t released;
+		uint64_t offset;
+		std::optional<uint64_t> mismatch;
+		// WHITESPACE only. Whitespace was skipped in the output since the last compared byte
+		bool pending_space;
+		bool started;
+
+		void release();
+		void feedExact(const uint8_t* data, size_t n);
+		void feedWhitespace(const uint8_t* data, size_t n);
+	public:
+		OutputComparator(Normalization norm = Normalization::EXACT);
+		~OutputComparator();
+
+		OutputComparator(const OutputComparator&) = delete;
+		OutputComparator& operator=(const OutputComparator&) = delete;
+
+		bool open(const std::string& path);
+
+		/*
+		 * Returns false once the output diverged. Later output is ignored.
+		 */
+		bool feed(const uint8_t* data, size_t n);
+		/*
+		 * Called at the end of the output. Returns the offset in the output
+		 * where it diverged or std::nullopt if it matched.
+		 */
+		std::optional<uint64_t> finish();
+	};
+
+	std::optional<OutputComparator::Normalization> parseNormalization(const std::string& name);
+}
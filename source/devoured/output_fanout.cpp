@@ -0,0 +1,72 @@
+#include "output_fanout.h"
+
+#include <algorithm>
+
+#include "network/protocol.h"
+#include "trace/trace.h"
+
+namespace dvr {
+	OutputFanout::OutputFanout(Service& srv):
+		service{srv}
+	{
+		service.follow(*this);
+	}
+
+	OutputFanout::~OutputFanout(){
+		service.unfollow(*this);
+	}
+
+	void OutputFanout::add(Connection& connection, uint16_t request_id){
+		followers.insert(std::make_pair(connection.id(), Follower{connection, request_id}));
+	}
+
+	void OutputFanout::remove(ConnectionId id){
+		followers.erase(id);
+	}
+
+	bool OutputFanout::empty() const {
+		return followers.empty();
+	}
+
+	const std::vector<SharedBuffer>& OutputFanout::framesFor(uint16_t request_id){
+		// Attached clients mostly use the same request id, so this stays short
+		for(auto& entry : frames){
+			if(entry.first == request_id){
+				return entry.second;
+			}
+		}
+		frames.emplace_back(request_id, std::vector<SharedBuffer>{});
+		std::vector<SharedBuffer>& buffers = frames.back().second;
+		buffers.reserve(2 * contents.size());
+		for(const SharedBuffer& content : contents){
+			std::vector<uint8_t> header;
+			if(!serializeResponseHeader(header, request_id, static_cast<uint8_t>(ReturnCode::OK), service.name(), content->size())){
+				continue;
+			}
+			buffers.push_back(std::make_shared<const std::vector<uint8_t>>(std::move(header)));
+			buffers.push_back(content);
+		}
+		return buffers;
+	}
+
+	void OutputFanout::notify(Service& srv, const uint8_t* data, size_t n){
+		if(followers.empty()){
+			return;
+		}
+		const size_t max_size = maxResponseContentSize() - srv.name().size();
+		for(size_t offset = 0; offset < n; offset += max_size){
+			const size_t size = std::min(max_size, n - offset);
+			contents.push_back(std::make_shared<const std::vector<uint8_t>>(data + offset, data + offset + size));
+		}
+
+		for(auto& entry : followers){
+			Follower& follower = entry.second;
+			const std::vector<SharedBuffer>& buffers = framesFor(follower.request_id);
+			DVR_TRACE(WRITE_RESPONSE, entry.first, follower.request_id, n);
+			follower.connection.write(buffers);
+		}
+		// From here on only the write queues hold the chunk
+		frames.clear();
+		contents.clear();
+	}
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "network/network.h"
+#include "service.h"
+
+namespace dvr {
+	/*
+	 * Sends the output of one service to all attached connections. Every
+	 * chunk is copied once into shared content buffers. Followers only get
+	 * references to them plus a small header for their request id, so the
+	 * memory per chunk doesn't grow with the number of followers. A chunk is
+	 * freed once the slowest follower has sent it.
+	 */
+	class OutputFanout final : public IServiceOutputObserver {
+	private:
+		struct Follower {
+			Connection& connection;
+			const uint16_t request_id;
+		};
+
+		Service& service;
+		/*
+		 * Key - ConnId - Connection ID of the attached client
+		 */
+		std::multimap<ConnectionId, Follower> followers;
+
+		// Reused between chunks
+		std::vector<SharedBuffer> contents;
+		// Headers and contents in send order per request id
+		std::vector<std::pair<uint16_t, std::vector<SharedBuffer>>> frames;
+
+		const std::vector<SharedBuffer>& framesFor(uint16_t request_id);
+	public:
+		OutputFanout(Service& srv);
+		~OutputFanout();
+
+		OutputFanout(const OutputFanout&) = delete;
+		OutputFanout& operator=(const OutputFanout&) = delete;
+
+		void add(Connection& connection, uint16_t request_id);
+		void remove(ConnectionId id);
+		bool empty() const;
+
+		void notify(Service& srv, const uint8_t* data, size_t n) override;
+	};
+}
@@ -0,0 +1,525 @@
+#include "output_store.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+#include "log/log.h"
+
+// Buffered output is written once it reaches this
+const size_t store_block_size = 64 * 1024;
+// Bytes between index entries. A line query scans at most this far for a line end
+const uint64_t index_block_size = 4 * 1024;
+// Output after a pause this long gets an entry. The precision of time queries
+const int64_t index_resolution_us = 10 * 1000;
+// Times in segment names are padded, so the names sort by time
+const int segment_name_digits = 20;
+const std::string log_extension = ".log";
+const std::string index_extension = ".idx";
+
+namespace dvr {
+	class MappedFile {
+	private:
+		const uint8_t* address;
+		size_t length;
+	public:
+		MappedFile(const uint8_t* a, size_t l):
+			address{a},
+			length{l}
+		{}
+
+		~MappedFile(){
+			if(length > 0){
+				::munmap(const_cast<uint8_t*>(address), length);
+			}
+		}
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		/*
+		 * Maps up to size bytes. A shorter file is mapped as far as it goes
+		 */
+		static std::shared_ptr<const MappedFile> open(const std::string& path, uint64_t size, int advice){
+			int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+			if(fd < 0){
+				return nullptr;
+			}
+			struct ::stat info;
+			size = ::fstat(fd, &info) == 0 ? std::min<uint64_t>(size, static_cast<uint64_t>(info.st_size)) : 0;
+			void* addr = nullptr;
+			if(size > 0){
+				addr = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+			}
+			::close(fd);
+			if(addr == MAP_FAILED){
+				return nullptr;
+			}
+			if(addr){
+				::madvise(addr, size, advice);
+			}
+			return std::make_shared<const MappedFile>(static_cast<const uint8_t*>(addr), static_cast<size_t>(size));
+		}
+
+		const uint8_t* data() const {
+			return address;
+		}
+
+		size_t size() const {
+			return length;
+		}
+	};
+
+	namespace {
+		int64_t toMicros(std::chrono::system_clock::time_point time){
+			return std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+		}
+
+		bool readAt(int fd, void* data, size_t n, uint64_t offset){
+			size_t done = 0;
+			while(done < n){
+				ssize_t got = ::pread(fd, static_cast<uint8_t*>(data) + done, n - done, static_cast<off_t>(offset + done));
+				if(got < 0 && errno == EINTR){
+					continue;
+				}
+				if(got <= 0){
+					return false;
+				}
+				done += static_cast<size_t>(got);
+			}
+			return true;
+		}
+
+		bool writeAll(int fd, const uint8_t* data, size_t n){
+			size_t written = 0;
+			while(written < n){
+				ssize_t done = ::write(fd, data + written, n - written);
+				if(done < 0){
+					if(errno == EINTR){
+						continue;
+					}
+					return false;
+				}
+				written += static_cast<size_t>(done);
+			}
+			return true;
+		}
+	}
+
+	OutputRange::OutputRange():
+		current{0}
+	{}
+
+	OutputRange::OutputRange(std::vector<Piece> p):
+		pieces{std::move(p)},
+		current{0}
+	{}
+
+	uint64_t OutputRange::size() const {
+		uint64_t remaining = 0;
+		for(size_t i = current; i < pieces.size(); ++i){
+			remaining += pieces[i].end - pieces[i].begin;
+		}
+		return remaining;
+	}
+
+	bool OutputRange::empty() const {
+		return size() == 0;
+	}
+
+	size_t OutputRange::read(std::vector<uint8_t>& buffer, size_t n){
+		size_t copied = 0;
+		while(copied < n && current < pieces.size()){
+			Piece& piece = pieces[current];
+			const size_t take = static_cast<size_t>(std::min<uint64_t>(n - copied, piece.end - piece.begin));
+			const uint8_t* begin = piece.file->data() + piece.begin;
+			buffer.insert(buffer.end(), begin, begin + take);
+			piece.begin += take;
+			copied += take;
+			if(piece.begin == piece.end){
+				// Unmapped as soon as it is sent
+				piece.file.reset();
+				++current;
+			}
+		}
+		return copied;
+	}
+
+	OutputStore::OutputStore():
+		segment_size{0},
+		segment_age{0},
+		max_segments{0},
+		log_fd{-1},
+		index_fd{-1},
+		entry_time{0},
+		entry_offset{0},
+		lines{0},
+		partial_line{false},
+		last_time{0},
+		failed{true}
+	{}
+
+	OutputStore::~OutputStore(){
+		closeSegment();
+	}
+
+	bool OutputStore::open(const std::string& dir, uint64_t max_segment_size, std::chrono::seconds max_segment_age, uint32_t kept_segments){
+		std::lock_guard<std::mutex> lock{mutex};
+		directory = dir;
+		segment_size = std::max<uint64_t>(1, max_segment_size);
+		segment_age = max_segment_age;
+		max_segments = kept_segments;
+		// Including the parents, instances store below a common directory
+		for(size_t slash = directory.find('/', 1); ; slash = directory.find('/', slash + 1)){
+			const std::string path = directory.substr(0, slash);
+			if(::mkdir(path.c_str(), 0755) != 0 && errno != EEXIST){
+				return false;
+			}
+			if(slash == std::string::npos){
+				break;
+			}
+		}
+		if(!load()){
+			return false;
+		}
+		removeOldSegments();
+		failed = false;
+		return true;
+	}
+
+	bool OutputStore::load(){
+		DIR* handle = ::opendir(directory.c_str());
+		if(!handle){
+			return false;
+		}
+		std::vector<std::string> names;
+		while(const ::dirent* entry = ::readdir(handle)){
+			const std::string name = entry->d_name;
+			if(name.size() == segment_name_digits + index_extension.size()
+				&& name.compare(segment_name_digits, std::string::npos, index_extension) == 0
+				&& name.find_first_not_of("0123456789") == segment_name_digits){
+				names.push_back(name.substr(0, segment_name_digits));
+			}
+		}
+		::closedir(handle);
+		std::sort(names.begin(), names.end());
+
+		IndexEntry newest{0, 0, 0};
+		for(const std::string& name : names){
+			Segment segment{directory + "/" + name, 0, 0, 0, 0, 0};
+			struct ::stat log_info;
+			struct ::stat index_info;
+			if(::stat((segment.base + log_extension).c_str(), &log_info) != 0 || ::stat((segment.base + index_extension).c_str(), &index_info) != 0){
+				continue;
+			}
+			segment.size = static_cast<uint64_t>(log_info.st_size);
+			// A partly written last entry is dropped
+			segment.entries = static_cast<uint64_t>(index_info.st_size) / sizeof(IndexEntry);
+			if(segment.entries == 0){
+				continue;
+			}
+			int fd = ::open((segment.base + index_extension).c_str(), O_RDONLY | O_CLOEXEC);
+			if(fd < 0){
+				continue;
+			}
+			IndexEntry first;
+			IndexEntry last;
+			const bool complete = readAt(fd, &first, sizeof(first), 0) && readAt(fd, &last, sizeof(last), (segment.entries - 1) * sizeof(IndexEntry));
+			::close(fd);
+			if(!complete){
+				continue;
+			}
+			segment.first_time = first.time;
+			segment.last_time = last.time;
+			segment.first_line = first.line;
+			segments.push_back(segment);
+			newest = last;
+		}
+		if(segments.empty()){
+			return true;
+		}
+
+		// Lines after the last entry of the newest segment
+		const Segment& segment = segments.back();
+		last_time = segment.last_time;
+		lines = newest.line;
+		int fd = ::open((segment.base + log_extension).c_str(), O_RDONLY | O_CLOEXEC);
+		if(fd < 0){
+			return true;
+		}
+		std::vector<uint8_t> chunk(store_block_size);
+		for(uint64_t offset = std::min(newest.offset, segment.size); offset < segment.size;){
+			const size_t n = static_cast<size_t>(std::min<uint64_t>(chunk.size(), segment.size - offset));
+			if(!readAt(fd, chunk.data(), n, offset)){
+				break;
+			}
+			lines += static_cast<uint64_t>(std::count(chunk.begin(), chunk.begin() + n, '\n'));
+			partial_line = chunk[n - 1] != '\n';
+			offset += n;
+		}
+		::close(fd);
+		return true;
+	}
+
+	bool OutputStore::startSegment(int64_t time){
+		std::string base;
+		// Two segments may start within the same microsecond
+		for(int64_t name_time = time;; ++name_time){
+			std::ostringstream ss;
+			ss<<directory<<"/"<<std::setw(segment_name_digits)<<std::setfill('0')<<name_time;
+			base = ss.str();
+			log_fd = ::open((base + log_extension).c_str(), O_WRONLY | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC, 0644);
+			if(log_fd >= 0 || errno != EEXIST){
+				break;
+			}
+		}
+		if(log_fd < 0){
+			return false;
+		}
+		index_fd = ::open((base + index_extension).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+		if(index_fd < 0){
+			::close(log_fd);
+			log_fd = -1;
+			::unlink((base + log_extension).c_str());
+			return false;
+		}
+		segments.push_back(Segment{base, time, time, lines, 0, 0});
+		removeOldSegments();
+		return true;
+	}
+
+	void OutputStore::closeSegment(){
+		if(log_fd < 0){
+			return;
+		}
+		writeBuffers();
+		if(log_fd >= 0){
+			::close(log_fd);
+			::close(index_fd);
+			log_fd = -1;
+			index_fd = -1;
+		}
+	}
+
+	void OutputStore::removeOldSegments(){
+		// The open segment is the newest, it is never removed
+		while(max_segments > 0 && segments.size() > max_segments){
+			::unlink((segments.front().base + log_extension).c_str());
+			::unlink((segments.front().base + index_extension).c_str());
+			segments.erase(segments.begin());
+		}
+	}
+
+	void OutputStore::append(const uint8_t* data, size_t n, std::chrono::system_clock::time_point time_point){
+		std::lock_guard<std::mutex> lock{mutex};
+		if(failed || n == 0){
+			return;
+		}
+		const int64_t time = std::max(toMicros(time_point), last_time);
+		last_time = time;
+		const int64_t max_age = std::chrono::duration_cast<std::chrono::microseconds>(segment_age).count();
+		while(n > 0){
+			if(log_fd < 0 && !startSegment(time)){
+				DVR_LOG(Error, "Stopped storing output in "<<directory<<", creating a segment failed with errno "<<errno);
+				failed = true;
+				return;
+			}
+			const Segment& segment = segments.back();
+			size_t take = n;
+			bool rotate = false;
+			if(segment.size > 0 && (segment.size + n > segment_size || (max_age > 0 && time - segment.first_time >= max_age))){
+				// Segments end with a line, unless the line outgrows twice the size
+				const void* newline = ::memrchr(data, '\n', n);
+				if(newline){
+					take = static_cast<size_t>(static_cast<const uint8_t*>(newline) - data) + 1;
+					rotate = true;
+				}else if(segment.size >= 2 * segment_size){
+					take = 0;
+					rotate = true;
+				}
+			}
+			put(data, take, time);
+			data += take;
+			n -= take;
+			if(rotate){
+				closeSegment();
+			}
+			if(failed){
+				return;
+			}
+		}
+	}
+
+	void OutputStore::put(const uint8_t* data, size_t n, int64_t time){
+		if(n == 0){
+			return;
+		}
+		Segment& segment = segments.back();
+		size_t done = 0;
+		while(done < n){
+			const uint64_t offset = segment.size + done;
+			if(segment.entries == 0 || offset - entry_offset >= index_block_size || time - entry_time >= index_resolution_us){
+				index_buffer.push_back(IndexEntry{time, offset, lines});
+				++segment.entries;
+				entry_time = time;
+				entry_offset = offset;
+			}
+			const size_t step = static_cast<size_t>(std::min<uint64_t>(n - done, entry_offset + index_block_size - offset));
+			lines += static_cast<uint64_t>(std::count(data + done, data + done + step, '\n'));
+			done += step;
+		}
+		segment.size += n;
+		segment.last_time = time;
+		partial_line = data[n - 1] != '\n';
+		log_buffer.insert(log_buffer.end(), data, data + n);
+		if(log_buffer.size() >= store_block_size){
+			writeBuffers();
+		}
+	}
+
+	void OutputStore::flush(){
+		std::lock_guard<std::mutex> lock{mutex};
+		writeBuffers();
+	}
+
+	void OutputStore::writeBuffers(){
+		if(log_fd < 0){
+			return;
+		}
+		// The output first, so an entry never points past the end of its segment
+		const bool written = writeAll(log_fd, log_buffer.data(), log_buffer.size())
+			&& writeAll(index_fd, reinterpret_cast<const uint8_t*>(index_buffer.data()), index_buffer.size() * sizeof(IndexEntry));
+		log_buffer.clear();
+		index_buffer.clear();
+		if(!written){
+			DVR_LOG(Error, "Stopped storing output in "<<directory<<", writing failed with errno "<<errno);
+			::close(log_fd);
+			::close(index_fd);
+			log_fd = -1;
+			index_fd = -1;
+			failed = true;
+		}
+	}
+
+	std::shared_ptr<const MappedFile> OutputStore::mapLog(size_t segment) const {
+		return MappedFile::open(segments[segment].base + log_extension, segments[segment].size, MADV_SEQUENTIAL);
+	}
+
+	std::shared_ptr<const MappedFile> OutputStore::mapIndex(size_t segment) const {
+		return MappedFile::open(segments[segment].base + index_extension, segments[segment].entries * sizeof(IndexEntry), MADV_RANDOM);
+	}
+
+	OutputStore::Position OutputStore::endPosition() const {
+		return Position{segments.size() - 1, segments.back().size};
+	}
+
+	OutputStore::Position OutputStore::locateTime(int64_t time) const {
+		// Segments and the entries of a segment are sorted by time
+		auto s_find = std::partition_point(segments.begin(), segments.end(), [time](const Segment& segment){
+			return segment.last_time < time;
+		});
+		if(s_find == segments.end()){
+			return endPosition();
+		}
+		const size_t segment = static_cast<size_t>(s_find - segments.begin());
+		auto index = mapIndex(segment);
+		auto log = mapLog(segment);
+		if(!index || !log){
+			return Position{segment, 0};
+		}
+		const IndexEntry* entries = reinterpret_cast<const IndexEntry*>(index->data());
+		const IndexEntry* entries_end = entries + index->size() / sizeof(IndexEntry);
+		const IndexEntry* e_find = std::partition_point(entries, entries_end, [time](const IndexEntry& entry){
+			return entry.time < time;
+		});
+		if(e_find == entries_end){
+			return Position{segment, log->size()};
+		}
+		// Back to the start of the line
+		const uint64_t offset = std::min<uint64_t>(e_find->offset, log->size());
+		const void* newline = offset > 0 ? ::memrchr(log->data(), '\n', offset) : nullptr;
+		return Position{segment, newline ? static_cast<uint64_t>(static_cast<const uint8_t*>(newline) - log->data()) + 1 : 0};
+	}
+
+	OutputStore::Position OutputStore::locateLine(uint64_t line) const {
+		// The last segment with line ends before the line, it holds the line end before the line
+		auto s_find = std::partition_point(segments.begin(), segments.end(), [line](const Segment& segment){
+			return segment.first_line < line;
+		});
+		if(s_find == segments.begin()){
+			return Position{0, 0};
+		}
+		const size_t segment = static_cast<size_t>(s_find - segments.begin()) - 1;
+		auto index = mapIndex(segment);
+		auto log = mapLog(segment);
+		if(!index || !log || index->size() < sizeof(IndexEntry)){
+			return Position{segment, 0};
+		}
+		const IndexEntry* entries = reinterpret_cast<const IndexEntry*>(index->data());
+		const IndexEntry* entries_end = entries + index->size() / sizeof(IndexEntry);
+		const IndexEntry* e_find = std::partition_point(entries, entries_end, [line](const IndexEntry& entry){
+			return entry.line < line;
+		});
+		// The first entry has fewer lines before it, so there is one before
+		const IndexEntry& entry = e_find == entries ? *entries : *(e_find - 1);
+
+		const uint8_t* position = log->data() + std::min<uint64_t>(entry.offset, log->size());
+		const uint8_t* end = log->data() + log->size();
+		for(uint64_t remaining = line - std::min(line, entry.line); remaining > 0 && position < end; --remaining){
+			const void* newline = std::memchr(position, '\n', static_cast<size_t>(end - position));
+			position = newline ? static_cast<const uint8_t*>(newline) + 1 : end;
+		}
+		return Position{segment, static_cast<uint64_t>(position - log->data())};
+	}
+
+	OutputRange OutputStore::between(Position begin, Position end) const {
+		std::vector<OutputRange::Piece> pieces;
+		for(size_t segment = begin.segment; segment <= end.segment && segment < segments.size(); ++segment){
+			auto log = mapLog(segment);
+			if(!log){
+				continue;
+			}
+			const uint64_t from = segment == begin.segment ? begin.offset : 0;
+			const uint64_t to = std::min<uint64_t>(segment == end.segment ? end.offset : log->size(), log->size());
+			if(from < to){
+				pieces.push_back(OutputRange::Piece{std::move(log), from, to});
+			}
+		}
+		return OutputRange{std::move(pieces)};
+	}
+
+	OutputRange OutputStore::timeRange(std::chrono::system_clock::time_point from, std::chrono::system_clock::time_point to) const {
+		std::lock_guard<std::mutex> lock{mutex};
+		if(segments.empty() || to < from){
+			return OutputRange{};
+		}
+		const int64_t last = toMicros(to);
+		// Up to the first line after to
+		const Position end = last >= last_time ? endPosition() : locateTime(last + 1);
+		return between(locateTime(toMicros(from)), end);
+	}
+
+	OutputRange OutputStore::lineRange(uint64_t first, uint64_t last) const {
+		std::lock_guard<std::mutex> lock{mutex};
+		first = std::max<uint64_t>(1, first);
+		if(segments.empty() || last < first){
+			return OutputRange{};
+		}
+		// Up to the start of the line after last
+		const Position end = last >= lines ? endPosition() : locateLine(last);
+		return between(locateLine(first - 1), end);
+	}
+
+	uint64_t OutputStore::lineCount() const {
+		std::lock_guard<std::mutex> lock{mutex};
+		return lines + (partial_line ? 1 : 0);
+	}
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace dvr {
+	// A read only mapping of a segment file
+	class MappedFile;
+
+	/*
+	 * Result of a query on an OutputStore. Holds the mappings of its
+	 * segments, so it stays valid while the store rotates or deletes them.
+	 */
+	class OutputRange {
+	public:
+		struct Piece {
+			std::shared_ptr<const MappedFile> file;
+			uint64_t begin;
+			uint64_t end;
+		};
+	private:
+		std::vector<Piece> pieces;
+		// Next unread piece
+		size_t current;
+	public:
+		OutputRange();
+		explicit OutputRange(std::vector<Piece> p);
+
+		/*
+		 * Bytes not read yet
+		 */
+		uint64_t size() const;
+		bool empty() const;
+		/*
+		 * Appends up to n bytes to buffer and consumes them. Returns how many
+		 */
+		size_t read(std::vector<uint8_t>& buffer, size_t n);
+	};
+
+	/*
+	 * Append-only store of the output of one service. The output is written
+	 * as it is to segment files <first time in us>.log in the directory.
+	 * Every segment has an index <first time in us>.idx of fixed size entries
+	 *
+	 * time in us since the epoch, offset in the segment, lines before the offset
+	 *
+	 * in native byte order. An entry starts every index block and every
+	 * output after a pause of the index resolution, so the index is sparse
+	 * and a query maps the files and binary searches instead of scanning.
+	 *
+	 * Segments rotate by size or age at the end of a line and only the
+	 * newest segments are kept if a limit is set. A store opened on an
+	 * existing directory continues after its last segment.
+	 *
+	 * The relay thread appends while the event loop flushes and queries,
+	 * so every public call takes the lock of the store.
+	 */
+	class OutputStore {
+	private:
+		struct IndexEntry {
+			int64_t time;
+			uint64_t offset;
+			uint64_t line;
+		};
+		static_assert(sizeof(IndexEntry) == 24, "Index entries are written as they are");
+
+		struct Segment {
+			// Path without extension
+			std::string base;
+			int64_t first_time;
+			// Time of the last output in the segment
+			int64_t last_time;
+			// Lines in the segments before
+			uint64_t first_line;
+			// Including the buffered bytes and entries of the open segment
+			uint64_t size;
+			uint64_t entries;
+		};
+		// The position of a byte in the store
+		struct Position {
+			size_t segment;
+			uint64_t offset;
+		};
+
+		std::string directory;
+		uint64_t segment_size;
+		std::chrono::seconds segment_age;
+		// 0 keeps all
+		uint32_t max_segments;
+
+		// Oldest first. The last one is open while log_fd is valid
+		std::vector<Segment> segments;
+		int log_fd;
+		int index_fd;
+		std::vector<uint8_t> log_buffer;
+		std::vector<IndexEntry> index_buffer;
+		// Last entry of the open segment
+		int64_t entry_time;
+		uint64_t entry_offset;
+		uint64_t lines;
+		// The output doesn't end with a line end
+		bool partial_line;
+		// Output times never go backwards, even if the clock does
+		int64_t last_time;
+		// Writing failed, the store ignores further output
+		bool failed;
+		mutable std::mutex mutex;
+
+		bool load();
+		bool startSegment(int64_t time);
+		void closeSegment();
+		void removeOldSegments();
+		void put(const uint8_t* data, size_t n, int64_t time);
+		// flush() without the lock
+		void writeBuffers();
+
+		std::shared_ptr<const MappedFile> mapLog(size_t segment) const;
+		std::shared_ptr<const MappedFile> mapIndex(size_t segment) const;
+		Position endPosition() const;
+		/*
+		 * Start of the first line whose index entry is at time or later
+		 */
+		Position locateTime(int64_t time) const;
+		/*
+		 * Start of the line with the index line, counted from 0
+		 */
+		Position locateLine(uint64_t line) const;
+		OutputRange between(Position begin, Position end) const;
+	public:
+		OutputStore();
+		~OutputStore();
+
+		OutputStore(const OutputStore&) = delete;
+		OutputStore& operator=(const OutputStore&) = delete;
+
+		/*
+		 * Creates the directory if needed. Segments of an earlier run stay
+		 * queryable, new output always starts a new segment.
+		 */
+		bool open(const std::string& dir, uint64_t max_segment_size, std::chrono::seconds max_segment_age, uint32_t kept_segments);
+
+		/*
+		 * Buffers the output. Ignored if not open or once writing failed
+		 */
+		void append(const uint8_t* data, size_t n, std::chrono::system_clock::time_point time);
+		/*
+		 * Writes the buffered output. Queries only see flushed output
+		 */
+		void flush();
+
+		/*
+		 * Output from the line printed at from up to the line printed at to,
+		 * both included. Resolved with the index, so lines printed within
+		 * the index resolution around the bounds may be in or out.
+		 */
+		OutputRange timeRange(std::chrono::system_clock::time_point from, std::chrono::system_clock::time_point to) const;
+		/*
+		 * Lines first to last, both included and counted from 1 since the
+		 * first output of the directory. Lines of deleted segments are skipped.
+		 */
+		OutputRange lineRange(uint64_t first, uint64_t last) const;
+		/*
+		 * Lines stored so far, including the deleted segments
+		 */
+		uint64_t lineCount() const;
+	};
+}
@@ -0,0 +1,267 @@
+#include "process_settings.h"
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <sstream>
+
+// From linux/ioprio.h, which not every libc ships
+const int ioprio_class_shift = 13;
+const int ioprio_who_process = 1;
+const int ioprio_class_rt = 1;
+const int ioprio_class_be = 2;
+const int ioprio_class_idle = 3;
+// Levels 0 (highest) to 7
+const int ioprio_levels = 8;
+
+namespace dvr {
+	namespace {
+		bool parseNumber(const std::string& text, int base, unsigned long& value){
+			if(text.empty()){
+				return false;
+			}
+			char* end = nullptr;
+			errno = 0;
+			value = std::strtoul(text.c_str(), &end, base);
+			return errno == 0 && *end == '\0';
+		}
+
+		/*
+		 * Leading decimal of text, "-1000\n" is -1000. Async-signal-safe unlike atoi
+		 */
+		int parseDecimal(const char* text){
+			const bool negative = *text == '-';
+			if(negative){
+				++text;
+			}
+			int value = 0;
+			for(; *text >= '0' && *text <= '9'; ++text){
+				value = value * 10 + (*text - '0');
+			}
+			return negative ? -value : value;
+		}
+
+		std::string formatCpus(const cpu_set_t& cpus){
+			std::stringstream ss;
+			const char* separator = "";
+			for(int cpu = 0; cpu < CPU_SETSIZE; ++cpu){
+				if(!CPU_ISSET(cpu, &cpus)){
+					continue;
+				}
+				int last = cpu;
+				while(last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &cpus)){
+					++last;
+				}
+				ss<<separator<<cpu;
+				if(last > cpu){
+					ss<<"-"<<last;
+				}
+				separator = ",";
+				cpu = last;
+			}
+			return ss.str();
+		}
+
+		std::string formatPolicy(int policy){
+			switch(policy){
+				case SCHED_OTHER: return "other";
+				case SCHED_BATCH: return "batch";
+				case SCHED_IDLE: return "idle";
+			}
+			return std::to_string(policy);
+		}
+
+		std::string formatIoPriority(int priority){
+			const int level = priority & ((1 << ioprio_class_shift) - 1);
+			switch(priority >> ioprio_class_shift){
+				case ioprio_class_rt: return "realtime:" + std::to_string(level);
+				case ioprio_class_be: return "best-effort:" + std::to_string(level);
+				case ioprio_class_idle: return "idle";
+			}
+			// No class follows the nice value
+			return "none";
+		}
+
+		template<typename T, typename Format>
+		void formatSetting(std::stringstream& ss, const char*& separator, const char* name, const std::optional<T>& requested, const std::optional<T>& effective, Format format){
+			if(!requested){
+				return;
+			}
+			ss<<separator<<name<<" "<<(effective ? format(*effective) : std::string{"unknown"});
+			if(!effective || format(*effective) != format(*requested)){
+				ss<<" (wanted "<<format(*requested)<<")";
+			}
+			separator = ", ";
+		}
+	}
+
+	bool ProcessSettings::empty() const {
+		return !cpus && !nice && !policy && !io_priority && !oom_score_adj;
+	}
+
+	std::optional<cpu_set_t> parseCpuList(const std::string& list){
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		unsigned long value;
+		if(list.compare(0, 2, "0x") == 0){
+			if(!parseNumber(list.substr(2), 16, value)){
+				return std::nullopt;
+			}
+			for(int cpu = 0; cpu < static_cast<int>(sizeof(value) * 8); ++cpu){
+				if(value & (1ul << cpu)){
+					CPU_SET(cpu, &cpus);
+				}
+			}
+		}else{
+			std::stringstream ss{list};
+			std::string range;
+			while(std::getline(ss, range, ',')){
+				const size_t dash = range.find('-');
+				unsigned long first;
+				unsigned long last;
+				if(!parseNumber(range.substr(0, dash), 10, first)){
+					return std::nullopt;
+				}
+				last = first;
+				if(dash != std::string::npos && !parseNumber(range.substr(dash + 1), 10, last)){
+					return std::nullopt;
+				}
+				if(last < first || last >= CPU_SETSIZE){
+					return std::nullopt;
+				}
+				for(unsigned long cpu = first; cpu <= last; ++cpu){
+					CPU_SET(cpu, &cpus);
+				}
+			}
+		}
+		if(CPU_COUNT(&cpus) == 0){
+			return std::nullopt;
+		}
+		return cpus;
+	}
+
+	std::optional<int> parseSchedulingPolicy(const std::string& name){
+		if(name == "other"){
+			return SCHED_OTHER;
+		}else if(name == "batch"){
+			return SCHED_BATCH;
+		}else if(name == "idle"){
+			return SCHED_IDLE;
+		}
+		return std::nullopt;
+	}
+
+	std::optional<int> parseIoPriority(const std::string& priority){
+		const size_t colon = priority.find(':');
+		const std::string name = priority.substr(0, colon);
+		unsigned long level = 4;
+		if(colon != std::string::npos && (!parseNumber(priority.substr(colon + 1), 10, level) || level >= ioprio_levels)){
+			return std::nullopt;
+		}
+		if(name == "idle" && colon == std::string::npos){
+			return ioprio_class_idle << ioprio_class_shift;
+		}else if(name == "best-effort"){
+			return (ioprio_class_be << ioprio_class_shift) | static_cast<int>(level);
+		}else if(name == "realtime"){
+			return (ioprio_class_rt << ioprio_class_shift) | static_cast<int>(level);
+		}
+		return std::nullopt;
+	}
+
+	PreparedProcessSettings prepareProcessSettings(const ProcessSettings& settings){
+		PreparedProcessSettings prepared{settings, {}};
+		if(settings.oom_score_adj){
+			prepared.oom_score_adj = std::to_string(*settings.oom_score_adj);
+		}
+		return prepared;
+	}
+
+	void applyProcessSettings(const PreparedProcessSettings& prepared){
+		const ProcessSettings& settings = prepared.settings;
+		if(settings.cpus){
+			::sched_setaffinity(0, sizeof(cpu_set_t), &*settings.cpus);
+		}
+		// Before the nice value, because changing the policy may reset it
+		if(settings.policy){
+			struct ::sched_param param{};
+			::sched_setscheduler(0, *settings.policy, &param);
+		}
+		if(settings.nice){
+			::setpriority(PRIO_PROCESS, 0, *settings.nice);
+		}
+		if(settings.io_priority){
+			::syscall(SYS_ioprio_set, ioprio_who_process, 0, *settings.io_priority);
+		}
+		if(settings.oom_score_adj){
+			int fd = ::open("/proc/self/oom_score_adj", O_WRONLY | O_CLOEXEC);
+			if(fd >= 0){
+				// Lowering needs CAP_SYS_RESOURCE, other errors show in the effective value
+				while(::write(fd, prepared.oom_score_adj.data(), prepared.oom_score_adj.size()) < 0 && errno == EINTR){}
+				::close(fd);
+			}
+		}
+	}
+
+	ProcessSettings effectiveProcessSettings(const ProcessSettings& requested){
+		ProcessSettings effective;
+		if(requested.cpus){
+			cpu_set_t cpus;
+			if(::sched_getaffinity(0, sizeof(cpus), &cpus) == 0){
+				effective.cpus = cpus;
+			}
+		}
+		if(requested.policy){
+			int policy = ::sched_getscheduler(0);
+			if(policy >= 0){
+				// SCHED_RESET_ON_FORK may be or-ed in
+				effective.policy = policy & ~SCHED_RESET_ON_FORK;
+			}
+		}
+		if(requested.nice){
+			errno = 0;
+			int nice = ::getpriority(PRIO_PROCESS, 0);
+			if(errno == 0){
+				effective.nice = nice;
+			}
+		}
+		if(requested.io_priority){
+			long priority = ::syscall(SYS_ioprio_get, ioprio_who_process, 0);
+			if(priority >= 0){
+				effective.io_priority = static_cast<int>(priority);
+			}
+		}
+		if(requested.oom_score_adj){
+			int fd = ::open("/proc/self/oom_score_adj", O_RDONLY | O_CLOEXEC);
+			if(fd >= 0){
+				char buffer[16] = {};
+				if(::read(fd, buffer, sizeof(buffer) - 1) > 0){
+					effective.oom_score_adj = parseDecimal(buffer);
+				}
+				::close(fd);
+			}
+		}
+		return effective;
+	}
+
+	bool equalProcessSettings(const ProcessSettings& a, const ProcessSettings& b){
+		if(a.cpus.has_value() != b.cpus.has_value() || (a.cpus && !CPU_EQUAL(&*a.cpus, &*b.cpus))){
+			return false;
+		}
+		return a.nice == b.nice && a.policy == b.policy && a.io_priority == b.io_priority && a.oom_score_adj == b.oom_score_adj;
+	}
+
+	std::string formatProcessSettings(const ProcessSettings& requested, const ProcessSettings& effective){
+		std::stringstream ss;
+		const char* separator = "";
+		formatSetting(ss, separator, "cpus", requested.cpus, effective.cpus, formatCpus);
+		formatSetting(ss, separator, "scheduler", requested.policy, effective.policy, formatPolicy);
+		formatSetting(ss, separator, "nice", requested.nice, effective.nice, [](int nice){ return std::to_string(nice); });
+		formatSetting(ss, separator, "io", requested.io_priority, effective.io_priority, formatIoPriority);
+		formatSetting(ss, separator, "oom_score_adj", requested.oom_score_adj, effective.oom_score_adj, [](int adj){ return std::to_string(adj); });
+		return ss.str();
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <sched.h>
+
+#include <optional>
+#include <string>
+#include <type_traits>
+
+namespace dvr {
+	/*
+	 * Scheduling attributes of a child. Applied after the fork and before
+	 * the exec, so they hold from the first instruction of the service.
+	 * Trivially copyable, so the child can send back the effective ones
+	 * through a pipe. Unset values keep those of the daemon.
+	 */
+	struct ProcessSettings {
+		std::optional<cpu_set_t> cpus;
+		std::optional<int> nice;
+		// SCHED_OTHER, SCHED_BATCH or SCHED_IDLE
+		std::optional<int> policy;
+		// Class and level combined like ioprio_set takes them
+		std::optional<int> io_priority;
+		std::optional<int> oom_score_adj;
+
+		bool empty() const;
+	};
+	static_assert(std::is_trivially_copyable_v<ProcessSettings>);
+
+	/*
+	 * "0-3,6" or a hex mask like "0xf"
+	 */
+	std::optional<cpu_set_t> parseCpuList(const std::string& list);
+	/*
+	 * "other", "batch" or "idle"
+	 */
+	std::optional<int> parseSchedulingPolicy(const std::string& name);
+	/*
+	 * "idle", "best-effort" or "realtime" with an optional level, e.g. "best-effort:7"
+	 */
+	std::optional<int> parseIoPriority(const std::string& priority);
+
+	/*
+	 * The settings as the child applies them. Other threads of the daemon
+	 * may hold the malloc lock at the fork, so everything which allocates
+	 * is done before and the child only makes async-signal-safe calls.
+	 */
+	struct PreparedProcessSettings {
+		ProcessSettings settings;
+		// Written to /proc/self/oom_score_adj
+		std::string oom_score_adj;
+	};
+
+	PreparedProcessSettings prepareProcessSettings(const ProcessSettings& settings);
+
+	/*
+	 * Only called in the child. Failures aren't fatal, the service runs
+	 * with what the kernel accepted.
+	 */
+	void applyProcessSettings(const PreparedProcessSettings& prepared);
+	/*
+	 * Only called in the child. Reads back the values which are set in requested
+	 */
+	ProcessSettings effectiveProcessSettings(const ProcessSettings& requested);
+
+	bool equalProcessSettings(const ProcessSettings& a, const ProcessSettings& b);
+
+	/*
+	 * e.g. "cpus 0-3, nice 5 (wanted -5)". Empty if nothing was requested
+	 */
+	std::string formatProcessSettings(const ProcessSettings& requested, const ProcessSettings& effective);
+}
@@ -1,36 +1,193 @@
 #include "process_stream.h"
 
+#include <sys/resource.h>
 #include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <termios.h>
 #include <unistd.h>
 
-#include <iostream>
+#include <cerrno>
+#include <cstdlib>
+
+#include "log/log.h"
 
 namespace dvr {
-	ProcessStream::ProcessStream(const std::string& ef, int pid, const std::array<int,3>& fds):
+	ProcessStream::ProcessStream(const std::string& ef, int pid, const std::array<int,3>& fds, bool tty, const ProcessSettings& effective):
 		process_id{pid},
 		file_descriptors{fds},
-		exec_file{ef}
+		exec_file{ef},
+		terminal{tty},
+		settings{effective}
 	{
 
 	}
 
+	ProcessStream::~ProcessStream(){
+		for(int fd : file_descriptors){
+			if(fd >= 0){
+				close(fd);
+			}
+		}
+	}
+
 	int ProcessStream::getPID() const {
 		return process_id;
 	}
-	
+
 	const std::array<int,3>& ProcessStream::getFD() const {
 		return file_descriptors;
 	}
-	
-	std::unique_ptr<ProcessStream> createProcessStream(const std::string& exec_file){
+
+	bool ProcessStream::closeInput(){
+		if(terminal || file_descriptors[0] < 0){
+			return false;
+		}
+		close(file_descriptors[0]);
+		file_descriptors[0] = -1;
+		return true;
+	}
+
+	bool ProcessStream::isTerminal() const {
+		return terminal;
+	}
+
+	bool ProcessStream::setWindowSize(uint16_t rows, uint16_t columns){
+		if(!terminal){
+			return false;
+		}
+		struct ::winsize size{};
+		size.ws_row = rows;
+		size.ws_col = columns;
+		return ::ioctl(file_descriptors[0], TIOCSWINSZ, &size) == 0;
+	}
+
+	const ProcessSettings& ProcessStream::getSettings() const {
+		return settings;
+	}
+
+	static void setNonBlocking(int fd){
+		int flags = fcntl(fd, F_GETFL);
+		if(flags >= 0){
+			fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+		}
+	}
+
+	/*
+	 * The child reports the effective settings through a pipe before the
+	 * exec. Only created if settings are requested, so plain spawns don't
+	 * wait for the child.
+	 */
+	static bool openReport(const ProcessOptions& options, int (&report)[2]){
+		report[0] = -1;
+		report[1] = -1;
+		if(options.settings.empty()){
+			return true;
+		}
+		if(pipe2(report, O_CLOEXEC) != 0){
+			DVR_LOG(Error, "Failed to create the settings pipe");
+			return false;
+		}
+		return true;
+	}
+
+	static void closeReport(int (&report)[2]){
+		for(int& fd : report){
+			if(fd >= 0){
+				close(fd);
+				fd = -1;
+			}
+		}
+	}
+
+	/*
+	 * Blocks until the child applied its settings. Empty settings if the
+	 * child died before.
+	 */
+	static ProcessSettings receiveReport(int (&report)[2]){
+		ProcessSettings effective;
+		if(report[0] < 0){
+			return effective;
+		}
+		close(report[1]);
+		report[1] = -1;
+
+		ProcessSettings received;
+		ssize_t n;
+		do{
+			n = read(report[0], &received, sizeof(received));
+		}while(n < 0 && errno == EINTR);
+		if(n == static_cast<ssize_t>(sizeof(received))){
+			effective = received;
+		}
+		closeReport(report);
+		return effective;
+	}
+
+	/*
+	 * What the child needs between the fork and the exec, built before the
+	 * fork. Other threads of the daemon like the logger, the relay thread or
+	 * test runner workers may hold the malloc lock at the fork, so the child
+	 * must not allocate.
+	 */
+	struct ChildExec {
+		const std::string& exec_file;
+		// Points into args, ends with nullptr
+		std::vector<char*> argv;
+		uint32_t cpu_limit;
+		PreparedProcessSettings settings;
+	};
+
+	static ChildExec prepareChild(const std::string& exec_file, const std::vector<std::string>& args, const ProcessOptions& options){
+		ChildExec child{exec_file, {}, options.cpu_limit, prepareProcessSettings(options.settings)};
+		child.argv.reserve(args.size() + 2);
+		child.argv.push_back(const_cast<char*>(exec_file.c_str()));
+		for(const std::string& arg : args){
+			child.argv.push_back(const_cast<char*>(arg.c_str()));
+		}
+		child.argv.push_back(nullptr);
+		return child;
+	}
+
+	/*
+	 * Only called in the child. Never returns. Only async-signal-safe calls
+	 */
+	[[noreturn]] static void execChild(const ChildExec& child, int report){
+		if(child.cpu_limit > 0){
+			struct ::rlimit limit;
+			limit.rlim_cur = child.cpu_limit;
+			limit.rlim_max = child.cpu_limit + 1;
+			if(setrlimit(RLIMIT_CPU, &limit) != 0){
+				_exit(126);
+			}
+		}
+
+		if(report >= 0){
+			applyProcessSettings(child.settings);
+			const ProcessSettings effective = effectiveProcessSettings(child.settings.settings);
+			// The parent treats a missing report as unknown settings
+			while(write(report, &effective, sizeof(effective)) < 0 && errno == EINTR){}
+		}
+
+		// TODO
+		// replace the exec with a handling loop which
+		// waits for a start signal by the core loop
+		// It should be possible that specific signals are not forwarded to the service.
+		// For SIGTERM handling etc
+		execvp(child.exec_file.c_str(), child.argv.data());
+		_exit(127);
+	}
+
+	static std::unique_ptr<ProcessStream> createPipeProcessStream(const std::string& exec_file, const ChildExec& child, int (&report)[2]){
 		std::unique_ptr<ProcessStream> process{nullptr};
-		int fds[2][3];
+		int fds[3][2];
 
 		// Creating each pipe
 		for(int8_t i = 0; i < 3; ++i){
-			int rv = pipe(fds[i]);
+			int rv = pipe2(fds[i], O_CLOEXEC);
 			if( rv == -1 ){
-				std::cerr<<"Failed to create pipe "<<std::to_string(i)<<std::endl;
+				DVR_LOG(Error, "Failed to create pipe "<<std::to_string(i));
 				//Closing previously opened pipes
 				for(int8_t j = i - 1; j >= 0; --j){
 					for(int8_t k = 0; k < 2; ++k){
@@ -41,13 +198,13 @@ namespace dvr {
 			}
 		}
 
-		// Swapping the output streams
-		// fd[i][0] is the input/writable side when created by pipe and fd[i][1] is the output/readable side.
-		// Because the process gets fd[i][1], the writable side has to be swapped.
-		for(uint8_t i : {1,2} ){
-			int temp = fds[i][0];
-			fds[i][0] = fds[i][1];
-			fds[i][1] = temp;
+		// Swapping the input stream
+		// fd[i][0] is the readable side when created by pipe and fd[i][1] is the writable side.
+		// Because the process gets fd[i][1], the stdin side has to be swapped so the child reads.
+		{
+			int temp = fds[0][0];
+			fds[0][0] = fds[0][1];
+			fds[0][1] = temp;
 		}
 
 		int pid = fork();
@@ -58,29 +215,113 @@ namespace dvr {
 				}
 			}
 		}else if( pid == 0 ){
-			/* 
-			 * replaces all default streams with the following fds 
+			/*
+			 * replaces all default streams with the following fds
 			 * and closes the parent fds
 			 */
 			for(uint8_t i = 0; i < 3; ++i){
 				close(fds[i][0]);
 				dup2(fds[i][1],i);
 			}
-			
-			// TODO
-			// replace the exec with a handling loop which
-			// waits for a start signal by the core loop
-			// It should be possible that specific signals are not forwarded to the service.
-			// For SIGTERM handling etc
-			// 
-			// Or just keep a record of service information and create the process stream only when needed.
-			execlp("terraria", "terraria", NULL);
+			execChild(child, report[1]);
 		}else{
 			for(uint8_t i = 0; i < 3; ++i){
 				close(fds[i][1]);
+				setNonBlocking(fds[i][0]);
 			}
-			process = std::make_unique<ProcessStream>(exec_file, pid, std::array<int,3>{fds[0][0],fds[1][0],fds[2][0]});
+			const ProcessSettings effective = receiveReport(report);
+			process = std::make_unique<ProcessStream>(exec_file, pid, std::array<int,3>{fds[0][0],fds[1][0],fds[2][0]}, false, effective);
 		}
 		return process;
 	}
+
+	static std::unique_ptr<ProcessStream> createTerminalProcessStream(const std::string& exec_file, const ChildExec& child, const ProcessOptions& options, int (&report)[2]){
+		int master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+		if(master < 0){
+			DVR_LOG(Error, "Failed to open pseudo terminal");
+			return nullptr;
+		}
+
+		char slave_name[128];
+		if(grantpt(master) != 0 || unlockpt(master) != 0 || ptsname_r(master, slave_name, sizeof(slave_name)) != 0){
+			DVR_LOG(Error, "Failed to unlock pseudo terminal");
+			close(master);
+			return nullptr;
+		}
+
+		int slave = open(slave_name, O_RDWR | O_NOCTTY | O_CLOEXEC);
+		if(slave < 0){
+			DVR_LOG(Error, "Failed to open pseudo terminal slave "<<slave_name);
+			close(master);
+			return nullptr;
+		}
+
+		struct ::winsize size{};
+		size.ws_row = options.rows;
+		size.ws_col = options.columns;
+		ioctl(master, TIOCSWINSZ, &size);
+
+		// Commands written to stdin should not show up again in the output
+		struct ::termios attributes;
+		if(tcgetattr(slave, &attributes) == 0){
+			attributes.c_lflag &= ~(ECHO | ECHONL);
+			tcsetattr(slave, TCSANOW, &attributes);
+		}
+
+		// Second handle, so stdin and stdout can be closed and observed independently
+		int master_out = fcntl(master, F_DUPFD_CLOEXEC, 0);
+		if(master_out < 0){
+			close(slave);
+			close(master);
+			return nullptr;
+		}
+
+		int pid = fork();
+		if( pid < 0 ){
+			close(slave);
+			close(master_out);
+			close(master);
+			return nullptr;
+		}else if( pid == 0 ){
+			/*
+			 * New session with the slave as the controlling terminal,
+			 * so the child sees a real tty on all default streams
+			 */
+			setsid();
+			ioctl(slave, TIOCSCTTY, 0);
+			for(uint8_t i = 0; i < 3; ++i){
+				dup2(slave, i);
+			}
+			execChild(child, report[1]);
+		}
+
+		close(slave);
+		// Both handles share the file description
+		setNonBlocking(master);
+		const ProcessSettings effective = receiveReport(report);
+		return std::make_unique<ProcessStream>(exec_file, pid, std::array<int,3>{master, master_out, -1}, true, effective);
+	}
+
+	std::unique_ptr<ProcessStream> createProcessStream(const std::string& exec_file, const std::vector<std::string>& args, const ProcessOptions& options){
+		int report[2];
+		if(!openReport(options, report)){
+			return nullptr;
+		}
+		const ChildExec child = prepareChild(exec_file, args, options);
+		std::unique_ptr<ProcessStream> process = options.pty
+			? createTerminalProcessStream(exec_file, child, options, report)
+			: createPipeProcessStream(exec_file, child, report);
+		// Still open if the fork failed
+		closeReport(report);
+		return process;
+	}
+
+	int openPidFd(int pid){
+#ifdef SYS_pidfd_open
+		return static_cast<int>(::syscall(SYS_pidfd_open, pid, 0));
+#else
+		(void)pid;
+		return -1;
+#endif
+	}
 }
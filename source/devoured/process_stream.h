@@ -2,28 +2,78 @@
 
 #include <array>
 #include <memory>
+#include <string>
+#include <vector>
+
+#include "process_settings.h"
 
 namespace dvr {
+	struct ProcessOptions {
+		/*
+		 * Run the child on a pseudo terminal instead of pipes.
+		 * stdio of most programs is line buffered on a terminal and block
+		 * buffered on a pipe. stdout and stderr are merged on the terminal.
+		 */
+		bool pty = false;
+		uint16_t rows = 24;
+		uint16_t columns = 80;
+		/*
+		 * CPU seconds. The kernel sends SIGXCPU when they are used up and
+		 * SIGKILL a second later. 0 is unlimited.
+		 */
+		uint32_t cpu_limit = 0;
+		// Affinity, priorities and the OOM score of the child
+		ProcessSettings settings;
+	};
+
 	class ProcessStream{
 	public:
-		ProcessStream(const std::string& ef, int pid, const std::array<int,3>& fds);
+		ProcessStream(const std::string& ef, int pid, const std::array<int,3>& fds, bool tty, const ProcessSettings& effective = {});
+		~ProcessStream();
 
 		/*
 		 *	returns the file descriptor from the parent side which replaced
 		 *	stdin 0,
 		 *	stdout 1,
 		 *	stderr 2
+		 *	All of them are non blocking. On a terminal stderr is -1, because
+		 *	it is merged into stdout.
 		 */
 		const std::array<int,3>& getFD() const;
+		/*
+		 *	closes stdin of the child, so it reads EOF. Not possible on a
+		 *	terminal, because stdin and stdout share the pseudo terminal.
+		 */
+		bool closeInput();
 		/*
 		 *	return the process id of the child
 		 */
 		int getPID() const;
+
+		bool isTerminal() const;
+		/*
+		 * Forwards the window size to the terminal. The kernel sends SIGWINCH
+		 * to the child on change. Returns false if this is not a terminal.
+		 */
+		bool setWindowSize(uint16_t rows, uint16_t columns);
+		/*
+		 * The settings which took effect in the child. Only those requested
+		 * in the options are set.
+		 */
+		const ProcessSettings& getSettings() const;
 	private:
 		int process_id;
 		std::array<int,3> file_descriptors;
 		std::string exec_file;
+		bool terminal;
+		ProcessSettings settings;
 	};
 
-	std::unique_ptr<ProcessStream> createProcessStream(const std::string& exec_file);
+	std::unique_ptr<ProcessStream> createProcessStream(const std::string& exec_file, const std::vector<std::string>& args = {}, const ProcessOptions& options = {});
+
+	/*
+	 * Becomes readable once the child exited, so a caller waiting for the
+	 * exit doesn't depend on the child closing its output. -1 before Linux 5.3.
+	 */
+	int openPidFd(int pid);
 }
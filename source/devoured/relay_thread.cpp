@@ -0,0 +1,486 @@
+#include "relay_thread.h"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "log/log.h"
+#include "spsc_queue.h"
+
+// One read call. A pipe holds 64KiB by default
+const size_t relay_buffer_size = 64 * 1024;
+// Max bytes per stream and wakeup, on both threads
+const size_t relay_budget = 4 * relay_buffer_size;
+// Chunks read ahead of the event loop per stream
+const size_t relay_queue_chunks = 16;
+// Pending attach, detach and resume requests before they overflow into a locked list
+const size_t relay_queue_commands = 256;
+
+namespace dvr {
+	/*
+	 * Allocated on the first read into it and not initialized, so a service
+	 * writing short lines only touches the first page of its chunks
+	 */
+	struct RelayChunk {
+		std::unique_ptr<uint8_t[]> data;
+		size_t size = 0;
+		// Found by the sink on the relay thread
+		std::vector<OutputMatch> matches;
+	};
+
+	class RelayThread::Stream : public std::enable_shared_from_this<Stream> {
+	public:
+		// Reads the duplicated fd on the relay thread
+		class Reader;
+
+		IRelaySink& sink;
+		// Duplicate of the fd of the caller, closed by the relay thread on detach
+		const int fd;
+		SpscQueue<RelayChunk> chunks;
+
+		// Held by the relay thread while it reads and by detach, so the output keeps its order
+		std::mutex reading;
+		bool detached;
+		// The relay thread stopped reading because the queue was full
+		std::atomic<bool> stalled;
+
+		// Event loop only
+		bool attached;
+		// The sink is called with the front chunk
+		bool delivering;
+
+		// Relay thread only
+		std::unique_ptr<Reader> reader;
+		// EOF or an error, nothing is read anymore
+		bool finished;
+
+		Stream(int f, IRelaySink& snk):
+			sink{snk},
+			fd{f},
+			chunks{relay_queue_chunks},
+			detached{false},
+			stalled{false},
+			attached{true},
+			delivering{false},
+			finished{false}
+		{}
+	};
+
+	class RelayThread::Impl {
+	private:
+		// Calls a member function when its eventfd is signalled
+		class Wakeup final : public IFdObserver {
+		private:
+			Impl& impl;
+			void (Impl::*const callback)();
+		public:
+			Wakeup(EventPoll& p, int fd, Impl& i, void (Impl::*cb)()):
+				IFdObserver(p, fd, EPOLLIN),
+				impl{i},
+				callback{cb}
+			{}
+
+			void notify(uint32_t) override {
+				uint64_t value;
+				while(::read(fd(), &value, sizeof(value)) > 0){}
+				(impl.*callback)();
+			}
+		};
+
+		struct Command {
+			enum class Kind : uint8_t {
+				ATTACH,
+				DETACH,
+				// The event loop made room in the queue of a stalled stream
+				RESUME
+			};
+
+			Kind kind = Kind::ATTACH;
+			std::shared_ptr<Stream> stream;
+		};
+
+		// Event loop side
+		EventPoll& loop_poll;
+		int loop_fd;
+		std::unique_ptr<Wakeup> loop_wakeup;
+		// The relay thread signalled loop_fd and the loop hasn't delivered yet
+		std::atomic<bool> loop_signalled;
+		std::vector<std::shared_ptr<Stream>> streams;
+		bool delivering;
+
+		// Written by the event loop, read by the relay thread
+		SpscQueue<Command> commands;
+		/*
+		 * Commands after the queue filled up, e.g. while thousands of services
+		 * start at once. They follow the queued ones, so the loop doesn't use
+		 * the queue again until the relay thread has taken the list.
+		 */
+		std::mutex overflow_mutex;
+		std::vector<Command> overflow;
+		std::atomic<bool> overflowed;
+		int relay_fd;
+		std::atomic<bool> running;
+
+		// Relay thread side
+		std::unique_ptr<EventPoll> relay_poll;
+		std::vector<std::shared_ptr<Stream>> relay_streams;
+		std::thread thread;
+
+		void send(Command::Kind kind, const std::shared_ptr<Stream>& stream);
+		void signalLoop();
+
+		/*
+		 * Event loop. Returns true if chunks are left after the budget
+		 */
+		bool deliver(Stream& stream, size_t budget);
+		void onDelivery();
+
+		void run();
+		void onCommands();
+		void execute(Command& command);
+		void startReading(Stream& stream);
+		void stopReading(Stream& stream);
+	public:
+		Impl(EventPoll& p);
+		~Impl();
+
+		bool valid() const;
+
+		/*
+		 * Relay thread. May destroy the reader of the stream, nothing is allowed to follow the call.
+		 */
+		void read(Stream& stream);
+
+		Stream* attach(int fd, IRelaySink& sink);
+		void detach(Stream* stream);
+	};
+
+	class RelayThread::Stream::Reader final : public IFdObserver {
+	private:
+		RelayThread::Impl& impl;
+		Stream& stream;
+	public:
+		Reader(EventPoll& p, RelayThread::Impl& i, Stream& s):
+			IFdObserver(p, s.fd, EPOLLIN),
+			impl{i},
+			stream{s}
+		{}
+
+		void notify(uint32_t) override {
+			impl.read(stream);
+		}
+	};
+
+	RelayThread::Impl::Impl(EventPoll& p):
+		loop_poll{p},
+		loop_fd{::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)},
+		loop_signalled{false},
+		delivering{false},
+		commands{relay_queue_commands},
+		overflowed{false},
+		relay_fd{::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)},
+		running{true}
+	{
+		if(!valid()){
+			DVR_LOG(Error, "Couldn't create the eventfds of the relay thread");
+			return;
+		}
+		loop_wakeup = std::make_unique<Wakeup>(loop_poll, loop_fd, *this, &Impl::onDelivery);
+
+		// Signals have to interrupt the poll of the event loop, so the thread blocks all of them
+		sigset_t all;
+		sigset_t previous;
+		::sigfillset(&all);
+		::pthread_sigmask(SIG_SETMASK, &all, &previous);
+		thread = std::thread{&Impl::run, this};
+		::pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+	}
+
+	RelayThread::Impl::~Impl(){
+		if(thread.joinable()){
+			running.store(false, std::memory_order_release);
+			uint64_t one = 1;
+			if(::write(relay_fd, &one, sizeof(one)) < 0){
+				DVR_LOG(Error, "Couldn't wake the relay thread");
+			}
+			thread.join();
+		}
+		loop_wakeup.reset();
+		for(int fd : {loop_fd, relay_fd}){
+			if(fd >= 0){
+				::close(fd);
+			}
+		}
+	}
+
+	bool RelayThread::Impl::valid() const {
+		return loop_fd >= 0 && relay_fd >= 0;
+	}
+
+	void RelayThread::Impl::send(Command::Kind kind, const std::shared_ptr<Stream>& stream){
+		Command* command = overflowed.load(std::memory_order_acquire) ? nullptr : commands.back();
+		if(command){
+			command->kind = kind;
+			command->stream = stream;
+			commands.push();
+		}else{
+			std::lock_guard<std::mutex> lock{overflow_mutex};
+			overflow.push_back(Command{kind, stream});
+			overflowed.store(true, std::memory_order_release);
+		}
+
+		uint64_t one = 1;
+		if(::write(relay_fd, &one, sizeof(one)) < 0){
+			DVR_LOG(Error, "Couldn't wake the relay thread");
+		}
+	}
+
+	void RelayThread::Impl::signalLoop(){
+		if(loop_signalled.exchange(true, std::memory_order_acq_rel)){
+			return;
+		}
+		uint64_t one = 1;
+		if(::write(loop_fd, &one, sizeof(one)) < 0){
+			DVR_LOG(Error, "Couldn't wake the event loop");
+		}
+	}
+
+	bool RelayThread::Impl::deliver(Stream& stream, size_t budget){
+		while(budget > 0 && stream.attached){
+			RelayChunk* chunk = stream.chunks.front();
+			if(!chunk){
+				return false;
+			}
+			budget -= std::min(budget, chunk->size);
+			stream.delivering = true;
+			stream.sink.relayed(chunk->data.get(), chunk->size, chunk->matches);
+			stream.delivering = false;
+			if(!stream.attached){
+				// Detached by the sink, detach took the chunk already
+				return false;
+			}
+			stream.chunks.pop();
+			// Pairs with the fence of the reader, one of both sees the other.
+			// Resuming at half the queue saves a subscription per chunk while flooding
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if(stream.chunks.size() <= stream.chunks.capacity() / 2 && stream.stalled.exchange(false, std::memory_order_acq_rel)){
+				send(Command::Kind::RESUME, stream.shared_from_this());
+			}
+		}
+		return stream.attached && stream.chunks.front() != nullptr;
+	}
+
+	void RelayThread::Impl::onDelivery(){
+		loop_signalled.store(false, std::memory_order_release);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		delivering = true;
+		bool pending = false;
+		// Sinks may attach and detach streams, so the vector may change
+		for(size_t i = 0; i < streams.size(); ++i){
+			std::shared_ptr<Stream> stream = streams[i];
+			if(stream->attached && deliver(*stream, relay_budget)){
+				pending = true;
+			}
+		}
+		delivering = false;
+		std::erase_if(streams, [](const std::shared_ptr<Stream>& stream){
+			return !stream->attached;
+		});
+
+		// The rest follows after the other fds of the loop had their turn
+		if(pending){
+			signalLoop();
+		}
+	}
+
+	RelayThread::Stream* RelayThread::Impl::attach(int fd, IRelaySink& sink){
+		if(!valid()){
+			return nullptr;
+		}
+		int duplicate = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+		if(duplicate < 0){
+			DVR_LOG(Error, "Couldn't duplicate fd "<<fd<<" for the relay thread");
+			return nullptr;
+		}
+		auto stream = std::make_shared<Stream>(duplicate, sink);
+		streams.push_back(stream);
+		send(Command::Kind::ATTACH, stream);
+		return stream.get();
+	}
+
+	void RelayThread::Impl::detach(Stream* stream){
+		if(!stream || !stream->attached){
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock{stream->reading};
+			stream->detached = true;
+		}
+		stream->attached = false;
+
+		// Called by the sink of this stream, its chunk is delivered already
+		if(stream->delivering){
+			stream->chunks.pop();
+		}
+		while(RelayChunk* chunk = stream->chunks.front()){
+			stream->sink.relayed(chunk->data.get(), chunk->size, chunk->matches);
+			stream->chunks.pop();
+		}
+
+		send(Command::Kind::DETACH, stream->shared_from_this());
+		if(!delivering){
+			std::erase_if(streams, [&](const std::shared_ptr<Stream>& s){
+				return s.get() == stream;
+			});
+		}
+	}
+
+	void RelayThread::Impl::run(){
+		relay_poll = std::make_unique<EventPoll>();
+		auto wakeup = std::make_unique<Wakeup>(*relay_poll, relay_fd, *this, &Impl::onCommands);
+		while(running.load(std::memory_order_acquire)){
+			relay_poll->poll(-1);
+		}
+
+		for(const std::shared_ptr<Stream>& stream : relay_streams){
+			stopReading(*stream);
+			::close(stream->fd);
+		}
+		relay_streams.clear();
+		wakeup.reset();
+		relay_poll.reset();
+	}
+
+	void RelayThread::Impl::onCommands(){
+		std::vector<Command> overflowed_commands;
+		while(true){
+			while(Command* command = commands.front()){
+				execute(*command);
+				command->stream.reset();
+				commands.pop();
+			}
+			// Everything in the queue came before the list
+			{
+				std::lock_guard<std::mutex> lock{overflow_mutex};
+				if(overflow.empty()){
+					return;
+				}
+				overflowed_commands.swap(overflow);
+				overflowed.store(false, std::memory_order_release);
+			}
+			for(Command& command : overflowed_commands){
+				execute(command);
+			}
+			overflowed_commands.clear();
+		}
+	}
+
+	void RelayThread::Impl::execute(Command& command){
+		Stream& stream = *command.stream;
+		switch(command.kind){
+			case Command::Kind::ATTACH:
+				relay_streams.push_back(command.stream);
+				startReading(stream);
+				break;
+			case Command::Kind::DETACH:
+				stopReading(stream);
+				::close(stream.fd);
+				std::erase(relay_streams, command.stream);
+				break;
+			case Command::Kind::RESUME:{
+				std::lock_guard<std::mutex> lock{stream.reading};
+				if(!stream.detached){
+					startReading(stream);
+				}
+				break;
+			}
+		}
+	}
+
+	void RelayThread::Impl::startReading(Stream& stream){
+		if(!stream.reader && !stream.finished){
+			stream.reader = std::make_unique<Stream::Reader>(*relay_poll, *this, stream);
+		}
+	}
+
+	void RelayThread::Impl::stopReading(Stream& stream){
+		stream.reader.reset();
+	}
+
+	void RelayThread::Impl::read(Stream& stream){
+		bool stop = false;
+		bool pushed = false;
+		{
+			std::lock_guard<std::mutex> lock{stream.reading};
+			if(stream.detached){
+				// The detach command follows and closes the fd
+				return;
+			}
+			size_t budget = relay_budget;
+			while(budget > 0){
+				RelayChunk* chunk = stream.chunks.back();
+				if(!chunk){
+					stream.stalled.store(true, std::memory_order_release);
+					// The loop may have taken a chunk before it could see the flag
+					std::atomic_thread_fence(std::memory_order_seq_cst);
+					if(!stream.chunks.back() || !stream.stalled.exchange(false, std::memory_order_acq_rel)){
+						// Resumed by the loop
+						stop = true;
+						break;
+					}
+					continue;
+				}
+				if(!chunk->data){
+					chunk->data.reset(new uint8_t[relay_buffer_size]);
+				}
+				ssize_t n = ::read(stream.fd, chunk->data.get(), relay_buffer_size);
+				if(n > 0){
+					chunk->size = static_cast<size_t>(n);
+					chunk->matches.clear();
+					stream.sink.process(chunk->data.get(), chunk->size, chunk->matches);
+					stream.chunks.push();
+					pushed = true;
+					budget -= std::min(budget, static_cast<size_t>(n));
+				}else if(n < 0 && (errno == EAGAIN || errno == EINTR)){
+					break;
+				}else{
+					// EOF or EIO on a terminal whose slave side has been closed
+					stream.finished = true;
+					stop = true;
+					break;
+				}
+			}
+		}
+		if(pushed){
+			signalLoop();
+		}
+		if(stop){
+			stopReading(stream);
+		}
+	}
+
+	RelayThread::RelayThread(EventPoll& loop_poll):
+		impl{std::make_unique<Impl>(loop_poll)}
+	{}
+
+	RelayThread::~RelayThread() = default;
+
+	RelayThread::Stream* RelayThread::attach(int fd, IRelaySink& sink){
+		return impl->attach(fd, sink);
+	}
+
+	void RelayThread::detach(Stream* stream){
+		impl->detach(stream);
+	}
+}
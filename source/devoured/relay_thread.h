@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "network/network.h"
+
+namespace dvr {
+	// An output line containing a pattern the sink looks for
+	struct OutputMatch {
+		std::string pattern;
+		std::string line;
+	};
+
+	class IRelaySink {
+	public:
+		virtual ~IRelaySink() = default;
+
+		/*
+		 * Called on the relay thread with every read, before the chunk is
+		 * queued. The matches are delivered together with the chunk.
+		 */
+		virtual void process(const uint8_t* data, size_t n, std::vector<OutputMatch>& matches) = 0;
+		/*
+		 * Called on the thread of the event loop, in the order of the output
+		 */
+		virtual void relayed(const uint8_t* data, size_t n, const std::vector<OutputMatch>& matches) = 0;
+	};
+
+	/*
+	 * Reads the output of children on a thread of its own, so a flooding
+	 * child doesn't keep the event loop in read calls while requests wait.
+	 * The sinks process the output on the thread as well, the loop only
+	 * passes it on.
+	 *
+	 * Every stream has a bounded lock-free queue of chunks to the event
+	 * loop. A full queue stops the reads of its stream until the loop took
+	 * a chunk, so the child blocks on the pipe instead of the daemon
+	 * buffering its output. The loop delivers a limited number of bytes per
+	 * stream and wakeup, other fds are served in between.
+	 */
+	class RelayThread {
+	public:
+		class Stream;
+	private:
+		// PImpl Pattern, the thread and its queues stay out of the header
+		class Impl;
+		std::unique_ptr<Impl> impl;
+	public:
+		/*
+		 * Output is delivered from loop_poll
+		 */
+		RelayThread(EventPoll& loop_poll);
+		~RelayThread();
+
+		RelayThread(const RelayThread&) = delete;
+		RelayThread& operator=(const RelayThread&) = delete;
+
+		/*
+		 * The thread reads a duplicate of fd, the caller keeps its own
+		 */
+		Stream* attach(int fd, IRelaySink& sink);
+		/*
+		 * Stops the reads of the thread and delivers the output read so far.
+		 * Afterwards only the caller reads the fd and the stream is invalid.
+		 */
+		void detach(Stream* stream);
+	};
+}
@@ -0,0 +1,515 @@
+#include "service.h"
+
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <signal.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+
+#include "log/log.h"
+#include "metrics/metrics.h"
+
+// One read call. A pipe holds 64KiB by default
+const size_t relay_buffer_size = 64 * 1024;
+// Max bytes read per fd after the exit
+const size_t relay_budget = 4 * relay_buffer_size;
+// An unterminated line is matched anyway once it gets this long
+const size_t max_line_size = 4096;
+
+namespace dvr {
+	class Service::Relay final : public IRelaySink {
+	private:
+		RelayThread& thread;
+		Service& service;
+		// 0 stdout, 1 stderr
+		const size_t index;
+		RelayThread::Stream* stream;
+	public:
+		Relay(RelayThread& t, int fd, Service& srv, size_t idx):
+			thread{t},
+			service{srv},
+			index{idx},
+			stream{thread.attach(fd, *this)}
+		{}
+
+		// Delivers the output the thread has read so far
+		~Relay(){
+			thread.detach(stream);
+		}
+
+		void process(const uint8_t* data, size_t n, std::vector<OutputMatch>& matches) override {
+			service.processOutput(index, data, n, matches);
+		}
+
+		void relayed(const uint8_t* data, size_t n, const std::vector<OutputMatch>& matches) override {
+			service.deliver(data, n, matches);
+		}
+	};
+
+	class Service::Timer final : public Scheduler::Timer {
+	private:
+		Service& service;
+		void (Service::*const callback)();
+	public:
+		Timer(Service& srv, void (Service::*cb)()):
+			service{srv},
+			callback{cb}
+		{}
+
+		void expired() override {
+			(service.*callback)();
+		}
+	};
+
+	static ProcessSettings parseProcessSettings(const std::string& name, const ServiceConfig& config){
+		ProcessSettings settings;
+		if(!config.cpus.empty()){
+			settings.cpus = parseCpuList(config.cpus);
+			if(!settings.cpus){
+				DVR_LOG(Warning, "Ignoring invalid Cpus \""<<config.cpus<<"\" of "<<name);
+			}
+		}
+		settings.nice = config.nice;
+		if(!config.scheduler.empty()){
+			settings.policy = parseSchedulingPolicy(config.scheduler);
+			if(!settings.policy){
+				DVR_LOG(Warning, "Ignoring invalid Scheduler \""<<config.scheduler<<"\" of "<<name);
+			}
+		}
+		if(!config.io_priority.empty()){
+			settings.io_priority = parseIoPriority(config.io_priority);
+			if(!settings.io_priority){
+				DVR_LOG(Warning, "Ignoring invalid IoPriority \""<<config.io_priority<<"\" of "<<name);
+			}
+		}
+		settings.oom_score_adj = config.oom_score_adj;
+		return settings;
+	}
+
+	Service::Service(RelayThread& r, Scheduler& s, const std::string& name, const ServiceConfig& conf, IServiceStateObserver& obsrv):
+		relay_thread{r},
+		scheduler{s},
+		service_name{name},
+		config{conf},
+		settings{parseProcessSettings(name, conf)},
+		state_observer{obsrv},
+		state{State::STOPPED},
+		exit_status{0},
+		relayed_bytes{0},
+		starts{0},
+		cpu_time{0},
+		timed_out{false},
+		stat_fd{-1},
+		time_limit_timer{std::make_unique<Timer>(*this, &Service::onTimeLimit)},
+		kill_timer{std::make_unique<Timer>(*this, &Service::onKillTimeout)}
+	{
+		if(!config.output_store.empty()){
+			output_store = std::make_unique<OutputStore>();
+			if(!output_store->open(config.output_store, static_cast<uint64_t>(config.output_segment_size) * 1024 * 1024, std::chrono::seconds{config.output_segment_age}, config.output_segments)){
+				DVR_LOG(Warning, "Couldn't store the output of "<<service_name<<" in "<<config.output_store);
+				output_store.reset();
+			}
+		}
+	}
+
+	Service::~Service(){
+		// The relays deliver what is left, observers may be gone already
+		observers.clear();
+		for(auto& relay : relays){
+			relay.reset();
+		}
+		if(stat_fd >= 0){
+			::close(stat_fd);
+		}
+	}
+
+	bool Service::start(){
+		if(state == State::RUNNING){
+			return false;
+		}
+
+		ProcessOptions options;
+		options.pty = config.pty;
+		options.rows = config.rows;
+		options.columns = config.columns;
+		options.cpu_limit = config.cpu_limit;
+		options.settings = settings;
+
+		{
+			ScopedLatency latency{Histogram::SPAWN_LATENCY_NS};
+			process = createProcessStream(config.exec, config.args, options);
+		}
+		if(!process){
+			increment(Counter::SPAWN_FAILURES);
+			setState(State::FAILED);
+			return false;
+		}
+		increment(Counter::SPAWNS);
+		char path[32];
+		::snprintf(path, sizeof(path), "/proc/%d/stat", process->getPID());
+		stat_fd = ::open(path, O_RDONLY | O_CLOEXEC);
+		if(!settings.empty() && !equalProcessSettings(settings, process->getSettings())){
+			// e.g. a lower nice value without CAP_SYS_NICE. The service runs anyway
+			DVR_LOG(Warning, service_name<<" runs with "<<formatProcessSettings(settings, process->getSettings()));
+		}
+
+		// The relay thread records right after the attach
+		if(!config.record.empty()){
+			recorder = std::make_unique<SessionRecorder>();
+			if(!recorder->open(config.record, config.exec, config.args, config.pty, config.rows, config.columns)){
+				DVR_LOG(Warning, "Couldn't record "<<service_name<<" to "<<config.record);
+				recorder.reset();
+			}
+		}
+		for(std::string& partial : partial_lines){
+			partial.clear();
+		}
+		const std::array<int,3>& fds = process->getFD();
+		for(size_t i = 0; i < relays.size(); ++i){
+			if(fds[i+1] >= 0){
+				relays[i] = std::make_unique<Relay>(relay_thread, fds[i+1], *this, i);
+			}
+		}
+
+		start_time = std::chrono::system_clock::now();
+		++starts;
+		cpu_time = std::chrono::microseconds{0};
+		timed_out = false;
+		if(config.time_limit > 0){
+			scheduler.arm(*time_limit_timer, Scheduler::Clock::now() + std::chrono::seconds{config.time_limit});
+		}
+		setState(State::RUNNING);
+		return true;
+	}
+
+	bool Service::terminate(){
+		if(!process){
+			return false;
+		}
+		if(!kill_timer->armed()){
+			::kill(process->getPID(), SIGTERM);
+			scheduler.arm(*kill_timer, Scheduler::Clock::now() + std::chrono::seconds{config.stop_timeout});
+		}
+		return true;
+	}
+
+	void Service::onTimeLimit(){
+		timed_out = true;
+		terminate();
+	}
+
+	bool Service::kill(){
+		if(!process){
+			return false;
+		}
+		::kill(process->getPID(), SIGKILL);
+		return true;
+	}
+
+	void Service::onKillTimeout(){
+		kill();
+	}
+
+	const char* Service::readStat(char* buffer, size_t size){
+		if(stat_fd < 0){
+			return nullptr;
+		}
+		// proc regenerates the file on a read from the start
+		ssize_t n = ::pread(stat_fd, buffer, size - 1, 0);
+		if(n <= 0){
+			return nullptr;
+		}
+		buffer[n] = '\0';
+		// The name may contain spaces and parentheses
+		const char* name_end = std::strrchr(buffer, ')');
+		if(!name_end || name_end + 2 >= buffer + n){
+			return nullptr;
+		}
+		return name_end + 2;
+	}
+
+	void Service::sampleCpuTime(){
+		char stat[512];
+		// Starts at the 3rd field, utime and stime are the 14th and 15th
+		const char* field = readStat(stat, sizeof(stat));
+		for(size_t i = 3; i < 14 && field; ++i){
+			field = std::strchr(field, ' ');
+			if(field){
+				++field;
+			}
+		}
+		if(!field){
+			return;
+		}
+		char* end;
+		const uint64_t user = std::strtoull(field, &end, 10);
+		if(end == field || *end != ' '){
+			return;
+		}
+		const uint64_t system = std::strtoull(end + 1, &end, 10);
+		static const long ticks_per_second = ::sysconf(_SC_CLK_TCK);
+		cpu_time = std::chrono::microseconds{(user + system) * 1000000 / static_cast<uint64_t>(ticks_per_second)};
+	}
+
+	char Service::schedulingState(){
+		char stat[512];
+		const char* field = readStat(stat, sizeof(stat));
+		return field ? field[0] : '\0';
+	}
+
+	void Service::setState(State st){
+		state = st;
+		state_observer.notify(*this, state);
+	}
+
+	void Service::processOutput(size_t index, const uint8_t* data, size_t n, std::vector<OutputMatch>& matches){
+		if(output_store){
+			output_store->append(data, n, std::chrono::system_clock::now());
+		}
+		std::lock_guard<std::mutex> lock{processing};
+		if(recorder){
+			recorder->record(index == 0 ? SessionRecord::Kind::STDOUT : SessionRecord::Kind::STDERR, data, n);
+		}
+		if(patterns.empty()){
+			return;
+		}
+		std::string& partial = partial_lines[index];
+		const char* begin = reinterpret_cast<const char*>(data);
+		const char* end = begin + n;
+		while(begin < end){
+			const char* newline = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+			const char* line_end = newline ? newline : end;
+			const size_t length = std::min(max_line_size - partial.size(), static_cast<size_t>(line_end - begin));
+			partial.append(begin, length);
+			begin += length;
+			if(begin == newline){
+				++begin;
+			}else if(partial.size() < max_line_size){
+				break;
+			}
+			matchLine(partial, matches);
+			partial.clear();
+		}
+	}
+
+	void Service::matchLine(std::string& line, std::vector<OutputMatch>& matches) const {
+		if(!line.empty() && line.back() == '\r'){
+			line.pop_back();
+		}
+		for(const auto& entry : patterns){
+			if(line.find(entry.first) != std::string::npos){
+				matches.push_back(OutputMatch{entry.first, line});
+			}
+		}
+	}
+
+	void Service::deliver(const uint8_t* data, size_t n, const std::vector<OutputMatch>& matches){
+		relayed_bytes += static_cast<uint64_t>(n);
+		increment(Counter::BYTES_RELAYED, static_cast<uint64_t>(n));
+		for(IServiceOutputObserver* observer : observers){
+			observer->notify(*this, data, n);
+		}
+		for(const OutputMatch& match : matches){
+			for(IServiceOutputObserver* observer : observers){
+				observer->matched(*this, match.pattern, match.line);
+			}
+		}
+	}
+
+	void Service::drain(size_t index, size_t budget){
+		int fd = process->getFD()[index + 1];
+		if(fd < 0){
+			return;
+		}
+		relay_buffer.resize(relay_buffer_size);
+		std::vector<OutputMatch> matches;
+		while(budget > 0){
+			ssize_t n = ::read(fd, relay_buffer.data(), relay_buffer.size());
+			if(n > 0){
+				budget -= std::min(budget, static_cast<size_t>(n));
+				matches.clear();
+				processOutput(index, relay_buffer.data(), static_cast<size_t>(n), matches);
+				deliver(relay_buffer.data(), static_cast<size_t>(n), matches);
+			}else if(n < 0 && errno == EINTR){
+				continue;
+			}else{
+				// EAGAIN, EOF or EIO on a terminal whose slave side has been closed
+				return;
+			}
+		}
+	}
+
+	void Service::onExit(int status, std::chrono::microseconds cpu){
+		scheduler.cancel(*time_limit_timer);
+		scheduler.cancel(*kill_timer);
+		cpu_time = cpu;
+
+		for(size_t i = 0; i < relays.size(); ++i){
+			if(relays[i]){
+				relays[i].reset();
+				drain(i, relay_budget);
+			}
+		}
+		process.reset();
+		if(stat_fd >= 0){
+			::close(stat_fd);
+			stat_fd = -1;
+		}
+		if(recorder){
+			recorder->finish(status);
+			recorder.reset();
+		}
+		if(output_store){
+			output_store->flush();
+		}
+
+		exit_status = status;
+		setState(State::EXITED);
+		for(IServiceOutputObserver* observer : observers){
+			observer->ended(*this);
+		}
+	}
+
+	bool Service::resize(uint16_t rows, uint16_t columns){
+		config.rows = rows;
+		config.columns = columns;
+		if(!process){
+			return false;
+		}
+		return process->setWindowSize(rows, columns);
+	}
+
+	bool Service::write(const std::string& data){
+		if(!process){
+			return false;
+		}
+		int fd = process->getFD()[0];
+		size_t written = 0;
+		while(written < data.size()){
+			ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+			if(n < 0){
+				if(errno == EINTR){
+					continue;
+				}
+				return false;
+			}
+			if(recorder){
+				std::lock_guard<std::mutex> lock{processing};
+				recorder->record(SessionRecord::Kind::INPUT, reinterpret_cast<const uint8_t*>(data.data()) + written, static_cast<size_t>(n));
+			}
+			written += static_cast<size_t>(n);
+		}
+		return true;
+	}
+
+	void Service::follow(IServiceOutputObserver& obsrv){
+		observers.insert(&obsrv);
+	}
+
+	void Service::unfollow(IServiceOutputObserver& obsrv){
+		observers.erase(&obsrv);
+	}
+
+	void Service::watch(const std::string& pattern){
+		std::lock_guard<std::mutex> lock{processing};
+		++patterns[pattern];
+	}
+
+	void Service::unwatch(const std::string& pattern){
+		std::lock_guard<std::mutex> lock{processing};
+		auto find = patterns.find(pattern);
+		if(find == patterns.end() || --find->second > 0){
+			return;
+		}
+		patterns.erase(find);
+		// Lines aren't followed without patterns, the next watch starts on a fresh line
+		if(patterns.empty()){
+			for(std::string& partial : partial_lines){
+				partial.clear();
+			}
+		}
+	}
+
+	const std::string& Service::name() const {
+		return service_name;
+	}
+
+	Service::State Service::getState() const {
+		return state;
+	}
+
+	OutputStore* Service::outputStore(){
+		return output_store.get();
+	}
+
+	uint64_t Service::relayedBytes() const {
+		return relayed_bytes;
+	}
+
+	std::chrono::system_clock::time_point Service::startTime() const {
+		return start_time;
+	}
+
+	int Service::exitStatus() const {
+		return exit_status;
+	}
+
+	uint32_t Service::restarts() const {
+		return starts > 0 ? starts - 1 : 0;
+	}
+
+	std::chrono::microseconds Service::cpuTime() const {
+		return cpu_time;
+	}
+
+	int Service::getPID() const {
+		return process ? process->getPID() : -1;
+	}
+
+	std::string Service::describe() const {
+		std::stringstream ss;
+		ss<<service_name<<": ";
+		switch(state){
+			case State::STOPPED:
+				ss<<"stopped";
+				break;
+			case State::RUNNING:{
+				std::time_t since = std::chrono::system_clock::to_time_t(start_time);
+				struct ::tm local;
+				::localtime_r(&since, &local);
+				ss<<"running pid "<<getPID()<<" since "<<std::put_time(&local, "%Y-%m-%d %H:%M:%S");
+				if(process && process->isTerminal()){
+					ss<<" on pty";
+				}
+				if(process && !settings.empty()){
+					ss<<" with "<<formatProcessSettings(settings, process->getSettings());
+				}
+				break;
+			}
+			case State::EXITED:
+				if(timed_out){
+					ss<<"stopped after the time limit of "<<config.time_limit<<"s";
+				}else if(WIFSIGNALED(exit_status) && (WTERMSIG(exit_status) == SIGXCPU || (config.cpu_limit > 0 && cpu_time >= std::chrono::seconds{config.cpu_limit}))){
+					ss<<"killed after the cpu limit of "<<config.cpu_limit<<"s";
+				}else if(WIFSIGNALED(exit_status)){
+					ss<<"killed by signal "<<WTERMSIG(exit_status);
+				}else{
+					ss<<"exited with status "<<WEXITSTATUS(exit_status);
+				}
+				break;
+			case State::FAILED:
+				ss<<"failed to start";
+				break;
+		}
+		return ss.str();
+	}
+}
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "config/config.h"
+#include "coro/scheduler.h"
+#include "output_store.h"
+#include "process_stream.h"
+#include "relay_thread.h"
+#include "session_recording.h"
+
+namespace dvr {
+	class Service;
+	class IServiceStateObserver;
+
+	class IServiceOutputObserver {
+	public:
+		virtual ~IServiceOutputObserver() = default;
+
+		/*
+		 * Called with every batch read from the stdout or stderr of the child.
+		 * The data is only valid during the call.
+		 */
+		virtual void notify(Service& service, const uint8_t* data, size_t n) = 0;
+		/*
+		 * Called after notify for every line of the batch containing a
+		 * watched pattern, see Service::watch
+		 */
+		virtual void matched(Service&, const std::string&, const std::string&){}
+		/*
+		 * Called after the child exited and its remaining output was notified
+		 */
+		virtual void ended(Service&){}
+	};
+
+	class Service {
+	public:
+		enum class State : uint8_t {
+			STOPPED,
+			RUNNING,
+			EXITED,
+			FAILED
+		};
+	private:
+		// Receives the output of one fd of the child from the relay thread
+		class Relay;
+		friend class Relay;
+		// Calls a member function at its deadline
+		class Timer;
+
+		RelayThread& relay_thread;
+		Scheduler& scheduler;
+		const std::string service_name;
+		ServiceConfig config;
+		// Parsed from the config once, invalid values are left unset
+		ProcessSettings settings;
+		IServiceStateObserver& state_observer;
+
+		State state;
+		int exit_status;
+		std::chrono::system_clock::time_point start_time;
+		uint64_t relayed_bytes;
+		// Successful starts
+		uint32_t starts;
+		// CPU time of the current or last run. Sampled while running, exact after the exit
+		std::chrono::microseconds cpu_time;
+		// The time limit expired and the service was stopped because of it
+		bool timed_out;
+
+		std::unique_ptr<ProcessStream> process;
+		// /proc/<pid>/stat of the child. Read every second, so it stays open for the run
+		int stat_fd;
+		// stdout and stderr
+		std::array<std::unique_ptr<Relay>,2> relays;
+		// Reads after the exit
+		std::vector<uint8_t> relay_buffer;
+		// Set for the run if the config has a record path
+		std::unique_ptr<SessionRecorder> recorder;
+		// Set if the config has an output store. Outlives the runs
+		std::unique_ptr<OutputStore> output_store;
+
+		// The relay thread records and matches while the event loop writes input and watches
+		std::mutex processing;
+		/*
+		 * Key - Pattern the output lines are matched against
+		 * Value - Number of watches
+		 */
+		std::map<std::string, size_t> patterns;
+		// Unterminated line of stdout and stderr, only kept while patterns are watched
+		std::array<std::string,2> partial_lines;
+
+		std::set<IServiceOutputObserver*> observers;
+
+		// Fires after the time limit of the config
+		std::unique_ptr<Timer> time_limit_timer;
+		// Fires stop_timeout after SIGTERM
+		std::unique_ptr<Timer> kill_timer;
+
+		/*
+		 * Records, stores and matches output of stdout (0) or stderr (1), on the relay thread
+		 */
+		void processOutput(size_t index, const uint8_t* data, size_t n, std::vector<OutputMatch>& matches);
+		void matchLine(std::string& line, std::vector<OutputMatch>& matches) const;
+		/*
+		 * Passes processed output to the observers, on the thread of the event loop
+		 */
+		void deliver(const uint8_t* data, size_t n, const std::vector<OutputMatch>& matches);
+		/*
+		 * Reads what the child left in the fd after the relay detached,
+		 * until EAGAIN or until the budget is used up.
+		 */
+		void drain(size_t index, size_t budget);
+		/*
+		 * The fields after the name of the child in /proc/<pid>/stat, nullptr on errors
+		 */
+		const char* readStat(char* buffer, size_t size);
+		void setState(State st);
+		void onTimeLimit();
+		void onKillTimeout();
+	public:
+		Service(RelayThread& r, Scheduler& s, const std::string& name, const ServiceConfig& conf, IServiceStateObserver& obsrv);
+		~Service();
+
+		bool start();
+		/*
+		 * Sends SIGTERM and SIGKILL after the stop timeout of the config.
+		 * Returns false if no child is running.
+		 */
+		bool terminate();
+		/*
+		 * SIGKILL right away. Returns false if no child is running.
+		 */
+		bool kill();
+		/*
+		 * Called after the child has been reaped. Drains remaining output.
+		 */
+		void onExit(int status, std::chrono::microseconds cpu);
+		/*
+		 * Reads the CPU time of the running child from /proc
+		 */
+		void sampleCpuTime();
+		/*
+		 * State letter of the running child in /proc, e.g. R, S, D or T. '\0' if unknown
+		 */
+		char schedulingState();
+
+		/*
+		 * Forwards the window size of an attached client to the terminal
+		 */
+		bool resize(uint16_t rows, uint16_t columns);
+		/*
+		 * Writes to the stdin of the child without blocking. Returns false if
+		 * no child is running or not everything could be written.
+		 */
+		bool write(const std::string& data);
+
+		void follow(IServiceOutputObserver& obsrv);
+		void unfollow(IServiceOutputObserver& obsrv);
+		/*
+		 * Output read from now on is matched against pattern until it is
+		 * unwatched as often. An empty pattern matches every line.
+		 */
+		void watch(const std::string& pattern);
+		void unwatch(const std::string& pattern);
+
+		const std::string& name() const;
+		State getState() const;
+		/*
+		 * -1 if no child is running
+		 */
+		int getPID() const;
+		/*
+		 * nullptr if the output isn't stored
+		 */
+		OutputStore* outputStore();
+		uint64_t relayedBytes() const;
+		std::chrono::system_clock::time_point startTime() const;
+		/*
+		 * waitpid status of the last exit
+		 */
+		int exitStatus() const;
+		uint32_t restarts() const;
+		std::chrono::microseconds cpuTime() const;
+		/*
+		 * Only changes together with the state
+		 */
+		std::string describe() const;
+	};
+
+	class IServiceStateObserver {
+	public:
+		virtual ~IServiceStateObserver() = default;
+		virtual void notify(Service& service, Service::State state) = 0;
+	};
+}
@@ -0,0 +1,165 @@
+#include "service_awaitables.h"
+
+#include <algorithm>
+
+namespace dvr {
+	MatchAwaiter::MatchAwaiter(Scheduler& s, Service& srv, const std::string& pat, Scheduler::Clock::duration time):
+		scheduler{s},
+		service{srv},
+		pattern{pat},
+		timeout{time},
+		following{false},
+		done{false}
+	{
+		service.watch(pattern);
+	}
+
+	MatchAwaiter::~MatchAwaiter(){
+		scheduler.cancel(*this);
+		if(following){
+			service.unfollow(*this);
+		}
+		service.unwatch(pattern);
+	}
+
+	void MatchAwaiter::notify(Service&, const uint8_t*, size_t){}
+
+	void MatchAwaiter::matched(Service&, const std::string& pat, const std::string& ln){
+		if(done || pat != pattern){
+			// Unfollowing here would invalidate the observer loop of the service
+			return;
+		}
+		line = ln;
+		done = true;
+		scheduler.cancel(*this);
+		scheduler.defer(handle);
+	}
+
+	void MatchAwaiter::ended(Service&){
+		if(done){
+			return;
+		}
+		done = true;
+		scheduler.cancel(*this);
+		scheduler.defer(handle);
+	}
+
+	void MatchAwaiter::expired(){
+		done = true;
+	}
+
+	void MatchAwaiter::await_suspend(std::coroutine_handle<> h){
+		handle = h;
+		service.follow(*this);
+		following = true;
+		scheduler.arm(*this, Scheduler::Clock::now() + timeout);
+	}
+
+	std::optional<std::string> MatchAwaiter::await_resume(){
+		service.unfollow(*this);
+		following = false;
+		return std::move(line);
+	}
+
+	CollectAwaiter::CollectAwaiter(Scheduler& s, Service& srv, Scheduler::Clock::duration quiet_period, Scheduler::Clock::duration limit, size_t max):
+		scheduler{s},
+		service{srv},
+		quiet{quiet_period},
+		end{Scheduler::Clock::now() + limit},
+		max_size{max},
+		following{false},
+		done{false}
+	{}
+
+	CollectAwaiter::~CollectAwaiter(){
+		scheduler.cancel(*this);
+		if(following){
+			service.unfollow(*this);
+		}
+	}
+
+	void CollectAwaiter::notify(Service&, const uint8_t* data, size_t n){
+		if(done){
+			return;
+		}
+		output.append(reinterpret_cast<const char*>(data), std::min(n, max_size - output.size()));
+		if(output.size() >= max_size){
+			done = true;
+			scheduler.cancel(*this);
+			scheduler.defer(handle);
+			return;
+		}
+		scheduler.arm(*this, std::min(Scheduler::Clock::now() + quiet, end));
+	}
+
+	void CollectAwaiter::ended(Service&){
+		if(done){
+			return;
+		}
+		done = true;
+		scheduler.cancel(*this);
+		scheduler.defer(handle);
+	}
+
+	void CollectAwaiter::expired(){
+		done = true;
+	}
+
+	void CollectAwaiter::await_suspend(std::coroutine_handle<> h){
+		handle = h;
+		service.follow(*this);
+		following = true;
+		scheduler.arm(*this, std::min(Scheduler::Clock::now() + quiet, end));
+	}
+
+	std::string CollectAwaiter::await_resume(){
+		service.unfollow(*this);
+		following = false;
+		return std::move(output);
+	}
+
+	ExitAwaiter::ExitAwaiter(Scheduler& s, Service& srv, Scheduler::Clock::duration time):
+		scheduler{s},
+		service{srv},
+		timeout{time},
+		following{false},
+		done{false}
+	{}
+
+	ExitAwaiter::~ExitAwaiter(){
+		scheduler.cancel(*this);
+		if(following){
+			service.unfollow(*this);
+		}
+	}
+
+	void ExitAwaiter::notify(Service&, const uint8_t*, size_t){}
+
+	void ExitAwaiter::ended(Service&){
+		if(done){
+			return;
+		}
+		done = true;
+		scheduler.cancel(*this);
+		scheduler.defer(handle);
+	}
+
+	void ExitAwaiter::expired(){
+		done = true;
+	}
+
+	void ExitAwaiter::await_suspend(std::coroutine_handle<> h){
+		handle = h;
+		service.follow(*this);
+		following = true;
+		scheduler.arm(*this, Scheduler::Clock::now() + timeout);
+	}
+
+	bool ExitAwaiter::await_resume(){
+		if(following){
+			service.unfollow(*this);
+			following = false;
+		}
+		return service.getState() != Service::State::RUNNING;
+	}
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <optional>
+#include <string>
+
+#include "coro/scheduler.h"
+#include "service.h"
+
+namespace dvr {
+	/*
+	 * Awaitables on the output of a service. Output observers are notified
+	 * inside the relay loop of the service, so these resume deferred through
+	 * the scheduler. The service has to outlive the await.
+	 */
+
+	/*
+	 * Resumes with the first output line containing pattern or std::nullopt
+	 * after the timeout or the exit. An empty pattern matches every line.
+	 * The relay thread matches the output read after the construction, so
+	 * create it before the input or the start which cause the line.
+	 */
+	class MatchAwaiter final : public IServiceOutputObserver, public Scheduler::Timer {
+	private:
+		Scheduler& scheduler;
+		Service& service;
+		const std::string pattern;
+		const Scheduler::Clock::duration timeout;
+
+		std::optional<std::string> line;
+		bool following;
+		bool done;
+	public:
+		MatchAwaiter(Scheduler& s, Service& srv, const std::string& pat, Scheduler::Clock::duration time);
+		~MatchAwaiter();
+
+		void notify(Service& srv, const uint8_t* data, size_t n) override;
+		void matched(Service& srv, const std::string& pat, const std::string& ln) override;
+		void ended(Service& srv) override;
+		void expired() override;
+
+		bool await_ready() const noexcept {
+			return false;
+		}
+		void await_suspend(std::coroutine_handle<> h);
+		std::optional<std::string> await_resume();
+	};
+
+	inline MatchAwaiter matchOutput(Scheduler& scheduler, Service& service, const std::string& pattern, Scheduler::Clock::duration timeout){
+		return MatchAwaiter{scheduler, service, pattern, timeout};
+	}
+
+	/*
+	 * Collects the output until the service is quiet for the quiet period,
+	 * the limit has passed, max_size bytes arrived or the service exited.
+	 */
+	class CollectAwaiter final : public IServiceOutputObserver, public Scheduler::Timer {
+	private:
+		Scheduler& scheduler;
+		Service& service;
+		const Scheduler::Clock::duration quiet;
+		const Scheduler::Clock::time_point end;
+		const size_t max_size;
+
+		std::string output;
+		bool following;
+		bool done;
+	public:
+		CollectAwaiter(Scheduler& s, Service& srv, Scheduler::Clock::duration quiet_period, Scheduler::Clock::duration limit, size_t max);
+		~CollectAwaiter();
+
+		void notify(Service& srv, const uint8_t* data, size_t n) override;
+		void ended(Service& srv) override;
+		void expired() override;
+
+		bool await_ready() const noexcept {
+			return false;
+		}
+		void await_suspend(std::coroutine_handle<> h);
+		std::string await_resume();
+	};
+
+	inline CollectAwaiter collectOutput(Scheduler& scheduler, Service& service, Scheduler::Clock::duration quiet, Scheduler::Clock::duration limit, size_t max_size){
+		return CollectAwaiter{scheduler, service, quiet, limit, max_size};
+	}
+
+	/*
+	 * Resumes with true once the service isn't running anymore or with false after the timeout
+	 */
+	class ExitAwaiter final : public IServiceOutputObserver, public Scheduler::Timer {
+	private:
+		Scheduler& scheduler;
+		Service& service;
+		const Scheduler::Clock::duration timeout;
+
+		bool following;
+		bool done;
+	public:
+		ExitAwaiter(Scheduler& s, Service& srv, Scheduler::Clock::duration time);
+		~ExitAwaiter();
+
+		void notify(Service& srv, const uint8_t* data, size_t n) override;
+		void ended(Service& srv) override;
+		void expired() override;
+
+		bool await_ready() const noexcept {
+			return service.getState() != Service::State::RUNNING;
+		}
+		void await_suspend(std::coroutine_handle<> h);
+		bool await_resume();
+	};
+
+	inline ExitAwaiter exited(Scheduler& scheduler, Service& service, Scheduler::Clock::duration timeout){
+		return ExitAwaiter{scheduler, service, timeout};
+	}
+}
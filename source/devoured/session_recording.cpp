@@ -0,0 +1,485 @@
+#include "session_recording.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <memory>
+
+#include "log/log.h"
+#include "output_comparator.h"
+#include "process_stream.h"
+
+// Buffered records are written once they reach this
+const size_t recorder_block_size = 64 * 1024;
+// One read call of the replay
+const size_t replay_chunk_size = 64 * 1024;
+// A replayed child which should exit on its own gets this long, a terminated one until SIGKILL
+const auto replay_exit_grace = std::chrono::milliseconds{1000};
+const uint8_t recording_magic[4] = {'D', 'V', 'R', 'S'};
+const uint8_t recording_version = 1;
+
+namespace dvr {
+	namespace {
+		void putVarint(std::vector<uint8_t>& buffer, uint64_t value){
+			while(value >= 0x80){
+				buffer.push_back(static_cast<uint8_t>(value) | 0x80);
+				value >>= 7;
+			}
+			buffer.push_back(static_cast<uint8_t>(value));
+		}
+
+		void putString(std::vector<uint8_t>& buffer, const std::string& str){
+			putVarint(buffer, str.size());
+			buffer.insert(buffer.end(), str.begin(), str.end());
+		}
+
+		/*
+		 * Reads the fields of a file in memory. Every call fails once the data ends
+		 */
+		class FieldReader {
+		private:
+			const std::vector<uint8_t>& data;
+			size_t position;
+		public:
+			FieldReader(const std::vector<uint8_t>& d):
+				data{d},
+				position{0}
+			{}
+
+			bool varint(uint64_t& value){
+				value = 0;
+				for(unsigned shift = 0; shift < 64 && position < data.size(); shift += 7){
+					const uint8_t byte = data[position++];
+					value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+					if(!(byte & 0x80)){
+						return true;
+					}
+				}
+				return false;
+			}
+
+			bool bytes(uint64_t size, const uint8_t*& begin){
+				if(size > data.size() - position){
+					return false;
+				}
+				begin = data.data() + position;
+				position += size;
+				return true;
+			}
+
+			bool string(std::string& str){
+				uint64_t size;
+				const uint8_t* begin;
+				if(!varint(size) || !bytes(size, begin)){
+					return false;
+				}
+				str.assign(reinterpret_cast<const char*>(begin), size);
+				return true;
+			}
+
+			bool atEnd() const {
+				return position == data.size();
+			}
+		};
+
+		bool readFile(const std::string& path, std::vector<uint8_t>& data){
+			int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+			if(fd < 0){
+				return false;
+			}
+			struct ::stat info;
+			if(::fstat(fd, &info) == 0 && info.st_size > 0){
+				data.reserve(static_cast<size_t>(info.st_size));
+			}
+			uint8_t chunk[replay_chunk_size];
+			while(true){
+				ssize_t got = ::read(fd, chunk, sizeof(chunk));
+				if(got < 0 && errno == EINTR){
+					continue;
+				}
+				if(got <= 0){
+					::close(fd);
+					return got == 0;
+				}
+				data.insert(data.end(), chunk, chunk + got);
+			}
+		}
+
+		/*
+		 * Compares the output of the replay with the recorded stream
+		 */
+		class StreamComparator {
+		private:
+			const std::vector<uint8_t>& recorded;
+		public:
+			uint64_t received;
+			std::optional<uint64_t> mismatch;
+
+			StreamComparator(const std::vector<uint8_t>& rec):
+				recorded{rec},
+				received{0}
+			{}
+
+			/*
+			 * Returns false once the output diverged
+			 */
+			bool feed(const uint8_t* data, size_t n){
+				const uint64_t comparable = received < recorded.size() ? std::min<uint64_t>(n, recorded.size() - received) : 0;
+				const size_t equal = firstMismatch(data, recorded.data() + received, static_cast<size_t>(comparable));
+				if(equal < n){
+					mismatch = received + equal;
+				}
+				received += n;
+				return !mismatch;
+			}
+
+			void finish(){
+				if(!mismatch && received < recorded.size()){
+					mismatch = received;
+				}
+			}
+		};
+
+		/*
+		 * Reads until EAGAIN. Returns false on EOF, on EIO of a terminal without child or once the output diverged.
+		 */
+		bool drain(int fd, std::vector<uint8_t>& buffer, StreamComparator& comparator){
+			while(true){
+				ssize_t got = ::read(fd, buffer.data(), buffer.size());
+				if(got < 0){
+					if(errno == EINTR){
+						continue;
+					}
+					return errno == EAGAIN;
+				}
+				if(got == 0){
+					return false;
+				}
+				if(!comparator.feed(buffer.data(), static_cast<size_t>(got))){
+					return false;
+				}
+			}
+		}
+	}
+
+	std::optional<SessionRecording> readSessionRecording(const std::string& path, std::string& error){
+		std::vector<uint8_t> data;
+		if(!readFile(path, data)){
+			error = "Couldn't read " + path;
+			return std::nullopt;
+		}
+		FieldReader reader{data};
+		SessionRecording recording;
+		const uint8_t* magic;
+		const uint8_t* version;
+		uint64_t count;
+		uint64_t pty;
+		uint64_t rows;
+		uint64_t columns;
+		bool valid = reader.bytes(sizeof(recording_magic), magic) && std::equal(magic, magic + sizeof(recording_magic), recording_magic)
+			&& reader.bytes(1, version) && *version == recording_version
+			&& reader.string(recording.exec) && reader.varint(count) && count <= data.size();
+		for(uint64_t i = 0; valid && i < count; ++i){
+			valid = reader.string(recording.args.emplace_back());
+		}
+		valid = valid && reader.varint(pty) && reader.varint(rows) && reader.varint(columns);
+		if(!valid){
+			error = path + " is no session recording of this version";
+			return std::nullopt;
+		}
+		recording.pty = pty != 0;
+		recording.rows = static_cast<uint16_t>(rows);
+		recording.columns = static_cast<uint16_t>(columns);
+
+		std::chrono::microseconds time{0};
+		while(!reader.atEnd()){
+			uint64_t delta;
+			uint64_t tag;
+			if(!reader.varint(delta) || !reader.varint(tag)){
+				break;
+			}
+			time += std::chrono::microseconds{delta};
+			SessionRecord record{static_cast<SessionRecord::Kind>(tag & 0x3), time, 0, 0};
+			if(record.kind == SessionRecord::Kind::EXIT){
+				if(!reader.varint(record.offset)){
+					break;
+				}
+				recording.records.push_back(record);
+				break;
+			}
+			std::vector<uint8_t>& stream = recording.streams[static_cast<size_t>(record.kind)];
+			const uint8_t* begin;
+			if(!reader.bytes(tag >> 2, begin)){
+				break;
+			}
+			record.offset = stream.size();
+			record.size = tag >> 2;
+			stream.insert(stream.end(), begin, begin + record.size);
+			recording.records.push_back(record);
+		}
+		return recording;
+	}
+
+	SessionRecorder::SessionRecorder():
+		fd{-1}
+	{}
+
+	SessionRecorder::~SessionRecorder(){
+		if(fd >= 0){
+			flush();
+			::close(fd);
+		}
+	}
+
+	bool SessionRecorder::open(const std::string& path, const std::string& exec, const std::vector<std::string>& args, bool pty, uint16_t rows, uint16_t columns){
+		fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if(fd < 0){
+			return false;
+		}
+		buffer.reserve(recorder_block_size * 2);
+		buffer.insert(buffer.end(), recording_magic, recording_magic + sizeof(recording_magic));
+		buffer.push_back(recording_version);
+		putString(buffer, exec);
+		putVarint(buffer, args.size());
+		for(const std::string& arg : args){
+			putString(buffer, arg);
+		}
+		putVarint(buffer, pty ? 1 : 0);
+		putVarint(buffer, rows);
+		putVarint(buffer, columns);
+		last = std::chrono::steady_clock::now();
+		return true;
+	}
+
+	void SessionRecorder::append(SessionRecord::Kind kind, uint64_t size){
+		const auto now = std::chrono::steady_clock::now();
+		putVarint(buffer, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now - last).count()));
+		putVarint(buffer, (size << 2) | static_cast<uint64_t>(kind));
+		last = now;
+	}
+
+	void SessionRecorder::flush(){
+		size_t written = 0;
+		while(written < buffer.size()){
+			ssize_t n = ::write(fd, buffer.data() + written, buffer.size() - written);
+			if(n < 0){
+				if(errno == EINTR){
+					continue;
+				}
+				DVR_LOG(Error, "Stopped recording the session, writing failed with errno "<<errno);
+				::close(fd);
+				fd = -1;
+				break;
+			}
+			written += static_cast<size_t>(n);
+		}
+		buffer.clear();
+	}
+
+	void SessionRecorder::record(SessionRecord::Kind kind, const uint8_t* data, size_t n){
+		if(fd < 0 || n == 0){
+			return;
+		}
+		append(kind, n);
+		buffer.insert(buffer.end(), data, data + n);
+		if(buffer.size() >= recorder_block_size){
+			flush();
+		}
+	}
+
+	void SessionRecorder::finish(int status){
+		if(fd < 0){
+			return;
+		}
+		append(SessionRecord::Kind::EXIT, 0);
+		putVarint(buffer, static_cast<uint32_t>(status));
+		flush();
+		if(fd >= 0){
+			::close(fd);
+			fd = -1;
+		}
+	}
+
+	ReplayResult replaySession(const SessionRecording& recording, double speed){
+		const auto begin = std::chrono::steady_clock::now();
+		ReplayResult result{false, -1, false, {}, std::chrono::microseconds{0}, std::chrono::microseconds{0}};
+		if(!recording.records.empty()){
+			result.recorded = recording.records.back().time;
+		}
+
+		ProcessOptions options;
+		options.pty = recording.pty;
+		options.rows = recording.rows;
+		options.columns = recording.columns;
+		std::unique_ptr<ProcessStream> process = createProcessStream(recording.exec, recording.args, options);
+		if(!process){
+			return result;
+		}
+		result.started = true;
+		const int pid = process->getPID();
+		const int pid_fd = openPidFd(pid);
+
+		std::array<StreamComparator,2> comparators{StreamComparator{recording.streams[1]}, StreamComparator{recording.streams[2]}};
+		std::vector<uint8_t> buffer(replay_chunk_size);
+
+		// Recorded output before the next record. An input waits for it at speed 0
+		std::array<uint64_t,2> expected{0, 0};
+		size_t cursor = 0;
+		// Input of the current record not written yet
+		uint64_t input_begin = 0;
+		uint64_t input_end = 0;
+		// The fallback delay at speed 0 counts from the last input
+		auto last_input = begin;
+		std::chrono::microseconds last_input_time{0};
+		// Exit as recorded. Without an exit record the child is terminated after the last record
+		std::optional<int> recorded_status;
+		bool ended = false;
+		std::optional<std::chrono::steady_clock::time_point> terminate_at;
+		std::optional<std::chrono::steady_clock::time_point> kill_at;
+		bool diverged = false;
+
+		auto dueAt = [&](const SessionRecord& record){
+			if(speed > 0){
+				return begin + std::chrono::duration_cast<std::chrono::steady_clock::duration>(record.time / speed);
+			}
+			return last_input + (record.time - last_input_time);
+		};
+		auto caughtUp = [&](){
+			return speed <= 0 && comparators[0].received >= expected[0] && comparators[1].received >= expected[1];
+		};
+
+		// stdin, stdout, stderr, pidfd. poll skips negative fds
+		::pollfd fds[4];
+		fds[0] = {-1, POLLOUT, 0};
+		fds[1] = {process->getFD()[1], POLLIN, 0};
+		fds[2] = {process->getFD()[2], POLLIN, 0};
+		fds[3] = {pid_fd, POLLIN, 0};
+
+		while(fds[1].fd >= 0 || fds[2].fd >= 0 || fds[3].fd >= 0){
+			auto now = std::chrono::steady_clock::now();
+			// Output records only raise the expected output, inputs and the exit wait until they are due
+			while(!ended && input_begin == input_end && cursor <= recording.records.size()){
+				if(cursor == recording.records.size()){
+					if(!caughtUp() && (recording.records.empty() || now < dueAt(recording.records.back()))){
+						break;
+					}
+					terminate_at = now;
+					ended = true;
+					break;
+				}
+				const SessionRecord& record = recording.records[cursor];
+				if(record.kind == SessionRecord::Kind::STDOUT || record.kind == SessionRecord::Kind::STDERR){
+					expected[static_cast<size_t>(record.kind) - 1] += record.size;
+					++cursor;
+					continue;
+				}
+				if(!caughtUp() && now < dueAt(record)){
+					break;
+				}
+				if(record.kind == SessionRecord::Kind::INPUT){
+					input_begin = record.offset;
+					input_end = record.offset + record.size;
+					last_input = now;
+					last_input_time = record.time;
+					++cursor;
+					continue;
+				}
+				// A child the daemon stopped is stopped as well, one which exited on its own gets a grace period
+				recorded_status = static_cast<int>(record.offset);
+				terminate_at = WIFEXITED(*recorded_status) ? now + replay_exit_grace : now;
+				ended = true;
+			}
+			if(terminate_at && now >= *terminate_at){
+				::kill(pid, SIGTERM);
+				terminate_at.reset();
+				kill_at = now + replay_exit_grace;
+			}
+			if(kill_at && now >= *kill_at){
+				::kill(pid, SIGKILL);
+				kill_at.reset();
+			}
+
+			auto wake = std::chrono::steady_clock::time_point::max();
+			if(!ended && input_begin == input_end){
+				wake = cursor < recording.records.size() ? dueAt(recording.records[cursor]) : recording.records.empty() ? now : dueAt(recording.records.back());
+			}
+			if(terminate_at){
+				wake = std::min(wake, *terminate_at);
+			}
+			if(kill_at){
+				wake = std::min(wake, *kill_at);
+			}
+			int timeout_ms = -1;
+			if(wake != std::chrono::steady_clock::time_point::max()){
+				timeout_ms = static_cast<int>(std::max<int64_t>(0, std::chrono::ceil<std::chrono::milliseconds>(wake - now).count()));
+			}
+
+			fds[0].fd = input_begin < input_end ? process->getFD()[0] : -1;
+			if(::poll(fds, 4, timeout_ms) < 0){
+				if(errno == EINTR){
+					continue;
+				}
+				break;
+			}
+			if(fds[0].revents){
+				const std::vector<uint8_t>& input = recording.streams[0];
+				ssize_t n = ::write(fds[0].fd, input.data() + input_begin, static_cast<size_t>(input_end - input_begin));
+				if(n > 0){
+					input_begin += static_cast<uint64_t>(n);
+				}else if(n < 0 && errno != EAGAIN && errno != EINTR){
+					// EPIPE if the child closed its stdin. Later input is dropped as well
+					input_begin = input_end;
+				}
+			}
+			for(size_t i = 0; i < comparators.size(); ++i){
+				if(fds[i + 1].revents && !drain(fds[i + 1].fd, buffer, comparators[i])){
+					fds[i + 1].fd = -1;
+					diverged = diverged || comparators[i].mismatch.has_value();
+				}
+			}
+			if(diverged){
+				break;
+			}
+			if(fds[3].revents){
+				fds[3].fd = -1;
+			}
+		}
+		if(diverged){
+			::kill(pid, SIGKILL);
+		}else{
+			// Without a pidfd the loop ends on EOF and the child may still run
+			::kill(pid, SIGTERM);
+		}
+		if(pid_fd >= 0){
+			::close(pid_fd);
+		}
+		int status;
+		while(::waitpid(pid, &status, 0) < 0){
+			if(errno != EINTR){
+				status = -1;
+				break;
+			}
+		}
+		result.status = status;
+		for(size_t i = 0; i < comparators.size(); ++i){
+			// After a divergence the other stream was cut short
+			if(!diverged){
+				comparators[i].finish();
+			}
+			result.mismatch[i] = comparators[i].mismatch;
+		}
+		if(status >= 0 && recorded_status && WIFEXITED(*recorded_status)){
+			result.status_matches = WIFEXITED(status) && WEXITSTATUS(status) == WEXITSTATUS(*recorded_status);
+		}else{
+			result.status_matches = status >= 0;
+		}
+		result.duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin);
+		return result;
+	}
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace dvr {
+	/*
+	 * A recorded session is a header and a sequence of records:
+	 *
+	 * "DVRS", version byte, exec, argument count, arguments, pty byte, rows, columns
+	 * record: time delta in us, (size << 2) | kind, size bytes of data
+	 * exit record: time delta in us, kind, waitpid status
+	 *
+	 * Numbers are unsigned LEB128 varints and strings are a varint size and
+	 * their bytes, so a record of a short line costs a few bytes of overhead.
+	 */
+	struct SessionRecord {
+		enum class Kind : uint8_t {
+			INPUT,
+			STDOUT,
+			STDERR,
+			// Always the last record. Missing if the daemon didn't see the exit
+			EXIT
+		};
+
+		Kind kind;
+		// Since the start of the child
+		std::chrono::microseconds time;
+		// Range in the stream of the kind. The waitpid status for EXIT
+		uint64_t offset;
+		uint64_t size;
+	};
+
+	struct SessionRecording {
+		std::string exec;
+		std::vector<std::string> args;
+		bool pty;
+		uint16_t rows;
+		uint16_t columns;
+		std::vector<SessionRecord> records;
+		/*
+		 * Concatenated data of stdin, stdout and stderr
+		 */
+		std::array<std::vector<uint8_t>,3> streams;
+	};
+
+	/*
+	 * Returns std::nullopt and sets error if the file can't be read or isn't
+	 * a recording. A truncated last record is dropped.
+	 */
+	std::optional<SessionRecording> readSessionRecording(const std::string& path, std::string& error);
+
+	/*
+	 * Writes the session of one child. Records are buffered and written in
+	 * large blocks, so recording a chatty service costs few syscalls.
+	 * Output is recorded on the relay thread and input on the thread of the
+	 * event loop, the service serializes them with its processing mutex.
+	 */
+	class SessionRecorder {
+	private:
+		int fd;
+		std::vector<uint8_t> buffer;
+		std::chrono::steady_clock::time_point last;
+
+		void append(SessionRecord::Kind kind, uint64_t size);
+		void flush();
+	public:
+		SessionRecorder();
+		~SessionRecorder();
+
+		SessionRecorder(const SessionRecorder&) = delete;
+		SessionRecorder& operator=(const SessionRecorder&) = delete;
+
+		/*
+		 * Truncates the file. Call right after the start of the child.
+		 */
+		bool open(const std::string& path, const std::string& exec, const std::vector<std::string>& args, bool pty, uint16_t rows, uint16_t columns);
+
+		/*
+		 * Ignored if not open or once writing failed
+		 */
+		void record(SessionRecord::Kind kind, const uint8_t* data, size_t n);
+		/*
+		 * Records the exit and closes the file
+		 */
+		void finish(int status);
+	};
+
+	struct ReplayResult {
+		// The recorded binary couldn't be started
+		bool started;
+		// waitpid status, -1 if the child wasn't reaped
+		int status;
+		/*
+		 * The replayed child exited with the recorded status. A child the
+		 * daemon terminated is terminated the same way and always matches.
+		 */
+		bool status_matches;
+		// First byte of stdout and stderr which differs from the recording
+		std::array<std::optional<uint64_t>,2> mismatch;
+		std::chrono::microseconds duration;
+		// Duration of the recorded session
+		std::chrono::microseconds recorded;
+	};
+
+	/*
+	 * Starts a new instance of the recorded binary in the calling thread,
+	 * feeds it the recorded stdin and compares its output with the recording.
+	 *
+	 * Speed 1 writes the input at the recorded times, 2 twice as fast and so
+	 * on. Speed 0 is as fast as possible: every input is written as soon as
+	 * the output recorded before it arrived, so a prompt is answered after it
+	 * appeared. If that output never comes the input is written after the
+	 * recorded delay. The child is killed once its output diverges.
+	 */
+	ReplayResult replaySession(const SessionRecording& recording, double speed);
+}
@@ -3,16 +3,46 @@
 #include <signal.h>
 
 volatile sig_atomic_t shutdown_status = 0;
+volatile sig_atomic_t window_status = 0;
+volatile sig_atomic_t trace_status = 0;
+volatile sig_atomic_t child_status = 0;
 
 bool shutdown_requested(){
 	return shutdown_status != 0;
 }
 
+bool window_resized(){
+	if(window_status == 0){
+		return false;
+	}
+	window_status = 0;
+	return true;
+}
+
+bool trace_dump_requested(){
+	if(trace_status == 0){
+		return false;
+	}
+	trace_status = 0;
+	return true;
+}
+
+bool children_exited(){
+	if(child_status == 0){
+		return false;
+	}
+	child_status = 0;
+	return true;
+}
+
 void signal_handler(int sig){
 	switch(sig){
-		case SIGINT: shutdown_status = 1; break;
+		case SIGINT:
+		case SIGTERM: shutdown_status = 1; break;
 		case SIGPIPE: break;
-		case SIGCHLD: break;
+		case SIGCHLD: child_status = 1; break;
+		case SIGWINCH: window_status = 1; break;
+		case SIGUSR1: trace_status = 1; break;
 	}
 }
 
@@ -21,6 +51,9 @@ void signal_ignore_handler(){
 
 void register_signal_handlers(){
 	::signal(SIGINT, signal_handler);
+	::signal(SIGTERM, signal_handler);
 	::signal(SIGPIPE, signal_handler);
 	::signal(SIGCHLD, signal_handler);
+	::signal(SIGWINCH, signal_handler);
+	::signal(SIGUSR1, signal_handler);
 }
@@ -1,5 +1,17 @@
 #pragma once
 
 bool shutdown_requested();
+/*
+ * Returns true once after SIGWINCH was received
+ */
+bool window_resized();
+/*
+ * Returns true once after SIGUSR1 was received
+ */
+bool trace_dump_requested();
+/*
+ * Returns true once after SIGCHLD was received
+ */
+bool children_exited();
 void signal_handler(int sig);
 void register_signal_handlers();
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace dvr {
+	/*
+	 * Bounded lock-free queue between exactly one producer and one consumer
+	 * thread. Slots are reused in place, so a slot holding a vector keeps its
+	 * capacity and a steady stream doesn't allocate.
+	 *
+	 * The producer fills back() and publishes it with push(), the consumer
+	 * reads front() and gives it back with pop().
+	 */
+	template<typename T>
+	class SpscQueue {
+	private:
+		// Keeps the indices of both sides on separate cache lines
+		static const size_t cache_line = 64;
+
+		std::vector<T> slots;
+		const size_t mask;
+
+		// Written by the consumer
+		alignas(cache_line) std::atomic<size_t> head;
+		// Written by the producer
+		alignas(cache_line) std::atomic<size_t> tail;
+
+		static size_t roundUp(size_t capacity){
+			size_t size = 1;
+			while(size < capacity){
+				size <<= 1;
+			}
+			return size;
+		}
+	public:
+		/*
+		 * The capacity is rounded up to a power of two
+		 */
+		SpscQueue(size_t capacity):
+			slots(roundUp(capacity)),
+			mask{slots.size() - 1},
+			head{0},
+			tail{0}
+		{}
+
+		SpscQueue(const SpscQueue&) = delete;
+		SpscQueue& operator=(const SpscQueue&) = delete;
+
+		/*
+		 * Producer only. The slot to fill next, nullptr if the queue is full
+		 */
+		T* back(){
+			const size_t t = tail.load(std::memory_order_relaxed);
+			if(t - head.load(std::memory_order_acquire) == slots.size()){
+				return nullptr;
+			}
+			return &slots[t & mask];
+		}
+
+		/*
+		 * Producer only. Publishes the slot returned by back()
+		 */
+		void push(){
+			tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+
+		/*
+		 * Consumer only. The oldest slot, nullptr if the queue is empty
+		 */
+		T* front(){
+			const size_t h = head.load(std::memory_order_relaxed);
+			if(h == tail.load(std::memory_order_acquire)){
+				return nullptr;
+			}
+			return &slots[h & mask];
+		}
+
+		/*
+		 * Consumer only. Gives the slot returned by front() back to the producer
+		 */
+		void pop(){
+			head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+
+		/*
+		 * Exact on both sides for the own operations, the other side may change it any time
+		 */
+		size_t size() const {
+			return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+		}
+
+		size_t capacity() const {
+			return slots.size();
+		}
+	};
+}
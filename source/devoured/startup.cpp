@@ -0,0 +1,74 @@
+#include "startup.h"
+
+#include <sys/wait.h>
+
+#include <deque>
+
+namespace dvr {
+	std::optional<std::vector<std::string>> startupOrder(const std::map<std::string, ServiceConfig>& services, std::string& error){
+		// Kahn's algorithm. Key - service, value - unstarted dependencies
+		std::map<std::string, size_t> pending;
+		std::map<std::string, std::vector<std::string>> dependents;
+		std::deque<std::string> startable;
+		for(auto& entry : services){
+			for(const std::string& dependency : entry.second.after){
+				if(services.find(dependency) == services.end()){
+					error = entry.first + " depends on the unknown service " + dependency;
+					return std::nullopt;
+				}
+				dependents[dependency].push_back(entry.first);
+			}
+			pending[entry.first] = entry.second.after.size();
+			if(entry.second.after.empty()){
+				startable.push_back(entry.first);
+			}
+		}
+
+		std::vector<std::string> order;
+		order.reserve(services.size());
+		while(!startable.empty()){
+			std::string name = std::move(startable.front());
+			startable.pop_front();
+			for(const std::string& dependent : dependents[name]){
+				if(--pending[dependent] == 0){
+					startable.push_back(dependent);
+				}
+			}
+			order.push_back(std::move(name));
+		}
+
+		if(order.size() != services.size()){
+			error = "Cyclic dependencies between";
+			for(auto& entry : pending){
+				if(entry.second > 0){
+					error += " " + entry.first;
+				}
+			}
+			return std::nullopt;
+		}
+		return order;
+	}
+
+	std::optional<RestartPolicy> parseRestartPolicy(const std::string& name){
+		if(name == "no"){
+			return RestartPolicy::NO;
+		}else if(name == "on-failure"){
+			return RestartPolicy::ON_FAILURE;
+		}else if(name == "always"){
+			return RestartPolicy::ALWAYS;
+		}
+		return std::nullopt;
+	}
+
+	bool shouldRestart(RestartPolicy policy, std::optional<int> status, bool unhealthy){
+		switch(policy){
+			case RestartPolicy::NO:
+				return false;
+			case RestartPolicy::ON_FAILURE:
+				return unhealthy || !status || !WIFEXITED(*status) || WEXITSTATUS(*status) != 0;
+			case RestartPolicy::ALWAYS:
+				return true;
+		}
+		return false;
+	}
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "config/config.h"
+
+namespace dvr {
+	/*
+	 * Orders the services so that every one comes after the services in its
+	 * After list. Returns std::nullopt and describes the problem in error if
+	 * a dependency is unknown or the dependencies form a cycle.
+	 */
+	std::optional<std::vector<std::string>> startupOrder(const std::map<std::string, ServiceConfig>& services, std::string& error);
+
+	enum class RestartPolicy : uint8_t {
+		NO,
+		// A non zero exit, a signal, a failed start or failed health probes
+		ON_FAILURE,
+		ALWAYS
+	};
+
+	std::optional<RestartPolicy> parseRestartPolicy(const std::string& name);
+
+	/*
+	 * status is the waitpid status of the exit, std::nullopt if the start failed
+	 */
+	bool shouldRestart(RestartPolicy policy, std::optional<int> status, bool unhealthy);
+}
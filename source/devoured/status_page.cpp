@@ -0,0 +1,266 @@
+#include "status_page.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <memory>
+
+#include "service.h"
+#include "log/log.h"
+
+// A reader gives up after this many torn reads of one entry
+const size_t max_read_retries = 1000;
+
+namespace dvr {
+	namespace {
+		/*
+		 * Returns false if src didn't fit
+		 */
+		bool copyString(char* dest, size_t size, const std::string& src){
+			size_t n = std::min(size - 1, src.size());
+			std::memcpy(dest, src.data(), n);
+			std::memset(dest + n, 0, size - n);
+			return n == src.size();
+		}
+
+		int64_t unixMillis(std::chrono::system_clock::time_point time){
+			return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+		}
+	}
+
+	StatusRecord makeStatusRecord(const Service& service){
+		StatusRecord record;
+		std::memset(&record, 0, sizeof(record));
+		const bool name_fits = copyString(record.name, sizeof(record.name), service.name());
+		const bool description_fits = copyString(record.description, sizeof(record.description), service.describe());
+		record.truncated = name_fits && description_fits ? 0 : 1;
+		record.start_time = unixMillis(service.startTime()) / 1000;
+		record.sample_time = unixMillis(std::chrono::system_clock::now());
+		record.relayed_bytes = service.relayedBytes();
+		record.pid = service.getPID();
+		record.exit_status = service.exitStatus();
+		record.restarts = service.restarts();
+		record.used = 1;
+		record.state = static_cast<uint8_t>(service.getState());
+		return record;
+	}
+
+	StatusPage::StatusPage():
+		mapping{nullptr},
+		mapping_size{0},
+		capacity{0}
+	{}
+
+	StatusPage::~StatusPage(){
+		close();
+	}
+
+	bool StatusPage::create(const std::string& file_path, uint32_t entries){
+		const std::string temp_path = file_path + ".new";
+		const size_t size = sizeof(StatusPageHeader) + entries * sizeof(StatusPageEntry);
+		// Left behind by a daemon which didn't finish
+		::unlink(temp_path.c_str());
+		int fd = ::open(temp_path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+		if(fd < 0){
+			return false;
+		}
+		if(::ftruncate(fd, static_cast<off_t>(size)) != 0){
+			::close(fd);
+			::unlink(temp_path.c_str());
+			return false;
+		}
+		void* addr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		::close(fd);
+		if(addr == MAP_FAILED){
+			::unlink(temp_path.c_str());
+			return false;
+		}
+		if(mapping){
+			::munmap(mapping, mapping_size);
+		}
+
+		path = file_path;
+		mapping = addr;
+		mapping_size = size;
+		capacity = entries;
+
+		// The file is zeroed, which is a valid state for all sequences
+		StatusPageHeader* header = static_cast<StatusPageHeader*>(mapping);
+		std::memcpy(header->magic, status_page_magic, sizeof(header->magic));
+		header->version = status_page_version;
+		header->capacity = capacity;
+		header->daemon_pid = ::getpid();
+		return true;
+	}
+
+	bool StatusPage::publish(){
+		const std::string temp_path = path + ".new";
+		if(::rename(temp_path.c_str(), path.c_str()) != 0){
+			::unlink(temp_path.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	bool StatusPage::open(const std::string& file_path, uint32_t entries){
+		close();
+		if(!create(file_path, entries)){
+			return false;
+		}
+		if(!publish()){
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void StatusPage::close(){
+		if(!mapping){
+			return;
+		}
+		::munmap(mapping, mapping_size);
+		::unlink(path.c_str());
+		mapping = nullptr;
+		mapping_size = 0;
+		capacity = 0;
+		slots.clear();
+	}
+
+	StatusPageEntry* StatusPage::entry(uint32_t index){
+		uint8_t* base = static_cast<uint8_t*>(mapping) + sizeof(StatusPageHeader);
+		return reinterpret_cast<StatusPageEntry*>(base + index * sizeof(StatusPageEntry));
+	}
+
+	void StatusPage::write(uint32_t index, const StatusRecord& record){
+		StatusPageEntry* e = entry(index);
+		uint32_t sequence = e->sequence.load(std::memory_order_relaxed);
+		e->sequence.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		std::memcpy(&e->record, &record, sizeof(record));
+		e->sequence.store(sequence + 2, std::memory_order_release);
+	}
+
+	bool StatusPage::grow(){
+		std::vector<std::pair<uint32_t, StatusRecord>> records;
+		records.reserve(slots.size());
+		for(auto& slot : slots){
+			records.emplace_back(slot.second, entry(slot.second)->record);
+		}
+		const std::string file_path = path;
+		const uint32_t entries = capacity * 2;
+		bool grown = create(file_path, entries);
+		if(grown){
+			// The records are in place before the rename, readers of the old file keep its last state
+			for(auto& record : records){
+				write(record.first, record.second);
+			}
+			grown = publish();
+		}
+		if(!grown){
+			DVR_LOG(Warning, "Couldn't grow the status page "<<file_path<<" to "<<entries<<" entries, clients ask the daemon");
+			close();
+		}
+		return grown;
+	}
+
+	bool StatusPage::update(const std::string& name, const StatusRecord& record){
+		if(!mapping){
+			return false;
+		}
+		auto find = slots.find(name);
+		if(find == slots.end()){
+			if(slots.size() >= capacity && !grow()){
+				return false;
+			}
+			// Lowest free entry
+			std::vector<bool> taken(capacity, false);
+			for(auto& slot : slots){
+				taken[slot.second] = true;
+			}
+			uint32_t index = static_cast<uint32_t>(std::find(taken.begin(), taken.end(), false) - taken.begin());
+			find = slots.insert(std::make_pair(name, index)).first;
+		}
+		write(find->second, record);
+		return true;
+	}
+
+	void StatusPage::remove(const std::string& name){
+		auto find = slots.find(name);
+		if(!mapping || find == slots.end()){
+			return;
+		}
+		StatusRecord record;
+		std::memset(&record, 0, sizeof(record));
+		write(find->second, record);
+		slots.erase(find);
+	}
+
+	std::optional<std::vector<StatusRecord>> readStatusPage(const std::string& file_path){
+		int fd = ::open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+		if(fd < 0){
+			return std::nullopt;
+		}
+		struct ::stat st;
+		if(::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(StatusPageHeader)){
+			::close(fd);
+			return std::nullopt;
+		}
+		const size_t size = static_cast<size_t>(st.st_size);
+		void* addr = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+		if(addr == MAP_FAILED){
+			return std::nullopt;
+		}
+		// Unmaps on every return
+		std::unique_ptr<void, std::function<void(void*)>> guard{addr, [size](void* a){ ::munmap(a, size); }};
+
+		const StatusPageHeader* header = static_cast<const StatusPageHeader*>(addr);
+		if(std::memcmp(header->magic, status_page_magic, sizeof(header->magic)) != 0){
+			return std::nullopt;
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if(header->version != status_page_version || size < sizeof(StatusPageHeader) + header->capacity * sizeof(StatusPageEntry)){
+			return std::nullopt;
+		}
+		if(::kill(header->daemon_pid, 0) != 0 && errno == ESRCH){
+			return std::nullopt;
+		}
+
+		std::vector<StatusRecord> records;
+		const uint8_t* base = static_cast<const uint8_t*>(addr) + sizeof(StatusPageHeader);
+		for(uint32_t i = 0; i < header->capacity; ++i){
+			const StatusPageEntry* e = reinterpret_cast<const StatusPageEntry*>(base + i * sizeof(StatusPageEntry));
+			StatusRecord record;
+			bool consistent = false;
+			for(size_t retry = 0; retry < max_read_retries && !consistent; ++retry){
+				uint32_t before = e->sequence.load(std::memory_order_acquire);
+				if(before & 1){
+					continue;
+				}
+				std::memcpy(&record, &e->record, sizeof(record));
+				std::atomic_thread_fence(std::memory_order_acquire);
+				consistent = e->sequence.load(std::memory_order_relaxed) == before;
+			}
+			if(!consistent){
+				return std::nullopt;
+			}
+			if(record.used){
+				record.name[sizeof(record.name) - 1] = '\0';
+				record.description[sizeof(record.description) - 1] = '\0';
+				records.push_back(record);
+			}
+		}
+		std::sort(records.begin(), records.end(), [](const StatusRecord& a, const StatusRecord& b){
+			return std::strcmp(a.name, b.name) < 0;
+		});
+		return records;
+	}
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace dvr {
+	class Service;
+
+	/*
+	 * Layout of the status page, a memory mapped file next to the control
+	 * socket (<socket>.status). Only the daemon writes it. Readers map it
+	 * read only and never block the daemon.
+	 *
+	 * StatusPageHeader
+	 * StatusPageEntry[capacity]
+	 *
+	 * Every page is filled under <page>.new and renamed over the path, so
+	 * readers never see it half written. The daemon moves the records to a
+	 * new page of twice the capacity when all entries are in use, readers of
+	 * the old one keep its last state.
+	 *
+	 * Every entry is guarded by a seqlock. The sequence is odd while the
+	 * daemon writes the record. Readers copy the record and retry if the
+	 * sequence was odd or changed in between.
+	 */
+	const char status_page_magic[8] = {'D','V','R','S','T','A','T','\0'};
+	const uint32_t status_page_version = 2;
+
+	struct StatusPageHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t capacity;
+		// Readers ignore the page if this process is gone
+		int32_t daemon_pid;
+		uint32_t reserved;
+	};
+
+	struct StatusRecord {
+		char name[64];
+		// Same line as in STATUS responses
+		char description[192];
+		// Unix time in seconds
+		int64_t start_time;
+		// Unix time in milliseconds when relayed_bytes was sampled
+		int64_t sample_time;
+		uint64_t relayed_bytes;
+		int32_t pid;
+		int32_t exit_status;
+		uint32_t restarts;
+		// 0 for free entries
+		uint8_t used;
+		// Service::State
+		uint8_t state;
+		// The name or the description didn't fit, readers have to ask the daemon
+		uint8_t truncated;
+		uint8_t reserved;
+	};
+
+	struct StatusPageEntry {
+		std::atomic<uint32_t> sequence;
+		uint32_t reserved;
+		StatusRecord record;
+	};
+
+	static_assert(std::atomic<uint32_t>::is_always_lock_free, "The seqlock is shared between processes");
+
+	StatusRecord makeStatusRecord(const Service& service);
+
+	/*
+	 * Writer side, owned by the daemon. The file is removed on destruction.
+	 */
+	class StatusPage {
+	private:
+		std::string path;
+		void* mapping;
+		size_t mapping_size;
+		uint32_t capacity;
+		/*
+		 * Key - Service name
+		 * Value - Entry index
+		 */
+		std::map<std::string, uint32_t> slots;
+
+		StatusPageEntry* entry(uint32_t index);
+		void write(uint32_t index, const StatusRecord& record);
+		/*
+		 * Maps an empty page under the temporary name in place of the current one
+		 */
+		bool create(const std::string& file_path, uint32_t entries);
+		/*
+		 * Renames the temporary file over the path
+		 */
+		bool publish();
+		/*
+		 * Moves the records to a page of twice the capacity
+		 */
+		bool grow();
+	public:
+		StatusPage();
+		~StatusPage();
+
+		bool open(const std::string& file_path, uint32_t entries);
+		void close();
+
+		/*
+		 * Grows the page if all entries are in use. Returns false if the page
+		 * isn't open, which it no longer is once growing failed. Readers
+		 * then find no page and ask the daemon.
+		 */
+		bool update(const std::string& name, const StatusRecord& record);
+		void remove(const std::string& name);
+	};
+
+	/*
+	 * Consistent copy of all used entries sorted by name. Returns std::nullopt
+	 * if the page doesn't exist, is of another version or its daemon is gone.
+	 */
+	std::optional<std::vector<StatusRecord>> readStatusPage(const std::string& file_path);
+}
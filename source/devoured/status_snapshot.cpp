@@ -0,0 +1,76 @@
+#include "status_snapshot.h"
+
+#include "network/protocol.h"
+
+namespace dvr {
+	StatusSnapshot::StatusSnapshot():
+		frames{nullptr}
+	{}
+
+	void StatusSnapshot::update(const std::string& name, const std::string& status){
+		auto& entry = entries[name];
+		if(entry != status){
+			entry = status;
+			frames.reset();
+		}
+	}
+
+	void StatusSnapshot::remove(const std::string& name){
+		if(entries.erase(name) > 0){
+			frames.reset();
+		}
+	}
+
+	void StatusSnapshot::rebuild(){
+		auto result = std::make_shared<StatusFrames>();
+
+		auto addFrame = [&result](const std::string& content, ReturnCode code){
+			result->push_back(StatusFrame{
+				static_cast<uint8_t>(code),
+				std::make_shared<const std::vector<uint8_t>>(content.begin(), content.end())
+			});
+		};
+
+		if(entries.empty()){
+			addFrame("Currently no service registered", ReturnCode::OK);
+			frames = std::move(result);
+			return;
+		}
+
+		const size_t max_size = maxResponseContentSize();
+		std::string content;
+		for(auto& entry : entries){
+			const std::string& line = entry.second;
+			if(!content.empty() && content.size() + line.size() + 1 > max_size){
+				addFrame(content, ReturnCode::PARTIAL);
+				content.clear();
+			}
+			content.append(line, 0, max_size - 1);
+			content.push_back('\n');
+		}
+		addFrame(content, ReturnCode::OK);
+		frames = std::move(result);
+	}
+
+	std::shared_ptr<const StatusFrames> StatusSnapshot::get(){
+		if(!frames){
+			rebuild();
+		}
+		return frames;
+	}
+
+	void StatusSnapshot::send(Connection& connection, uint16_t request_id){
+		std::shared_ptr<const StatusFrames> contents = get();
+		std::vector<SharedBuffer> buffers;
+		buffers.reserve(2 * contents->size());
+		for(const StatusFrame& frame : *contents){
+			std::vector<uint8_t> header;
+			if(!serializeResponseHeader(header, request_id, frame.return_code, "", frame.content->size())){
+				continue;
+			}
+			buffers.push_back(std::make_shared<const std::vector<uint8_t>>(std::move(header)));
+			buffers.push_back(frame.content);
+		}
+		connection.write(buffers);
+	}
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "network/network.h"
+
+namespace dvr {
+	struct StatusFrame {
+		uint8_t return_code;
+		SharedBuffer content;
+	};
+
+	typedef std::vector<StatusFrame> StatusFrames;
+
+	/*
+	 * Status of all services, answered for STATUS requests without a target.
+	 * Entries are only updated when the state of a service changes and the
+	 * contents are serialized once after a change. Requests in between
+	 * queue references to the same contents behind a header of their own.
+	 */
+	class StatusSnapshot {
+	private:
+		/*
+		 * Key - Service name
+		 * Value - Status line of the service
+		 */
+		std::map<std::string, std::string> entries;
+
+		std::shared_ptr<const StatusFrames> frames;
+
+		void rebuild();
+	public:
+		StatusSnapshot();
+
+		void update(const std::string& name, const std::string& status);
+		void remove(const std::string& name);
+
+		/*
+		 * Contents of the responses. All but the last one are PARTIAL.
+		 */
+		std::shared_ptr<const StatusFrames> get();
+		/*
+		 * Queues the responses for request_id on the connection
+		 */
+		void send(Connection& connection, uint16_t request_id);
+	};
+}
@@ -0,0 +1,211 @@
+#include "subscriptions.h"
+
+#include <sstream>
+#include <vector>
+
+#include "network/protocol.h"
+
+namespace dvr {
+	class SubscriptionHub::LineMatcher final : public IServiceOutputObserver {
+	private:
+		SubscriptionHub& hub;
+		Service& service;
+		/*
+		 * Key - Pattern
+		 * Value - Number of subscriptions using it
+		 */
+		std::map<std::string, size_t> patterns;
+		bool following;
+	public:
+		LineMatcher(SubscriptionHub& h, Service& srv):
+			hub{h},
+			service{srv},
+			following{false}
+		{}
+
+		~LineMatcher(){
+			for(auto& entry : patterns){
+				service.unwatch(entry.first);
+			}
+			if(following){
+				service.unfollow(*this);
+			}
+		}
+
+		void add(const std::string& pattern){
+			if(++patterns[pattern] == 1){
+				service.watch(pattern);
+			}
+			if(!following){
+				service.follow(*this);
+				following = true;
+			}
+		}
+
+		void remove(const std::string& pattern){
+			auto find = patterns.find(pattern);
+			if(find == patterns.end()){
+				return;
+			}
+			if(--find->second == 0){
+				patterns.erase(find);
+				service.unwatch(pattern);
+			}
+			if(patterns.empty() && following){
+				service.unfollow(*this);
+				following = false;
+			}
+		}
+
+		void notify(Service&, const uint8_t*, size_t) override {}
+
+		// Called for the patterns of all watchers of the service
+		void matched(Service& srv, const std::string& pattern, const std::string& line) override {
+			if(patterns.count(pattern)){
+				hub.onMatch(srv.name(), pattern, line);
+			}
+		}
+	};
+
+	SubscriptionHub::SubscriptionHub() = default;
+	SubscriptionHub::~SubscriptionHub() = default;
+
+	void SubscriptionHub::addService(Service& service){
+		auto matcher = std::make_unique<LineMatcher>(*this, service);
+		for(auto& entry : subscriptions){
+			const Subscription& sub = entry.second;
+			if((sub.target.empty() || sub.target == service.name()) && (sub.kinds & static_cast<uint8_t>(EventKind::MATCH))){
+				matcher->add(sub.pattern);
+			}
+		}
+		matchers[service.name()] = std::move(matcher);
+	}
+
+	void SubscriptionHub::removeService(const std::string& name){
+		matchers.erase(name);
+	}
+
+	void SubscriptionHub::addPattern(const Subscription& sub){
+		if(!(sub.kinds & static_cast<uint8_t>(EventKind::MATCH))){
+			return;
+		}
+		for(auto& entry : matchers){
+			if(sub.target.empty() || sub.target == entry.first){
+				entry.second->add(sub.pattern);
+			}
+		}
+	}
+
+	void SubscriptionHub::removePattern(const Subscription& sub){
+		if(!(sub.kinds & static_cast<uint8_t>(EventKind::MATCH))){
+			return;
+		}
+		for(auto& entry : matchers){
+			if(sub.target.empty() || sub.target == entry.first){
+				entry.second->remove(sub.pattern);
+			}
+		}
+	}
+
+	bool SubscriptionHub::subscribe(Connection& connection, const std::string& target, const std::string& spec){
+		uint8_t kinds = 0;
+		std::string pattern;
+
+		std::istringstream ss{spec};
+		std::string token;
+		while(ss>>token){
+			if(token == "state"){
+				kinds |= static_cast<uint8_t>(EventKind::STATE);
+			}else if(token == "exit"){
+				kinds |= static_cast<uint8_t>(EventKind::EXIT);
+			}else if(token == "match"){
+				ss>>std::ws;
+				std::getline(ss, pattern);
+				if(pattern.empty()){
+					return false;
+				}
+				kinds |= static_cast<uint8_t>(EventKind::MATCH);
+			}else{
+				return false;
+			}
+		}
+		if(kinds == 0){
+			kinds = static_cast<uint8_t>(EventKind::STATE) | static_cast<uint8_t>(EventKind::EXIT);
+		}
+
+		auto iter = subscriptions.insert(std::make_pair(connection.id(), Subscription{connection, target, kinds, pattern}));
+		addPattern(iter->second);
+		return true;
+	}
+
+	void SubscriptionHub::unsubscribe(ConnectionId id){
+		auto range = subscriptions.equal_range(id);
+		for(auto iter = range.first; iter != range.second; ++iter){
+			removePattern(iter->second);
+		}
+		subscriptions.erase(range.first, range.second);
+	}
+
+	void SubscriptionHub::onStateChange(Service& service, Service::State state){
+		if(subscriptions.empty()){
+			return;
+		}
+		pending[std::make_tuple(service.name(), static_cast<uint8_t>(EventKind::STATE), std::string{})] = service.describe();
+		if(state == Service::State::EXITED){
+			pending[std::make_tuple(service.name(), static_cast<uint8_t>(EventKind::EXIT), std::string{})] = service.describe();
+		}
+	}
+
+	void SubscriptionHub::onMatch(const std::string& service, const std::string& pattern, const std::string& line){
+		std::string& content = pending[std::make_tuple(service, static_cast<uint8_t>(EventKind::MATCH), pattern)];
+		// Lines beyond a single response are dropped until the next flush
+		if(content.size() + line.size() + 1 + service.size() > maxResponseContentSize()){
+			return;
+		}
+		content.append(line);
+		content.push_back('\n');
+	}
+
+	void SubscriptionHub::flush(){
+		for(auto& event : pending){
+			const std::string& service = std::get<0>(event.first);
+			const uint8_t kind = std::get<1>(event.first);
+			const std::string& pattern = std::get<2>(event.first);
+
+			std::string content;
+			switch(static_cast<EventKind>(kind)){
+				case EventKind::STATE: content = "state "; break;
+				case EventKind::EXIT: content = "exit "; break;
+				case EventKind::MATCH: content = "match " + pattern + ": "; break;
+			}
+			content += event.second;
+
+			MessageResponse resp{
+				event_request_id,
+				static_cast<uint8_t>(ReturnCode::OK),
+				service,
+				content.substr(0, maxResponseContentSize() - service.size())
+			};
+			std::vector<uint8_t> buffer;
+			if(!serializeMessageResponse(buffer, resp)){
+				continue;
+			}
+			SharedBuffer frame = std::make_shared<const std::vector<uint8_t>>(std::move(buffer));
+
+			for(auto& entry : subscriptions){
+				const Subscription& sub = entry.second;
+				if(!(sub.kinds & kind)){
+					continue;
+				}
+				if(!sub.target.empty() && sub.target != service){
+					continue;
+				}
+				if(kind == static_cast<uint8_t>(EventKind::MATCH) && sub.pattern != pattern){
+					continue;
+				}
+				sub.connection.write(frame);
+			}
+		}
+		pending.clear();
+	}
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+
+#include "network/network.h"
+#include "network/protocol.h"
+#include "service.h"
+
+namespace dvr {
+	enum class EventKind : uint8_t {
+		STATE = 1,
+		EXIT = 2,
+		MATCH = 4
+	};
+
+	/*
+	 * Keeps the SUBSCRIBE registrations and pushes events to them.
+	 * Events are collected during one loop iteration and coalesced per
+	 * service and kind. Every event is serialized once and the same buffer
+	 * is queued on all matching connections.
+	 */
+	class SubscriptionHub {
+	private:
+		// Watches the subscribed patterns on a service and collects its matches
+		class LineMatcher;
+
+		struct Subscription {
+			Connection& connection;
+			std::string target;
+			uint8_t kinds;
+			std::string pattern;
+		};
+
+		std::multimap<ConnectionId, Subscription> subscriptions;
+
+		/*
+		 * Key - Service name
+		 */
+		std::map<std::string, std::unique_ptr<LineMatcher>> matchers;
+
+		/*
+		 * Events since the last flush
+		 * Key - Service name, EventKind, Pattern
+		 * Value - Content. State and exit only keep the newest, matches are appended
+		 */
+		std::map<std::tuple<std::string, uint8_t, std::string>, std::string> pending;
+
+		void addPattern(const Subscription& sub);
+		void removePattern(const Subscription& sub);
+	public:
+		SubscriptionHub();
+		~SubscriptionHub();
+
+		void addService(Service& service);
+		void removeService(const std::string& name);
+
+		/*
+		 * spec is a space separated list of "state" and "exit". "match <pattern>"
+		 * has to be last, the rest of the spec is the pattern.
+		 * An empty target subscribes to all services.
+		 * Returns false if the spec is invalid.
+		 */
+		bool subscribe(Connection& connection, const std::string& target, const std::string& spec);
+		void unsubscribe(ConnectionId id);
+
+		void onStateChange(Service& service, Service::State state);
+		void onMatch(const std::string& service, const std::string& pattern, const std::string& line);
+
+		void flush();
+	};
+}
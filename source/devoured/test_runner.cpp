@@ -0,0 +1,326 @@
+#include "test_runner.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "output_comparator.h"
+#include "process_stream.h"
+
+// One read or write call
+const size_t runner_chunk_size = 64 * 1024;
+
+namespace dvr {
+	namespace {
+		/*
+		 * Closes the fd when leaving the scope. -1 is no fd
+		 */
+		class ScopedFd {
+		public:
+			const int fd;
+
+			explicit ScopedFd(int f):
+				fd{f}
+			{}
+			ScopedFd(const ScopedFd&) = delete;
+			ScopedFd& operator=(const ScopedFd&) = delete;
+			~ScopedFd(){
+				if(fd >= 0){
+					::close(fd);
+				}
+			}
+		};
+
+		int openOptional(const std::string& path){
+			if(path == "-"){
+				return -1;
+			}
+			return ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		}
+
+		/*
+		 * Moves the input file to stdin of the child as far as the pipe accepts it
+		 */
+		class InputFeeder {
+		private:
+			const int fd;
+			std::vector<uint8_t> buffer;
+			size_t begin;
+			size_t end;
+		public:
+			InputFeeder(int input_fd):
+				fd{input_fd},
+				buffer(input_fd >= 0 ? runner_chunk_size : 0),
+				begin{0},
+				end{0}
+			{}
+
+			/*
+			 * Returns false once stdin should be closed, because the input ended or the child closed it
+			 */
+			bool feed(int stdin_fd){
+				while(true){
+					if(begin == end){
+						ssize_t got = ::read(fd, buffer.data(), buffer.size());
+						if(got < 0 && errno == EINTR){
+							continue;
+						}
+						if(got <= 0){
+							return false;
+						}
+						begin = 0;
+						end = static_cast<size_t>(got);
+					}
+					ssize_t written = ::write(stdin_fd, buffer.data() + begin, end - begin);
+					if(written < 0){
+						if(errno == EINTR){
+							continue;
+						}
+						// EPIPE if the child doesn't read its input
+						return errno == EAGAIN;
+					}
+					begin += static_cast<size_t>(written);
+				}
+			}
+		};
+
+		/*
+		 * Reads until EAGAIN. Returns false on EOF or once the output diverged.
+		 */
+		bool drain(int fd, std::vector<uint8_t>& buffer, OutputComparator* comparator){
+			while(true){
+				ssize_t got = ::read(fd, buffer.data(), buffer.size());
+				if(got < 0){
+					if(errno == EINTR){
+						continue;
+					}
+					return errno == EAGAIN;
+				}
+				if(got == 0){
+					return false;
+				}
+				if(comparator && !comparator->feed(buffer.data(), static_cast<size_t>(got))){
+					return false;
+				}
+			}
+		}
+
+		struct WorkerQueue {
+			std::mutex mutex;
+			std::deque<size_t> jobs;
+		};
+
+		bool takeJob(std::vector<WorkerQueue>& queues, size_t self, size_t& job){
+			{
+				std::lock_guard<std::mutex> lock{queues[self].mutex};
+				if(!queues[self].jobs.empty()){
+					job = queues[self].jobs.front();
+					queues[self].jobs.pop_front();
+					return true;
+				}
+			}
+			// No jobs are added while running, so one empty pass over all victims means the work is done
+			for(size_t i = 1; i < queues.size(); ++i){
+				WorkerQueue& victim = queues[(self + i) % queues.size()];
+				std::lock_guard<std::mutex> lock{victim.mutex};
+				if(!victim.jobs.empty()){
+					job = victim.jobs.back();
+					victim.jobs.pop_back();
+					return true;
+				}
+			}
+			return false;
+		}
+	}
+
+	std::optional<std::vector<TestJob>> parseTestManifest(std::istream& stream, std::string& error){
+		std::vector<TestJob> jobs;
+		std::string line;
+		size_t line_number = 0;
+		while(std::getline(stream, line)){
+			++line_number;
+			std::istringstream ss{line};
+			TestJob job{line_number, "", "", "", std::chrono::milliseconds{0}, OutputComparator::Normalization::EXACT};
+			if(!(ss>>job.binary) || job.binary[0] == '#'){
+				continue;
+			}
+			if(!(ss>>job.input>>job.expected)){
+				error = line;
+				return std::nullopt;
+			}
+			std::string limit;
+			while(ss>>limit){
+				unsigned long value;
+				std::optional<OutputComparator::Normalization> normalization;
+				if(limit.compare(0, 5, "time=") == 0 && std::istringstream{limit.substr(5)}>>value){
+					job.time_limit = std::chrono::milliseconds{value};
+				}else if(limit.compare(0, 8, "compare=") == 0 && (normalization = parseNormalization(limit.substr(8)))){
+					job.compare = *normalization;
+				}else{
+					error = line;
+					return std::nullopt;
+				}
+			}
+			jobs.push_back(std::move(job));
+		}
+		return jobs;
+	}
+
+	const char* outcomeName(TestResult::Outcome outcome){
+		switch(outcome){
+			case TestResult::Outcome::PASS: return "pass";
+			case TestResult::Outcome::FAIL: return "fail";
+			case TestResult::Outcome::TIMEOUT: return "timeout";
+			case TestResult::Outcome::ERROR: return "error";
+		}
+		return "unknown";
+	}
+
+	TestResult runTestJob(const TestJob& job){
+		const auto begin = std::chrono::steady_clock::now();
+		TestResult result{job.line, TestResult::Outcome::ERROR, -1, std::chrono::microseconds{0}, std::nullopt};
+		auto finished = [&](){
+			result.duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin);
+			return result;
+		};
+
+		ScopedFd input{openOptional(job.input)};
+		OutputComparator comparator{job.compare};
+		const bool comparing = job.expected != "-";
+		if((job.input != "-" && input.fd < 0) || (comparing && !comparator.open(job.expected))){
+			return finished();
+		}
+		std::unique_ptr<ProcessStream> process = createProcessStream(job.binary);
+		if(!process){
+			return finished();
+		}
+		const int pid = process->getPID();
+		ScopedFd pid_fd{openPidFd(pid)};
+
+		InputFeeder feeder{input.fd};
+		std::vector<uint8_t> buffer(runner_chunk_size);
+		if(input.fd < 0){
+			process->closeInput();
+		}
+
+		// stdin, stdout, stderr, pidfd. poll skips negative fds
+		::pollfd fds[4];
+		fds[0] = {process->getFD()[0], POLLOUT, 0};
+		fds[1] = {process->getFD()[1], POLLIN, 0};
+		fds[2] = {process->getFD()[2], POLLIN, 0};
+		fds[3] = {pid_fd.fd, POLLIN, 0};
+		const auto deadline = begin + job.time_limit;
+		bool timed_out = false;
+		bool failed = false;
+		bool diverged = false;
+
+		// stderr is drained, so the child never blocks on it, but not compared
+		while(fds[1].fd >= 0 || fds[2].fd >= 0 || fds[3].fd >= 0){
+			int timeout_ms = -1;
+			if(job.time_limit.count() > 0){
+				auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+				if(remaining <= 0){
+					timed_out = true;
+					break;
+				}
+				timeout_ms = static_cast<int>(remaining);
+			}
+			if(::poll(fds, 4, timeout_ms) < 0){
+				if(errno == EINTR){
+					continue;
+				}
+				failed = true;
+				break;
+			}
+			if(fds[0].revents && !feeder.feed(fds[0].fd)){
+				process->closeInput();
+				fds[0].fd = -1;
+			}
+			if(fds[1].revents && !drain(fds[1].fd, buffer, comparing ? &comparator : nullptr)){
+				fds[1].fd = -1;
+				// No need to wait for the rest of a wrong output
+				if(comparing && comparator.finish()){
+					diverged = true;
+					break;
+				}
+			}
+			if(fds[2].revents && !drain(fds[2].fd, buffer, nullptr)){
+				fds[2].fd = -1;
+			}
+			if(fds[3].revents){
+				fds[3].fd = -1;
+			}
+		}
+		if(timed_out || failed || diverged){
+			::kill(pid, SIGKILL);
+		}
+		// Without a pidfd this waits for a child which closed stdout without the time limit
+		int status;
+		while(::waitpid(pid, &status, 0) < 0){
+			if(errno != EINTR){
+				return finished();
+			}
+		}
+		result.status = status;
+		if(comparing){
+			result.mismatch = comparator.finish();
+		}
+
+		if(timed_out){
+			result.outcome = TestResult::Outcome::TIMEOUT;
+		}else if(!failed && WIFEXITED(status) && WEXITSTATUS(status) == 0 && !result.mismatch){
+			result.outcome = TestResult::Outcome::PASS;
+		}else if(!failed){
+			result.outcome = TestResult::Outcome::FAIL;
+		}
+		return finished();
+	}
+
+	TestRunner::TestRunner(size_t worker_count):
+		workers{worker_count > 0 ? worker_count : std::max(1u, std::thread::hardware_concurrency())}
+	{}
+
+	void TestRunner::run(const std::vector<TestJob>& jobs, const ResultHandler& handler){
+		if(jobs.empty()){
+			return;
+		}
+		const size_t count = std::min(workers, jobs.size());
+		std::vector<WorkerQueue> queues(count);
+		// Contiguous blocks. Thieves take from the end their owner reaches last
+		for(size_t i = 0; i < jobs.size(); ++i){
+			queues[i * count / jobs.size()].jobs.push_back(i);
+		}
+
+		std::mutex handler_mutex;
+		auto work = [&](size_t self){
+			size_t index;
+			while(takeJob(queues, self, index)){
+				TestResult result = runTestJob(jobs[index]);
+				std::lock_guard<std::mutex> lock{handler_mutex};
+				handler(jobs[index], result);
+			}
+		};
+
+		std::vector<std::thread> threads;
+		for(size_t i = 1; i < count; ++i){
+			threads.emplace_back(work, i);
+		}
+		work(0);
+		for(std::thread& thread : threads){
+			thread.join();
+		}
+	}
+
+	size_t TestRunner::workerCount() const {
+		return workers;
+	}
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "output_comparator.h"
+
+namespace dvr {
+	/*
+	 * One line of a test manifest:
+	 * "<binary> <input>|- <expected>|- [time=<ms>] [compare=exact|trailing|whitespace]"
+	 * The input is fed to stdin, stdout is compared with the expected file.
+	 * - closes stdin right away or skips the comparison. Empty lines and
+	 * lines starting with # are skipped.
+	 */
+	struct TestJob {
+		// Line in the manifest
+		size_t line;
+		std::string binary;
+		std::string input;
+		std::string expected;
+		// Wall clock limit. 0 is unlimited
+		std::chrono::milliseconds time_limit;
+		OutputComparator::Normalization compare;
+	};
+
+	/*
+	 * Returns std::nullopt and sets error to the offending line if the manifest is invalid
+	 */
+	std::optional<std::vector<TestJob>> parseTestManifest(std::istream& stream, std::string& error);
+
+	struct TestResult {
+		enum class Outcome : uint8_t {
+			PASS,
+			// Wrong output or a non zero exit. A child is killed as soon as its output diverges
+			FAIL,
+			TIMEOUT,
+			// The job couldn't be started, e.g. a missing input file
+			ERROR
+		};
+
+		size_t line;
+		Outcome outcome;
+		// waitpid status, -1 if the child wasn't reaped
+		int status;
+		std::chrono::microseconds duration;
+		// First byte of stdout which differs from the expected output
+		std::optional<uint64_t> mismatch;
+	};
+
+	const char* outcomeName(TestResult::Outcome outcome);
+
+	/*
+	 * Runs the job in the calling thread and blocks until the child is reaped
+	 */
+	TestResult runTestJob(const TestJob& job);
+
+	/*
+	 * Runs jobs on a fixed number of worker threads, so at most that many
+	 * children exist at once. Every worker owns a deque of jobs and takes
+	 * from its front. An idle worker steals from the back of the others, so
+	 * slow jobs don't leave the remaining workers without work.
+	 */
+	class TestRunner {
+	public:
+		typedef std::function<void(const TestJob& job, const TestResult& result)> ResultHandler;
+	private:
+		const size_t workers;
+	public:
+		/*
+		 * 0 workers uses one per core
+		 */
+		TestRunner(size_t worker_count);
+
+		/*
+		 * Calls the handler for every finished job, one call at a time but from
+		 * the worker threads and not in manifest order. Returns once all jobs ran.
+		 */
+		void run(const std::vector<TestJob>& jobs, const ResultHandler& handler);
+
+		size_t workerCount() const;
+	};
+}
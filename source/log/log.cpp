@@ -0,0 +1,266 @@
+#include "log.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <ctime>
+#include <mutex>
+#include <thread>
+
+// Max size of a single write by the writer thread
+const size_t log_batch_size = 64 * 1024;
+
+namespace dvr {
+	namespace {
+		struct LogRecord {
+			std::atomic<LogRecord*> next;
+			LogLevel level;
+			std::chrono::system_clock::time_point time;
+			std::string message;
+		};
+
+		/*
+		 * Intrusive multi producer single consumer queue (Vyukov).
+		 * Producers only do a single exchange, the writer thread pops.
+		 */
+		class LogQueue {
+		private:
+			std::atomic<LogRecord*> head;
+			LogRecord* tail;
+			LogRecord stub;
+		public:
+			LogQueue():
+				head{&stub},
+				tail{&stub}
+			{
+				stub.next.store(nullptr, std::memory_order_relaxed);
+			}
+
+			void push(LogRecord* record){
+				record->next.store(nullptr, std::memory_order_relaxed);
+				LogRecord* prev = head.exchange(record, std::memory_order_acq_rel);
+				prev->next.store(record, std::memory_order_release);
+			}
+
+			/*
+			 * nullptr if empty or if a producer is in the middle of a push
+			 */
+			LogRecord* pop(){
+				LogRecord* current = tail;
+				LogRecord* next = current->next.load(std::memory_order_acquire);
+				if(current == &stub){
+					if(!next){
+						return nullptr;
+					}
+					tail = next;
+					current = next;
+					next = next->next.load(std::memory_order_acquire);
+				}
+				if(next){
+					tail = next;
+					return current;
+				}
+				if(current != head.load(std::memory_order_acquire)){
+					return nullptr;
+				}
+				push(&stub);
+				next = current->next.load(std::memory_order_acquire);
+				if(next){
+					tail = next;
+					return current;
+				}
+				return nullptr;
+			}
+		};
+
+		const char* levelName(LogLevel level){
+			switch(level){
+				case LogLevel::Debug: return "DEBUG";
+				case LogLevel::Info: return "INFO";
+				case LogLevel::Warning: return "WARNING";
+				case LogLevel::Error: return "ERROR";
+				default: return "";
+			}
+		}
+
+		void appendRecord(std::string& buffer, LogLevel level, std::chrono::system_clock::time_point time, const std::string& message){
+			std::time_t seconds = std::chrono::system_clock::to_time_t(time);
+			auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count() % 1000;
+			struct ::tm local;
+			::localtime_r(&seconds, &local);
+			char prefix[64];
+			size_t n = std::strftime(prefix, sizeof(prefix), "%Y-%m-%d %H:%M:%S", &local);
+			n += static_cast<size_t>(std::snprintf(prefix + n, sizeof(prefix) - n, ".%03d %s ", static_cast<int>(millis), levelName(level)));
+			buffer.append(prefix, n);
+			buffer.append(message);
+			buffer.push_back('\n');
+		}
+
+		void writeAll(int fd, const std::string& buffer){
+			size_t written = 0;
+			while(written < buffer.size()){
+				ssize_t n = ::write(fd, buffer.data() + written, buffer.size() - written);
+				if(n < 0){
+					if(errno == EINTR){
+						continue;
+					}
+					return;
+				}
+				written += static_cast<size_t>(n);
+			}
+		}
+
+		class Logger {
+		private:
+			LogQueue queue;
+			std::thread writer;
+			std::atomic<bool> running{false};
+
+			int fd = -1;
+			bool owns_fd = false;
+
+			// Only used to put the writer to sleep
+			std::mutex mutex;
+			std::condition_variable wakeup;
+			std::atomic<bool> sleeping{false};
+
+			void run(){
+				std::string batch;
+				batch.reserve(log_batch_size);
+				for(;;){
+					batch.clear();
+					while(batch.size() < log_batch_size){
+						LogRecord* record = queue.pop();
+						if(!record){
+							break;
+						}
+						appendRecord(batch, record->level, record->time, record->message);
+						delete record;
+					}
+					if(!batch.empty()){
+						writeAll(fd, batch);
+						continue;
+					}
+					if(!running.load(std::memory_order_acquire)){
+						break;
+					}
+					std::unique_lock<std::mutex> lock{mutex};
+					sleeping.store(true, std::memory_order_release);
+					// Lost wakeups only delay the batch until the timeout
+					wakeup.wait_for(lock, std::chrono::milliseconds{100});
+					sleeping.store(false, std::memory_order_release);
+				}
+			}
+		public:
+			std::atomic<LogLevel> level{LogLevel::Info};
+
+			~Logger(){
+				stop();
+			}
+
+			bool started() const {
+				return running.load(std::memory_order_acquire);
+			}
+
+			bool start(const std::string& destination){
+				stop();
+				if(destination == "stdout"){
+					fd = STDOUT_FILENO;
+					owns_fd = false;
+				}else if(destination == "stderr"){
+					fd = STDERR_FILENO;
+					owns_fd = false;
+				}else{
+					fd = ::open(destination.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+					if(fd < 0){
+						return false;
+					}
+					owns_fd = true;
+				}
+				running.store(true, std::memory_order_release);
+				writer = std::thread{&Logger::run, this};
+				return true;
+			}
+
+			void stop(){
+				if(!running.exchange(false, std::memory_order_acq_rel)){
+					return;
+				}
+				wakeup.notify_one();
+				writer.join();
+				if(owns_fd){
+					::close(fd);
+				}
+				fd = -1;
+			}
+
+			void push(LogLevel lvl, std::string&& message){
+				LogRecord* record = new LogRecord;
+				record->level = lvl;
+				record->time = std::chrono::system_clock::now();
+				record->message = std::move(message);
+				queue.push(record);
+				if(sleeping.load(std::memory_order_acquire)){
+					wakeup.notify_one();
+				}
+			}
+		};
+
+		Logger& logger(){
+			static Logger global_logger;
+			return global_logger;
+		}
+	}
+
+	LogLevel parseLogLevel(const std::string& level){
+		if(level == "debug"){
+			return LogLevel::Debug;
+		}else if(level == "warning"){
+			return LogLevel::Warning;
+		}else if(level == "error"){
+			return LogLevel::Error;
+		}else if(level == "off"){
+			return LogLevel::Off;
+		}
+		return LogLevel::Info;
+	}
+
+	bool logEnabled(LogLevel level){
+		return level >= logger().level.load(std::memory_order_relaxed);
+	}
+
+	std::ostringstream& logStream(){
+		static thread_local std::ostringstream stream;
+		stream.str(std::string{});
+		return stream;
+	}
+
+	void setLogLevel(LogLevel level){
+		logger().level.store(level, std::memory_order_relaxed);
+	}
+
+	void log(LogLevel level, std::string&& message){
+		Logger& instance = logger();
+		if(instance.started()){
+			instance.push(level, std::move(message));
+			return;
+		}
+		std::string buffer;
+		appendRecord(buffer, level, std::chrono::system_clock::now(), message);
+		writeAll(STDERR_FILENO, buffer);
+	}
+
+	bool startLogger(const std::string& destination, LogLevel level){
+		setLogLevel(level);
+		return logger().start(destination);
+	}
+
+	void stopLogger(){
+		logger().stop();
+	}
+}
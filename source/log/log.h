@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+/*
+ * Levels below DVR_LOG_LEVEL are compiled out (scons log_level=<n>).
+ * 0 Debug, 1 Info, 2 Warning, 3 Error
+ */
+#ifndef DVR_LOG_LEVEL
+#define DVR_LOG_LEVEL 1
+#endif
+
+/*
+ * Formats the message on the calling thread and queues it for the writer thread.
+ * DVR_LOG(Info, "Connection " << id << " registered");
+ */
+#define DVR_LOG(level, message) \
+	do { \
+		if constexpr(::dvr::logCompiled(::dvr::LogLevel::level)){ \
+			if(::dvr::logEnabled(::dvr::LogLevel::level)){ \
+				std::ostringstream& dvr_log_stream = ::dvr::logStream(); \
+				dvr_log_stream<<message; \
+				::dvr::log(::dvr::LogLevel::level, dvr_log_stream.str()); \
+			} \
+		} \
+	} while(0)
+
+namespace dvr {
+	enum class LogLevel : uint8_t {
+		Debug,
+		Info,
+		Warning,
+		Error,
+		Off
+	};
+
+	/*
+	 * "debug", "info", "warning", "error" or "off". Defaults to Info
+	 */
+	LogLevel parseLogLevel(const std::string& level);
+
+	/*
+	 * False for the levels below DVR_LOG_LEVEL
+	 */
+	constexpr bool logCompiled(LogLevel level){
+		return level >= static_cast<LogLevel>(DVR_LOG_LEVEL);
+	}
+
+	bool logEnabled(LogLevel level);
+	/*
+	 * Cleared stream of the calling thread. Constructing a stream per record costs more than the formatting.
+	 */
+	std::ostringstream& logStream();
+	void setLogLevel(LogLevel level);
+
+	/*
+	 * Queues the record in a lock free queue. Without a started logger the
+	 * record is written synchronously to stderr.
+	 */
+	void log(LogLevel level, std::string&& message);
+
+	/*
+	 * Starts the writer thread. Destination is "stdout", "stderr" or a file
+	 * path which is appended to. Returns false if the file can't be opened.
+	 */
+	bool startLogger(const std::string& destination, LogLevel level);
+	/*
+	 * Writes all queued records and stops the writer thread
+	 */
+	void stopLogger();
+}
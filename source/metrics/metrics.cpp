@@ -0,0 +1,318 @@
+#include "metrics.h"
+
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <sstream>
+
+namespace dvr {
+	namespace {
+		struct AtomicHistogram {
+			std::array<std::atomic<uint64_t>, histogram_buckets> buckets;
+			std::atomic<uint64_t> count;
+			std::atomic<uint64_t> sum;
+		};
+
+		struct Shard {
+			std::array<std::atomic<uint64_t>, counter_count> counters;
+			std::array<AtomicHistogram, histogram_count> histograms;
+
+			Shard(){
+				for(auto& counter : counters){
+					counter.store(0, std::memory_order_relaxed);
+				}
+				for(auto& histogram : histograms){
+					for(auto& bucket : histogram.buckets){
+						bucket.store(0, std::memory_order_relaxed);
+					}
+					histogram.count.store(0, std::memory_order_relaxed);
+					histogram.sum.store(0, std::memory_order_relaxed);
+				}
+			}
+
+			void addTo(MetricsSnapshot& snapshot) const {
+				for(size_t i = 0; i < counter_count; ++i){
+					snapshot.counters[i] += counters[i].load(std::memory_order_relaxed);
+				}
+				for(size_t i = 0; i < histogram_count; ++i){
+					HistogramData& data = snapshot.histograms[i];
+					for(size_t j = 0; j < histogram_buckets; ++j){
+						data.buckets[j] += histograms[i].buckets[j].load(std::memory_order_relaxed);
+					}
+					data.count += histograms[i].count.load(std::memory_order_relaxed);
+					data.sum += histograms[i].sum.load(std::memory_order_relaxed);
+				}
+			}
+		};
+
+		/*
+		 * Only the owning thread writes, so a relaxed load and store is
+		 * enough and avoids the locked read-modify-write of fetch_add
+		 */
+		inline void add(std::atomic<uint64_t>& value, uint64_t n){
+			value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+		}
+
+		inline size_t bucketOf(uint64_t value){
+			return value == 0 ? 0 : static_cast<size_t>(64 - __builtin_clzll(value));
+		}
+
+		/*
+		 * Keeps track of all live shards. Values of exited threads are kept
+		 * in retired so totals never go backwards.
+		 */
+		class ShardRegistry {
+		private:
+			std::mutex mutex;
+			std::vector<const Shard*> shards;
+			MetricsSnapshot retired;
+		public:
+			void attach(const Shard& shard){
+				std::lock_guard<std::mutex> lock{mutex};
+				shards.push_back(&shard);
+			}
+
+			void detach(const Shard& shard){
+				std::lock_guard<std::mutex> lock{mutex};
+				shard.addTo(retired);
+				for(auto iter = shards.begin(); iter != shards.end(); ++iter){
+					if(*iter == &shard){
+						shards.erase(iter);
+						break;
+					}
+				}
+			}
+
+			MetricsSnapshot collect(){
+				std::lock_guard<std::mutex> lock{mutex};
+				MetricsSnapshot snapshot = retired;
+				for(const Shard* shard : shards){
+					shard->addTo(snapshot);
+				}
+				return snapshot;
+			}
+		};
+
+		ShardRegistry& registry(){
+			static ShardRegistry shard_registry;
+			return shard_registry;
+		}
+
+		class LocalShard {
+		public:
+			Shard shard;
+
+			LocalShard(){
+				registry().attach(shard);
+			}
+
+			~LocalShard(){
+				registry().detach(shard);
+			}
+		};
+
+		Shard& localShard(){
+			static thread_local LocalShard local_shard;
+			return local_shard.shard;
+		}
+
+		void observeIndex(size_t index, uint64_t value){
+			AtomicHistogram& histogram = localShard().histograms[index];
+			add(histogram.buckets[bucketOf(value)], 1);
+			add(histogram.count, 1);
+			add(histogram.sum, value);
+		}
+
+		void writeVarint(std::vector<uint8_t>& buffer, uint64_t value){
+			while(value >= 0x80){
+				buffer.push_back(static_cast<uint8_t>(value | 0x80));
+				value >>= 7;
+			}
+			buffer.push_back(static_cast<uint8_t>(value));
+		}
+
+		bool readVarint(const std::vector<uint8_t>& buffer, size_t& offset, uint64_t& value){
+			value = 0;
+			for(uint8_t shift = 0; shift < 64 && offset < buffer.size(); shift += 7){
+				uint8_t byte = buffer[offset++];
+				value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+				if((byte & 0x80) == 0){
+					return true;
+				}
+			}
+			return false;
+		}
+
+		const uint8_t metrics_version = 1;
+	}
+
+	uint64_t HistogramData::quantile(double q) const {
+		if(count == 0){
+			return 0;
+		}
+		uint64_t target = static_cast<uint64_t>(std::ceil(q * static_cast<double>(count)));
+		uint64_t seen = 0;
+		for(size_t i = 0; i < histogram_buckets; ++i){
+			seen += buckets[i];
+			if(seen >= target && buckets[i] > 0){
+				if(i == 0){
+					return 0;
+				}
+				return i == 64 ? std::numeric_limits<uint64_t>::max() : (uint64_t{1} << i) - 1;
+			}
+		}
+		return std::numeric_limits<uint64_t>::max();
+	}
+
+	void increment(Counter counter, uint64_t n){
+		add(localShard().counters[static_cast<size_t>(counter)], n);
+	}
+
+	void observe(Histogram histogram, uint64_t value){
+		observeIndex(static_cast<size_t>(histogram), value);
+	}
+
+	void observeRequest(uint8_t type, uint64_t latency_ns){
+		if(type >= request_type_count){
+			return;
+		}
+		observeIndex(static_cast<size_t>(Histogram::COUNT) + type, latency_ns);
+	}
+
+	MetricsSnapshot collectMetrics(){
+		return registry().collect();
+	}
+
+	const char* counterName(size_t index){
+		static const char* names[counter_count] = {
+			"epoll_wakeups",
+			"epoll_events",
+			"connections_accepted",
+			"connections_broken",
+			"requests",
+			"bytes_relayed",
+			"spawns",
+			"spawn_failures",
+			"health_probes",
+			"health_probe_failures",
+			"health_probe_ns"
+		};
+		return index < counter_count ? names[index] : "unknown";
+	}
+
+	std::string histogramName(size_t index){
+		switch(index){
+			case static_cast<size_t>(Histogram::EVENTS_PER_WAKEUP):
+				return "events_per_wakeup";
+			case static_cast<size_t>(Histogram::SPAWN_LATENCY_NS):
+				return "spawn_latency_ns";
+			default:
+				return "request_latency_ns." + std::to_string(index - static_cast<size_t>(Histogram::COUNT));
+		}
+	}
+
+	std::string formatMetrics(const MetricsSnapshot& snapshot){
+		std::stringstream ss;
+		for(size_t i = 0; i < counter_count; ++i){
+			ss<<counterName(i)<<" "<<snapshot.counters[i]<<"\n";
+		}
+		for(size_t i = 0; i < histogram_count; ++i){
+			const HistogramData& data = snapshot.histograms[i];
+			if(data.count == 0){
+				continue;
+			}
+			ss<<histogramName(i)<<" count="<<data.count
+				<<" mean="<<(data.sum / data.count)
+				<<" p50<="<<data.quantile(0.5)
+				<<" p99<="<<data.quantile(0.99)
+				<<" max<="<<data.quantile(1.0)<<"\n";
+		}
+		return ss.str();
+	}
+
+	void serializeMetrics(std::vector<uint8_t>& buffer, const MetricsSnapshot& snapshot){
+		buffer.push_back(metrics_version);
+		writeVarint(buffer, counter_count);
+		for(uint64_t counter : snapshot.counters){
+			writeVarint(buffer, counter);
+		}
+		writeVarint(buffer, histogram_count);
+		for(const HistogramData& data : snapshot.histograms){
+			writeVarint(buffer, data.count);
+			writeVarint(buffer, data.sum);
+			size_t used = 0;
+			for(uint64_t bucket : data.buckets){
+				used += bucket > 0 ? 1 : 0;
+			}
+			writeVarint(buffer, used);
+			for(size_t i = 0; i < histogram_buckets; ++i){
+				if(data.buckets[i] > 0){
+					buffer.push_back(static_cast<uint8_t>(i));
+					writeVarint(buffer, data.buckets[i]);
+				}
+			}
+		}
+	}
+
+	bool deserializeMetrics(const std::vector<uint8_t>& buffer, MetricsSnapshot& snapshot){
+		if(buffer.empty() || buffer[0] != metrics_version){
+			return false;
+		}
+		size_t offset = 1;
+		uint64_t n;
+		if(!readVarint(buffer, offset, n) || n > counter_count){
+			return false;
+		}
+		for(size_t i = 0; i < n; ++i){
+			if(!readVarint(buffer, offset, snapshot.counters[i])){
+				return false;
+			}
+		}
+		if(!readVarint(buffer, offset, n) || n > histogram_count){
+			return false;
+		}
+		for(size_t i = 0; i < n; ++i){
+			HistogramData& data = snapshot.histograms[i];
+			uint64_t used;
+			if(!readVarint(buffer, offset, data.count) || !readVarint(buffer, offset, data.sum) || !readVarint(buffer, offset, used)){
+				return false;
+			}
+			for(uint64_t j = 0; j < used; ++j){
+				if(offset >= buffer.size() || buffer[offset] >= histogram_buckets){
+					return false;
+				}
+				uint8_t bucket = buffer[offset++];
+				if(!readVarint(buffer, offset, data.buckets[bucket])){
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	void mergeMetrics(MetricsSnapshot& total, const MetricsSnapshot& other){
+		for(size_t i = 0; i < counter_count; ++i){
+			total.counters[i] += other.counters[i];
+		}
+		for(size_t i = 0; i < histogram_count; ++i){
+			HistogramData& data = total.histograms[i];
+			const HistogramData& add = other.histograms[i];
+			data.count += add.count;
+			data.sum += add.sum;
+			for(size_t b = 0; b < histogram_buckets; ++b){
+				data.buckets[b] += add.buckets[b];
+			}
+		}
+	}
+
+	ScopedLatency::ScopedLatency(Histogram h):
+		histogram{h},
+		begin{std::chrono::steady_clock::now()}
+	{}
+
+	ScopedLatency::~ScopedLatency(){
+		auto duration = std::chrono::steady_clock::now() - begin;
+		observe(histogram, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()));
+	}
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace dvr {
+	enum class Counter : uint8_t {
+		EPOLL_WAKEUPS,
+		EPOLL_EVENTS,
+		CONNECTIONS_ACCEPTED,
+		CONNECTIONS_BROKEN,
+		REQUESTS,
+		BYTES_RELAYED,
+		SPAWNS,
+		SPAWN_FAILURES,
+		HEALTH_PROBES,
+		HEALTH_PROBE_FAILURES,
+		// Time spent in probe passes. Divided by HEALTH_PROBES it is the cost of one probe
+		HEALTH_PROBE_NS,
+		COUNT
+	};
+
+	enum class Histogram : uint8_t {
+		EVENTS_PER_WAKEUP,
+		SPAWN_LATENCY_NS,
+		COUNT
+	};
+
+	/*
+	 * Request latencies are kept per request type (Devoured::Mode)
+	 * behind the fixed histograms
+	 */
+	const size_t request_type_count = 16;
+	const size_t counter_count = static_cast<size_t>(Counter::COUNT);
+	const size_t histogram_count = static_cast<size_t>(Histogram::COUNT) + request_type_count;
+	// Bucket i holds values in [2^(i-1), 2^i). Bucket 0 holds 0
+	const size_t histogram_buckets = 65;
+
+	struct HistogramData {
+		std::array<uint64_t, histogram_buckets> buckets{};
+		uint64_t count = 0;
+		uint64_t sum = 0;
+
+		/*
+		 * Upper bound of the bucket containing the given quantile
+		 */
+		uint64_t quantile(double q) const;
+	};
+
+	struct MetricsSnapshot {
+		std::array<uint64_t, counter_count> counters{};
+		std::array<HistogramData, histogram_count> histograms{};
+	};
+
+	/*
+	 * Every thread writes into its own shard without locked instructions.
+	 * Shards are only summed up when the metrics are collected, so these
+	 * calls are cheap enough for the hot paths.
+	 */
+	void increment(Counter counter, uint64_t n = 1);
+	void observe(Histogram histogram, uint64_t value);
+	void observeRequest(uint8_t type, uint64_t latency_ns);
+
+	MetricsSnapshot collectMetrics();
+
+	const char* counterName(size_t index);
+	std::string histogramName(size_t index);
+
+	/*
+	 * One metric per line
+	 */
+	std::string formatMetrics(const MetricsSnapshot& snapshot);
+	/*
+	 * Compact form. All integers are LEB128 varints
+	 * version(=1)
+	 * counter count, counters...
+	 * histogram count, for each: count, sum, used buckets, (bucket index, value)...
+	 */
+	void serializeMetrics(std::vector<uint8_t>& buffer, const MetricsSnapshot& snapshot);
+	bool deserializeMetrics(const std::vector<uint8_t>& buffer, MetricsSnapshot& snapshot);
+
+	/*
+	 * Adds the counters and histogram buckets of other, e.g. of several daemons
+	 */
+	void mergeMetrics(MetricsSnapshot& total, const MetricsSnapshot& other);
+
+	/*
+	 * Measures the lifetime of the scope into a histogram
+	 */
+	class ScopedLatency {
+	private:
+		const Histogram histogram;
+		const std::chrono::steady_clock::time_point begin;
+	public:
+		ScopedLatency(Histogram h);
+		~ScopedLatency();
+	};
+}
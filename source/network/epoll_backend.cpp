@@ -0,0 +1,68 @@
+#include "poll_backend.h"
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+
+// Same as the max events of a dispatch
+const size_t epoll_max_events = 256;
+
+namespace dvr {
+	class EpollBackend final : public PollBackend {
+	private:
+		int epoll_fd;
+
+		::epoll_event events[epoll_max_events];
+	public:
+		EpollBackend(int fd):
+			epoll_fd{fd}
+		{}
+
+		~EpollBackend(){
+			::close(epoll_fd);
+		}
+
+		int wait(PollEvent* ready, size_t max_events, int timeout_ms) override {
+			int nfds = ::epoll_wait(epoll_fd, events, static_cast<int>(std::min(max_events, epoll_max_events)), timeout_ms);
+			if(nfds < 0){
+				return -errno;
+			}
+			for(int n = 0; n < nfds; ++n){
+				ready[n].fd = static_cast<int>(events[n].data.u64 & 0xFFFFFFFF);
+				ready[n].mask = events[n].events;
+				ready[n].generation = static_cast<uint32_t>(events[n].data.u64 >> 32);
+			}
+			return nfds;
+		}
+
+		bool add(int fd, uint32_t mask, uint32_t generation) override {
+			::epoll_event event;
+			event.events = mask;
+			event.data.u64 = (static_cast<uint64_t>(generation) << 32) | static_cast<uint32_t>(fd);
+			return ::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0;
+		}
+
+		void remove(int fd) override {
+			::epoll_event event;
+			event.events = 0;
+			event.data.u64 = 0;
+			// Closing a fd already removes it from the epoll set, so a failing
+			// delete is not fatal
+			::epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, &event);
+		}
+
+		const char* name() const override {
+			return "epoll";
+		}
+	};
+
+	std::unique_ptr<PollBackend> createEpollBackend(){
+		int fd = ::epoll_create1(EPOLL_CLOEXEC);
+		if(fd < 0){
+			return nullptr;
+		}
+		return std::make_unique<EpollBackend>(fd);
+	}
+}
@@ -2,6 +2,7 @@
 
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <sys/stat.h>
 #include <sys/epoll.h>
@@ -12,10 +13,15 @@
 #include <cstring>
 
 #include <cassert>
-#include <iostream>
+
+#include "poll_backend.h"
+#include "log/log.h"
+#include "metrics/metrics.h"
+#include "trace/trace.h"
 
 const size_t read_buffer_size = 4096;
-const size_t write_buffer_size = 4096;
+// Buffers gathered into one send, well below IOV_MAX
+const size_t max_write_iovecs = 64;
 
 namespace dvr {
 	IFdObserver::IFdObserver(EventPoll& p, int file_d, uint32_t msk):
@@ -42,44 +48,66 @@ namespace dvr {
 
 	class EventPoll::Impl {
 	private:
-		std::map<int, IFdObserver*> observers;
+		struct Subscription {
+			IFdObserver* observer;
+			uint32_t generation;
+		};
+
+		std::map<int, Subscription> observers;
+		// Of the last subscription. Events of an earlier subscription of a reused fd are dropped
+		uint32_t generation;
 
-		int epoll_fd;
+		std::unique_ptr<PollBackend> backend;
 		bool broken;
 
-		::epoll_event events[max_events];
+		PollEvent events[max_events];
 	public:
 		Impl():
+			generation{0},
 			broken{false}
 		{
-			epoll_fd = epoll_create1(0);
-			if(epoll_fd < 0){
-				broken = true;
+			// DVR_POLL_BACKEND=epoll skips io_uring. Older kernels fall back to epoll
+			const char* selected = ::getenv("DVR_POLL_BACKEND");
+			if(!selected || std::strcmp(selected, "epoll") != 0){
+				backend = createUringBackend();
 			}
-		}
-
-		~Impl(){
-			if(epoll_fd > 0){
-				close(epoll_fd);
+			if(!backend){
+				backend = createEpollBackend();
+			}
+			if(!backend){
+				broken = true;
 			}
 		}
 
-		bool poll(){
+		bool poll(int timeout_ms){
 			if(broken){
 				return true;
 			}
-			int nfds = ::epoll_wait(epoll_fd, events, max_events, -1);
+			DVR_TRACE(POLL_BEGIN, 0, timeout_ms, 0);
+			int nfds = backend->wait(events, max_events, timeout_ms);
+			DVR_TRACE(POLL_END, 0, nfds, 0);
 			if(nfds < 0){
+				// Signals like SIGCHLD interrupt the wait. This is not an error
+				if(nfds == -EINTR){
+					return false;
+				}
 				return broken = true;
 			}
+			increment(Counter::EPOLL_WAKEUPS);
+			increment(Counter::EPOLL_EVENTS, static_cast<uint64_t>(nfds));
+			observe(Histogram::EVENTS_PER_WAKEUP, static_cast<uint64_t>(nfds));
 
 			for(int n = 0; n < nfds; ++n){
-				int fd_event = events[n].data.fd;
+				int fd_event = events[n].fd;
 				auto finder = observers.find(fd_event);
-				if(finder == observers.end()){
-					return broken = true;
+				if(finder == observers.end() || finder->second.generation != events[n].generation){
+					// Unsubscribed by an observer notified earlier in this batch, maybe
+					// closed and reused by a new subscription since
+					continue;
 				}
-				finder->second->notify(events[n].events);
+				DVR_TRACE(FD_NOTIFY_BEGIN, fd_event, events[n].mask, 0);
+				finder->second.observer->notify(events[n].mask);
+				DVR_TRACE(FD_NOTIFY_END, fd_event, 0, 0);
 			}
 
 			return broken;
@@ -89,16 +117,15 @@ namespace dvr {
 			if(!broken){
 				int fd = obsv.fd();
 				assert(fd >= 0);
-				::epoll_event event;
-				event.events = obsv.mask();
-				event.data.fd = fd;
-				
-				if(::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event)){
+				if(++generation == 0){
+					++generation;
+				}
+				if(!backend->add(fd, obsv.mask(), generation)){
 					broken = true;
 					return;
 				}
 
-				observers.insert(std::make_pair(fd, &obsv));
+				observers.insert(std::make_pair(fd, Subscription{&obsv, generation}));
 			}
 		}
 
@@ -106,18 +133,15 @@ namespace dvr {
 			if(!broken){
 				int fd = obsv.fd();
 				assert(fd >= 0);
-				::epoll_event event;
-				event.events = obsv.mask();
-				event.data.fd = fd;
-
-				if(::epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, &event)){
-					broken = true;
-					return;
-				}
+				backend->remove(fd);
 
 				observers.erase(fd);
 			}
 		}
+
+		const char* backendName() const {
+			return backend ? backend->name() : "none";
+		}
 	};
 
 	EventPoll::EventPoll():
@@ -126,8 +150,12 @@ namespace dvr {
 	}
 	EventPoll::~EventPoll(){}
 
-	bool EventPoll::poll(){
-		return impl->poll();
+	bool EventPoll::poll(int timeout_ms){
+		return impl->poll(timeout_ms);
+	}
+
+	const char* EventPoll::backend() const {
+		return impl->backendName();
 	}
 
 	void EventPoll::subscribe(IFdObserver& obv){
@@ -148,7 +176,7 @@ namespace dvr {
 		//TODO Missing errno check in every state
 
 		if(file_descriptor < 0){
-			std::cerr<<"Couldn't create socket: "<<(::strerror(errno))<<std::endl;
+			DVR_LOG(Error, "Couldn't create socket: "<<(::strerror(errno)));
 			return nullptr;
 		}
 
@@ -166,7 +194,7 @@ namespace dvr {
 
 		status = ::bind(file_descriptor, (struct ::sockaddr*)&local, sizeof(local));
 		if( status != 0){
-			std::cerr<<"Couldn't bind socket: "<<local.sun_path<<std::endl;
+			DVR_LOG(Error, "Couldn't bind socket: "<<local.sun_path);
 			return nullptr;
 		}
 
@@ -179,7 +207,7 @@ namespace dvr {
 		int file_descriptor = ::socket( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
 
 		if(file_descriptor < 0){
-			std::cerr<<"Couldn't create socket: "<<(::strerror(errno))<<std::endl;
+			DVR_LOG(Error, "Couldn't create socket: "<<(::strerror(errno)));
 			return nullptr;
 		}
 
@@ -193,7 +221,7 @@ namespace dvr {
 
 		status = ::connect(file_descriptor, (struct ::sockaddr*)&local, sizeof(local));
 		if( status != 0){
-			std::cerr<<"Couldn't connect to socket at "<<local.sun_path<<" : "<<(::strerror(errno))<<std::endl;
+			DVR_LOG(Error, "Couldn't connect to socket at "<<local.sun_path<<" : "<<(::strerror(errno)));
 			return nullptr;
 		}
 
@@ -202,8 +230,12 @@ namespace dvr {
 
 	static ConnectionId next_connection_id = 0;
 
+	/*
+	 * Edge triggered, because reads and writes are always done until EAGAIN.
+	 * Level triggered EPOLLOUT would wake up the poll on every call.
+	 */
 	Connection::Connection(EventPoll& p, int fd, IConnectionStateObserver& obsrv):
-		IFdObserver(p, fd, EPOLLIN | EPOLLOUT),
+		IFdObserver(p, fd, EPOLLIN | EPOLLOUT | EPOLLET),
 		poll{p},
 		connection_id{++next_connection_id},
 		observer{obsrv},
@@ -219,6 +251,7 @@ namespace dvr {
 
 	Connection::~Connection(){
 		close();
+		::close(file_desc);
 	}
 
 	void Connection::close(){
@@ -228,6 +261,7 @@ namespace dvr {
 		is_broken = true;
 		read_ready = false;
 		write_ready = false;
+		increment(Counter::CONNECTIONS_BROKEN);
 		observer.notify(*this, ConnectionState::Broken);
 	}
 
@@ -239,38 +273,68 @@ namespace dvr {
 		if(broken()){
 			return;
 		}
+		DVR_TRACE(CONNECTION_NOTIFY_BEGIN, connection_id, mask, 0);
 		if( mask & EPOLLOUT ){
 			write_ready = true;
 			onReadyWrite();
 			observer.notify(*this, ConnectionState::WriteReady);
 		}
-		if( mask & EPOLLIN ){
+		// A failed write closes the connection, reading would mark it ready again
+		if( (mask & EPOLLIN) && !broken() ){
 			read_ready = true;
 			onReadyRead();
 			observer.notify(*this, ConnectionState::ReadReady);
 		}
+		DVR_TRACE(CONNECTION_NOTIFY_END, connection_id, 0, 0);
 	}
 
 	void Connection::write(std::vector<uint8_t>&& buffer){
-		if(write_buffer.empty()){
-			write_buffer = std::move(buffer);
-		}else /*if (write_buffer.size() + buffer.size() <= write_buffer_size)*/{
-			write_buffer.insert(std::end(write_buffer), std::begin(buffer),std::end(buffer));
-		}/*else{
+		write(std::make_shared<const std::vector<uint8_t>>(std::move(buffer)));
+	}
 
-		}*/
+	void Connection::write(SharedBuffer buffer){
+		if(!buffer || buffer->empty()){
+			return;
+		}
+		write_queue.push_back(std::move(buffer));
+		if(write_ready){
+			onReadyWrite();
+		}
+	}
+
+	void Connection::write(const std::vector<SharedBuffer>& buffers){
+		for(const SharedBuffer& buffer : buffers){
+			if(buffer && !buffer->empty()){
+				write_queue.push_back(buffer);
+			}
+		}
 		if(write_ready){
 			onReadyWrite();
 		}
 	}
 
 	bool Connection::hasWriteQueued() const {
-		return !write_buffer.empty();
+		return !write_queue.empty();
 	}
 
+	/*
+	 * Gathers the queued buffers into one sendmsg. A buffer is released as
+	 * soon as it is sent, other connections may still hold it.
+	 */
 	void Connection::onReadyWrite(){
-		while(write_ready && write_buffer.size() > 0){
-			ssize_t n = ::send(file_desc, write_buffer.data(), write_buffer.size(), MSG_NOSIGNAL);
+		::iovec iov[max_write_iovecs];
+		while(write_ready && !write_queue.empty()){
+			size_t count = 0;
+			for(auto it = write_queue.begin(); it != write_queue.end() && count < max_write_iovecs; ++it, ++count){
+				const std::vector<uint8_t>& buffer = **it;
+				const size_t offset = count == 0 ? already_written : 0;
+				iov[count].iov_base = const_cast<uint8_t*>(buffer.data() + offset);
+				iov[count].iov_len = buffer.size() - offset;
+			}
+			::msghdr msg{};
+			msg.msg_iov = iov;
+			msg.msg_iovlen = count;
+			ssize_t n = ::sendmsg(file_desc, &msg, MSG_NOSIGNAL);
 			if(n<0){
 				if(errno != EAGAIN){
 					close();
@@ -283,14 +347,17 @@ namespace dvr {
 				return;
 			}
 
-			already_written += n;
-			
-			size_t remaining = write_buffer.size() - already_written;
-			for(size_t i = 0; i < remaining; ++i){
-				write_buffer[i] = write_buffer[already_written+i];
+			size_t sent = static_cast<size_t>(n);
+			while(sent > 0){
+				const size_t remaining = write_queue.front()->size() - already_written;
+				if(sent < remaining){
+					already_written += sent;
+					break;
+				}
+				sent -= remaining;
+				write_queue.pop_front();
+				already_written = 0;
 			}
-			write_buffer.resize(remaining);
-			remaining = 0;
 		}
 	}
 
@@ -301,6 +368,10 @@ namespace dvr {
 		do {
 			// Not yet read into the buffer
 			size_t remaining = read_buffer.size() - already_read;
+			if(remaining == 0){
+				// Buffer is full. Keep read_ready so the rest is read after consumption
+				return;
+			}
 			ssize_t n = ::recv(file_desc, &read_buffer[already_read], remaining, 0);
 			
 			if(n < 0){
@@ -332,11 +403,9 @@ namespace dvr {
 	}
 
 	void Connection::consumeRead(size_t n){
-		size_t remaining = n < read_buffer.size()?(read_buffer.size()-n):(0);
-		for(size_t i = 0; i < remaining; ++i){
-			read_buffer[i] = read_buffer[i+n];
-		}
 		assert(already_read>=n);
+		// Only the unconsumed part has to move. Pipelined messages are consumed one by one
+		std::memmove(read_buffer.data(), read_buffer.data() + n, already_read - n);
 		already_read -= n;
 	}
 
@@ -363,6 +432,7 @@ namespace dvr {
 
 	Server::~Server(){
 		::unlink(address.c_str());
+		::close(file_desc);
 	}
 
 	void Server::notify(uint32_t mask){
@@ -382,6 +452,7 @@ namespace dvr {
 			//int error = errno;
 			return nullptr;
 		}
+		increment(Counter::CONNECTIONS_ACCEPTED);
 
 		return std::make_unique<Connection>(event_poll, accepted_fd, obsrv);
 	}
@@ -393,8 +464,12 @@ namespace dvr {
 	Network::Network(){
 	}
 
-	void Network::poll(){
-		ev_poll.poll();
+	void Network::poll(int timeout_ms){
+		ev_poll.poll(timeout_ms);
+	}
+
+	EventPoll& Network::eventPoll(){
+		return ev_poll;
 	}
 
 	std::unique_ptr<Server> Network::listen(const std::string& address, IServerStateObserver& obsrv){
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <deque>
 #include <memory>
+#include <string>
 #include <vector>
 #include <map>
 #include <set>
@@ -21,7 +23,16 @@ namespace dvr {
 		EventPoll();
 		~EventPoll();
 
-		bool poll();
+		/*
+		 * Waits at most timeout_ms milliseconds for events and dispatches them.
+		 * A negative value blocks until an event or a signal arrives.
+		 */
+		bool poll(int timeout_ms = -1);
+
+		/*
+		 * "io_uring" or "epoll". Chosen at runtime, see poll_backend.h
+		 */
+		const char* backend() const;
 
 		void subscribe(IFdObserver& obsv);
 		void unsubscribe(IFdObserver& obsv);
@@ -58,6 +69,12 @@ namespace dvr {
 		virtual void notify(Connection& c, ConnectionState mask) = 0;
 	};
 
+	/*
+	 * Immutable buffer which can be queued on many connections at once.
+	 * It is freed after the last connection has sent it.
+	 */
+	typedef std::shared_ptr<const std::vector<uint8_t>> SharedBuffer;
+
 	typedef uint64_t ConnectionId;
 	class Connection : public IFdObserver {
 	private:
@@ -71,8 +88,9 @@ namespace dvr {
 		// non blocking helpers
 		// write buffering
 		bool write_ready;
+		// Offset into the front buffer
 		size_t already_written;
-		std::vector<uint8_t> write_buffer;
+		std::deque<SharedBuffer> write_queue;
 
 		// read buffering 
 		bool read_ready;
@@ -91,6 +109,14 @@ namespace dvr {
 		 * move buffer to the writeQueue
 		 */
 		void write(std::vector<uint8_t>&& buffer);
+		/*
+		 * queue a shared buffer by reference
+		 */
+		void write(SharedBuffer buffer);
+		/*
+		 * queue several shared buffers, they leave in as few sends as possible
+		 */
+		void write(const std::vector<SharedBuffer>& buffers);
 		bool hasWriteQueued() const;
 		
 		/* 
@@ -158,7 +184,9 @@ namespace dvr {
 	public:
 		Network();
 
-		void poll();
+		void poll(int timeout_ms = -1);
+
+		EventPoll& eventPoll();
 
 		std::unique_ptr<Server> listen(const std::string& address, IServerStateObserver& obsrv);
 		std::unique_ptr<Connection> connect(const std::string& address, IConnectionStateObserver& obsrv);
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+namespace dvr {
+	struct PollEvent {
+		int fd;
+		// EPOLLIN, EPOLLOUT, ... for every backend
+		uint32_t mask;
+		// Of the subscription that reported the event. The fd may be closed
+		// and reused by a new subscription while the batch is dispatched
+		uint32_t generation;
+	};
+
+	/*
+	 * Readiness source behind EventPoll::Impl. The Impl keeps the observers
+	 * and dispatches, a backend only reports which fds are ready.
+	 * Masks use the epoll flags. EPOLLET selects edge triggered notification.
+	 */
+	class PollBackend {
+	public:
+		virtual ~PollBackend() = default;
+
+		/*
+		 * Fills at most max_events events. Returns their number, 0 on timeout,
+		 * -EINTR if a signal interrupted the wait or another negative errno.
+		 */
+		virtual int wait(PollEvent* events, size_t max_events, int timeout_ms) = 0;
+
+		/*
+		 * Events of the subscription carry the generation, which is never 0
+		 */
+		virtual bool add(int fd, uint32_t mask, uint32_t generation) = 0;
+		/*
+		 * The fd may already be closed
+		 */
+		virtual void remove(int fd) = 0;
+
+		virtual const char* name() const = 0;
+	};
+
+	std::unique_ptr<PollBackend> createEpollBackend();
+	/*
+	 * nullptr if the kernel doesn't support the needed io_uring features
+	 */
+	std::unique_ptr<PollBackend> createUringBackend();
+}
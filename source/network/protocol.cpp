@@ -1,6 +1,8 @@
 #include "protocol.h"
 
 #include "network.h"
+#include "log/log.h"
+#include "trace/trace.h"
 
 #include <iostream>
 
@@ -38,6 +40,10 @@ namespace dvr {
 		content{content_p}
 	{}
 
+	size_t maxResponseContentSize(){
+		return max_response_content_size - 1;
+	}
+
 	std::ostream& operator<<(std::ostream& stream, const MessageRequest& request){
 		stream<<"Request ID: "<<std::to_string(request.request_id)<<"\n";
 		stream<<"Type: "<<std::to_string(request.type)<<"\n";
@@ -114,16 +120,16 @@ namespace dvr {
 			return std::nullopt;
 		}
 		connection.consumeRead(shift);
+		DVR_TRACE(READ_REQUEST, connection.id(), msg.request_id, shift);
 		return msg;
 	}
 
-	bool asyncWriteRequest(Connection& connection, const MessageRequest& request){
+	bool serializeMessageRequest(std::vector<uint8_t>& buffer, const MessageRequest& request){
 		const size_t ct_size = request.content.size();
 		const size_t tg_size = request.target.size();
 		const size_t msg_size = ct_size + tg_size + request_static_size;
 
 		if( msg_size < max_message_size && ct_size < max_request_content_size && tg_size < max_target_size ){
-			std::vector<uint8_t> buffer;
 			buffer.resize(message_length_size+msg_size);
 
 			size_t shift = serialize(&buffer[0], msg_size);
@@ -131,16 +137,70 @@ namespace dvr {
 			buffer[shift++] = request.type;
 			shift += serialize(&buffer[shift], request.target);
 			shift += serialize(&buffer[shift], request.content);
-
-			std::cout<<request<<std::endl<<"Length: "<<ct_size<<" "<<tg_size<<" "<<msg_size<<std::endl;
-
-			connection.write(std::move(buffer));
 			return true;
 		}else{
 			return false;
 		}
 	}
 
+	/*
+	 * Checks the length prefix and the field sizes of the frame at the front of buffer.
+	 * Returns the frame size or 0 if the frame is incomplete or invalid.
+	 */
+	size_t checkFrame(std::vector<uint8_t>& buffer, size_t max_content_size){
+		if(buffer.size() < message_length_size){
+			return 0;
+		}
+		uint16_t msg_size;
+		deserialize(buffer.data(), msg_size);
+		const size_t frame_size = message_length_size + msg_size;
+		if(msg_size >= max_message_size || buffer.size() < frame_size){
+			return 0;
+		}
+		// request id and type or return code
+		size_t shift = message_length_size + 3;
+		const size_t max_sizes[] = {max_target_size, max_content_size};
+		for(size_t max_size : max_sizes){
+			if(shift + 2 > frame_size){
+				return 0;
+			}
+			uint16_t field_size;
+			deserialize(&buffer[shift], field_size);
+			if(field_size >= max_size){
+				return 0;
+			}
+			shift += 2 + field_size;
+		}
+		return shift == frame_size ? frame_size : 0;
+	}
+
+	bool deserializeMessageRequest(std::vector<uint8_t>& buffer, MessageRequest& request){
+		const size_t frame_size = checkFrame(buffer, max_request_content_size);
+		if(frame_size == 0){
+			return false;
+		}
+		size_t shift = message_length_size;
+		shift += deserialize(&buffer[shift], request.request_id);
+		request.type = buffer[shift++];
+		shift += deserialize(&buffer[shift], request.target);
+		deserialize(&buffer[shift], request.content);
+		buffer.erase(buffer.begin(), buffer.begin() + frame_size);
+		return true;
+	}
+
+	bool asyncWriteRequest(Connection& connection, const MessageRequest& request){
+		std::vector<uint8_t> buffer;
+		if(!serializeMessageRequest(buffer, request)){
+			return false;
+		}
+
+		DVR_LOG(Debug, "Request "<<request.request_id<<" type "<<std::to_string(request.type)<<" target "<<request.target<<" length "<<buffer.size());
+
+		DVR_TRACE(WRITE_REQUEST, connection.id(), request.request_id, buffer.size());
+		connection.write(std::move(buffer));
+		return true;
+	}
+
 	std::optional<MessageResponse> asyncReadResponse(Connection& connection){
 		auto opt_buffer = connection.read(message_length_size);
 		if(!opt_buffer.has_value()){
@@ -171,15 +231,29 @@ namespace dvr {
 			return std::nullopt;
 		}
 		connection.consumeRead(shift);
+		DVR_TRACE(READ_RESPONSE, connection.id(), msg.request_id, shift);
 		return msg;
 	}
 
-	bool asyncWriteResponse(Connection& connection, const MessageResponse& request){
+	bool deserializeMessageResponse(std::vector<uint8_t>& buffer, MessageResponse& response){
+		const size_t frame_size = checkFrame(buffer, max_response_content_size);
+		if(frame_size == 0){
+			return false;
+		}
+		size_t shift = message_length_size;
+		shift += deserialize(&buffer[shift], response.request_id);
+		response.return_code = buffer[shift++];
+		shift += deserialize(&buffer[shift], response.target);
+		deserialize(&buffer[shift], response.content);
+		buffer.erase(buffer.begin(), buffer.begin() + frame_size);
+		return true;
+	}
+
+	bool serializeMessageResponse(std::vector<uint8_t>& buffer, const MessageResponse& request){
 		const size_t ct_size = request.content.size();
 		const size_t tg_size = request.target.size();
-		const size_t msg_size = ct_size + tg_size + request_static_size;
-		if( msg_size < max_message_size && ct_size < max_request_content_size && tg_size < max_target_size ){
-			std::vector<uint8_t> buffer;
+		const size_t msg_size = ct_size + tg_size + response_static_size;
+		if( msg_size < max_message_size && ct_size < max_response_content_size && tg_size < max_target_size ){
 			buffer.resize(message_length_size+msg_size);
 
 			size_t shift = serialize(&buffer[0], msg_size);
@@ -187,11 +261,38 @@ namespace dvr {
 			buffer[shift++] = request.return_code;
 			shift += serialize(&buffer[shift], request.target);
 			shift += serialize(&buffer[shift], request.content);
+			return true;
+		}else{
+			return false;
+		}
+	}
 
-			connection.write(std::move(buffer));
+	bool serializeResponseHeader(std::vector<uint8_t>& buffer, uint16_t request_id, uint8_t return_code, const std::string& target, size_t content_size){
+		const size_t tg_size = target.size();
+		const size_t msg_size = content_size + tg_size + response_static_size;
+		if( msg_size < max_message_size && content_size < max_response_content_size && tg_size < max_target_size ){
+			// Everything but the content bytes
+			buffer.resize(message_length_size+msg_size-content_size);
+
+			size_t shift = serialize(&buffer[0], static_cast<uint16_t>(msg_size));
+			shift += serialize(&buffer[shift], request_id);
+			buffer[shift++] = return_code;
+			shift += serialize(&buffer[shift], target);
+			serialize(&buffer[shift], static_cast<uint16_t>(content_size));
 			return true;
 		}else{
 			return false;
 		}
 	}
+
+	bool asyncWriteResponse(Connection& connection, const MessageResponse& request){
+		std::vector<uint8_t> buffer;
+		if(!serializeMessageResponse(buffer, request)){
+			return false;
+		}
+
+		DVR_TRACE(WRITE_RESPONSE, connection.id(), request.request_id, buffer.size());
+		connection.write(std::move(buffer));
+		return true;
+	}
 }
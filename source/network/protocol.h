@@ -27,8 +27,17 @@ namespace dvr {
 	 */
 	enum class ReturnCode: uint8_t{
 		OK,
-		NOSERVICE
+		NOSERVICE,
+		FAILED,
+		// The content is continued in the next response with the same request id
+		PARTIAL
 	};
+	/*
+	 * Request id of responses pushed without a request, e.g. subscription
+	 * events. Clients don't use it for their requests.
+	 */
+	const uint16_t event_request_id = 0xFFFF;
+
 	class MessageResponse {
 	public:
 		MessageResponse() = default;
@@ -39,14 +48,29 @@ namespace dvr {
 		std::string content;
 	};
 
+	/*
+	 * Largest content which fits into a single response. Longer content
+	 * has to be split up into multiple responses.
+	 */
+	size_t maxResponseContentSize();
+
 	std::ostream& operator<<(std::ostream& stream, const MessageRequest& request);
 	std::ostream& operator<<(std::ostream& stream, const MessageResponse& response);
 
-	bool serializeMessageRequest(std::vector<uint8_t>& buffer, MessageRequest& request);
+	/*
+	 * The deserialize functions parse the frame at the front of buffer and
+	 * erase it on success. They return false if the frame is incomplete or invalid.
+	 */
+	bool serializeMessageRequest(std::vector<uint8_t>& buffer, const MessageRequest& request);
 	bool deserializeMessageRequest(std::vector<uint8_t>& buffer, MessageRequest& request);
 
-	bool serializeMessageResponse(std::vector<uint8_t>& buffer, MessageResponse& response);
+	bool serializeMessageResponse(std::vector<uint8_t>& buffer, const MessageResponse& response);
 	bool deserializeMessageResponse(std::vector<uint8_t>& buffer, MessageResponse& response);
+	/*
+	 * Serializes a response without its content bytes. The content can follow
+	 * from another buffer, so one content buffer serves many headers.
+	 */
+	bool serializeResponseHeader(std::vector<uint8_t>& buffer, uint16_t request_id, uint8_t return_code, const std::string& target, size_t content_size);
 	
 	std::optional<MessageRequest> asyncReadRequest(Connection& connection);
 	bool asyncWriteRequest(Connection& connection, const MessageRequest& request);
@@ -0,0 +1,340 @@
+#include "poll_backend.h"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+
+// Multishot polls need headers of Linux 5.13 or newer
+#ifdef IORING_POLL_ADD_MULTI
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <vector>
+
+// Submission queue size. A full queue is submitted early
+const unsigned uring_entries = 256;
+// User data of POLL_REMOVE requests. Poll user data always has a generation > 0
+const uint64_t uring_remove_data = 0;
+
+namespace dvr {
+	/*
+	 * Readiness through IORING_OP_POLL_ADD. Adding and removing fds only
+	 * queues submissions. They are submitted together with the next wait in
+	 * a single io_uring_enter, where epoll needs one epoll_ctl each.
+	 *
+	 * Edge triggered fds get a multishot poll. POLL_ADD doesn't accept level
+	 * triggered multishot polls, so level triggered fds get a oneshot poll
+	 * which is armed again after every completion. The new poll is submitted
+	 * with the next wait, after the observer has been notified, and completes
+	 * immediately if the fd is still ready.
+	 */
+	class UringBackend final : public PollBackend {
+	private:
+		struct Subscription {
+			uint64_t user_data;
+			uint32_t mask;
+		};
+
+		int ring_fd;
+
+		void* ring;
+		size_t ring_size;
+		::io_uring_sqe* sqes;
+		size_t sqes_size;
+
+		unsigned* sq_head;
+		unsigned* sq_tail;
+		unsigned sq_mask;
+		unsigned sq_entries;
+		unsigned* sq_array;
+		// Local tail, published before entering the kernel
+		unsigned sq_local_tail;
+
+		unsigned* cq_head;
+		unsigned* cq_tail;
+		unsigned cq_mask;
+		::io_uring_cqe* cqes;
+
+		/*
+		 * Key - fd
+		 * Value - the armed poll. The upper half of the user data is the generation,
+		 * so completions of a removed poll are ignored after the fd is reused
+		 */
+		std::map<int, Subscription> polls;
+		// Completions taken off the ring so a full submission queue could be submitted, handled by the next wait
+		std::vector<::io_uring_cqe> reaped;
+
+		int enter(unsigned to_submit, unsigned min_complete, unsigned flags, void* arg, size_t arg_size){
+			return static_cast<int>(::syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, arg, arg_size));
+		}
+
+		unsigned pendingSubmissions() const {
+			return sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+		}
+
+		void reap(){
+			unsigned head = *cq_head;
+			const unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+			for(; head != tail; ++head){
+				reaped.push_back(cqes[head & cq_mask]);
+			}
+			__atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+		}
+
+		/*
+		 * Submits until a slot is free. The kernel refuses submissions with
+		 * EBUSY while completions overflow the ring, so they are reaped first.
+		 */
+		void submitFull(){
+			__atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+			while(pendingSubmissions() >= sq_entries){
+				if(enter(pendingSubmissions(), 0, 0, nullptr, 0) < 0 && errno != EINTR){
+					reap();
+				}
+			}
+		}
+
+		::io_uring_sqe* nextSqe(){
+			// The slot of an unsubmitted entry is never handed out again
+			if(pendingSubmissions() >= sq_entries){
+				submitFull();
+			}
+			unsigned index = sq_local_tail & sq_mask;
+			::io_uring_sqe* sqe = &sqes[index];
+			std::memset(sqe, 0, sizeof(*sqe));
+			sq_array[index] = index;
+			++sq_local_tail;
+			return sqe;
+		}
+
+		void arm(int fd, const Subscription& sub){
+			::io_uring_sqe* sqe = nextSqe();
+			sqe->opcode = IORING_OP_POLL_ADD;
+			sqe->fd = fd;
+			sqe->poll32_events = sub.mask & ~static_cast<uint32_t>(EPOLLET);
+			if(sub.mask & EPOLLET){
+				sqe->len = IORING_POLL_ADD_MULTI;
+			}
+			sqe->user_data = sub.user_data;
+		}
+
+		bool completionsQueued() const {
+			return !reaped.empty() || *cq_head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+		}
+
+		/*
+		 * Returns false if the completion isn't an event for the observers
+		 */
+		bool handle(const ::io_uring_cqe& cqe, PollEvent& event){
+			// Removed polls complete with ECANCELED, possibly after the fd was
+			// added again with the same generation, e.g. after the self test
+			if(cqe.user_data == uring_remove_data || cqe.res == -ECANCELED){
+				return false;
+			}
+			const int fd = static_cast<int>(cqe.user_data & 0xFFFFFFFF);
+			auto find = polls.find(fd);
+			if(find == polls.end() || find->second.user_data != cqe.user_data){
+				return false;
+			}
+			event.fd = fd;
+			event.generation = static_cast<uint32_t>(cqe.user_data >> 32);
+			if(cqe.res < 0){
+				// E.g. an unsupported poll. The observer has to handle it, arming again would spin
+				event.mask = EPOLLERR;
+				return true;
+			}
+			event.mask = static_cast<uint32_t>(cqe.res);
+			// A oneshot poll or a multishot poll the kernel ended, e.g. after an overflow
+			if(!(cqe.flags & IORING_CQE_F_MORE)){
+				arm(fd, find->second);
+			}
+			return true;
+		}
+	public:
+		UringBackend(int fd, const ::io_uring_params& params, void* r, size_t r_size, ::io_uring_sqe* s, size_t s_size):
+			ring_fd{fd},
+			ring{r},
+			ring_size{r_size},
+			sqes{s},
+			sqes_size{s_size},
+			sq_local_tail{0}
+		{
+			uint8_t* base = static_cast<uint8_t*>(ring);
+			sq_head = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+			sq_tail = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+			sq_mask = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+			sq_entries = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_entries);
+			sq_array = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+			sq_local_tail = *sq_tail;
+
+			cq_head = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+			cq_tail = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+			cq_mask = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+			cqes = reinterpret_cast<::io_uring_cqe*>(base + params.cq_off.cqes);
+		}
+
+		~UringBackend(){
+			::munmap(sqes, sqes_size);
+			::munmap(ring, ring_size);
+			::close(ring_fd);
+		}
+
+		int wait(PollEvent* events, size_t max_events, int timeout_ms) override {
+			__atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+
+			unsigned flags = 0;
+			unsigned min_complete = 0;
+			::io_uring_getevents_arg arg;
+			std::memset(&arg, 0, sizeof(arg));
+			struct ::__kernel_timespec ts;
+			if(timeout_ms != 0 && !completionsQueued()){
+				flags |= IORING_ENTER_GETEVENTS;
+				min_complete = 1;
+				if(timeout_ms > 0){
+					ts.tv_sec = timeout_ms / 1000;
+					ts.tv_nsec = static_cast<long long>(timeout_ms % 1000) * 1000000;
+					arg.ts = reinterpret_cast<uint64_t>(&ts);
+					flags |= IORING_ENTER_EXT_ARG;
+				}
+			}
+
+			int error = 0;
+			unsigned pending = pendingSubmissions();
+			if(pending > 0 || min_complete > 0){
+				if(enter(pending, min_complete, flags, (flags & IORING_ENTER_EXT_ARG) ? &arg : nullptr, sizeof(arg)) < 0){
+					error = errno;
+				}
+			}
+
+			size_t n = 0;
+			// Arming again may reap more, so the completions are copied and consumed one by one
+			size_t handled = 0;
+			for(; handled < reaped.size() && n < max_events; ++handled){
+				const ::io_uring_cqe cqe = reaped[handled];
+				if(handle(cqe, events[n])){
+					++n;
+				}
+			}
+			reaped.erase(reaped.begin(), reaped.begin() + static_cast<std::ptrdiff_t>(handled));
+			while(reaped.empty() && n < max_events){
+				const unsigned head = *cq_head;
+				if(head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)){
+					break;
+				}
+				const ::io_uring_cqe cqe = cqes[head & cq_mask];
+				__atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+				if(handle(cqe, events[n])){
+					++n;
+				}
+			}
+
+			if(n == 0 && error != 0 && error != ETIME && error != EBUSY){
+				return -error;
+			}
+			return static_cast<int>(n);
+		}
+
+		bool add(int fd, uint32_t mask, uint32_t generation) override {
+			Subscription sub{(static_cast<uint64_t>(generation) << 32) | static_cast<uint32_t>(fd), mask};
+			polls[fd] = sub;
+			arm(fd, sub);
+			return true;
+		}
+
+		void remove(int fd) override {
+			auto find = polls.find(fd);
+			if(find == polls.end()){
+				return;
+			}
+			::io_uring_sqe* sqe = nextSqe();
+			sqe->opcode = IORING_OP_POLL_REMOVE;
+			sqe->fd = -1;
+			sqe->addr = find->second.user_data;
+			sqe->user_data = uring_remove_data;
+			polls.erase(find);
+		}
+
+		const char* name() const override {
+			return "io_uring";
+		}
+	};
+
+	namespace {
+		/*
+		 * Arms a multishot poll on a pipe and checks that it reports data.
+		 * Kernels before 5.13 reject it.
+		 */
+		bool selfTest(PollBackend& backend){
+			int fds[2];
+			if(::pipe2(fds, O_CLOEXEC | O_NONBLOCK) != 0){
+				return false;
+			}
+			bool working = false;
+			if(backend.add(fds[0], EPOLLIN | EPOLLET, 1) && ::write(fds[1], "x", 1) == 1){
+				PollEvent events[4];
+				int n = backend.wait(events, 4, 100);
+				working = n == 1 && events[0].fd == fds[0] && events[0].mask == EPOLLIN && events[0].generation == 1;
+			}
+			backend.remove(fds[0]);
+			::close(fds[0]);
+			::close(fds[1]);
+			PollEvent events[4];
+			backend.wait(events, 4, 0);
+			return working;
+		}
+	}
+
+	std::unique_ptr<PollBackend> createUringBackend(){
+		::io_uring_params params;
+		std::memset(&params, 0, sizeof(params));
+		int fd = static_cast<int>(::syscall(__NR_io_uring_setup, uring_entries, &params));
+		if(fd < 0){
+			return nullptr;
+		}
+		const uint32_t needed = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+		if((params.features & needed) != needed){
+			::close(fd);
+			return nullptr;
+		}
+
+		size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(::io_uring_cqe);
+		size_t ring_size = std::max(sq_size, cq_size);
+		void* ring = ::mmap(nullptr, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+		if(ring == MAP_FAILED){
+			::close(fd);
+			return nullptr;
+		}
+		size_t sqes_size = params.sq_entries * sizeof(::io_uring_sqe);
+		void* sqes = ::mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+		if(sqes == MAP_FAILED){
+			::munmap(ring, ring_size);
+			::close(fd);
+			return nullptr;
+		}
+
+		auto backend = std::make_unique<UringBackend>(fd, params, ring, ring_size, static_cast<::io_uring_sqe*>(sqes), sqes_size);
+		if(!selfTest(*backend)){
+			return nullptr;
+		}
+		return backend;
+	}
+}
+
+#else
+
+namespace dvr {
+	std::unique_ptr<PollBackend> createUringBackend(){
+		return nullptr;
+	}
+}
+
+#endif
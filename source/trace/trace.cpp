@@ -0,0 +1,176 @@
+#include "trace.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace dvr {
+#ifdef DVR_TRACE_ENABLED
+	// Per thread. 512KiB of records
+	const size_t trace_ring_size = 1 << 14;
+
+	namespace {
+		struct TraceRing {
+			std::array<TraceRecord, trace_ring_size> records;
+			// Total records ever written. Only the owning thread writes
+			std::atomic<uint64_t> head{0};
+			uint32_t thread;
+		};
+
+		class TraceRegistry {
+		private:
+			std::mutex mutex;
+			std::vector<TraceRing*> rings;
+			uint32_t next_thread = 0;
+		public:
+			void attach(TraceRing& ring){
+				std::lock_guard<std::mutex> lock{mutex};
+				ring.thread = next_thread++;
+				rings.push_back(&ring);
+			}
+
+			void detach(TraceRing& ring){
+				std::lock_guard<std::mutex> lock{mutex};
+				for(auto iter = rings.begin(); iter != rings.end(); ++iter){
+					if(*iter == &ring){
+						rings.erase(iter);
+						break;
+					}
+				}
+			}
+
+			/*
+			 * Other threads may keep writing while their ring is copied.
+			 * Records which are overwritten during the dump can be torn.
+			 */
+			bool dump(std::ofstream& file){
+				std::lock_guard<std::mutex> lock{mutex};
+				uint32_t thread_count = static_cast<uint32_t>(rings.size());
+				file.write(reinterpret_cast<const char*>(&thread_count), sizeof(thread_count));
+				for(const TraceRing* ring : rings){
+					uint64_t head = ring->head.load(std::memory_order_acquire);
+					uint64_t begin = head > trace_ring_size ? head - trace_ring_size : 0;
+					uint32_t count = static_cast<uint32_t>(head - begin);
+					file.write(reinterpret_cast<const char*>(&ring->thread), sizeof(ring->thread));
+					file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+					for(uint64_t i = begin; i < head; ++i){
+						file.write(reinterpret_cast<const char*>(&ring->records[i % trace_ring_size]), sizeof(TraceRecord));
+					}
+				}
+				return file.good();
+			}
+		};
+
+		TraceRegistry& registry(){
+			static TraceRegistry trace_registry;
+			return trace_registry;
+		}
+
+		class LocalRing {
+		public:
+			// Too large for the static TLS block
+			std::unique_ptr<TraceRing> ring;
+
+			LocalRing():
+				ring{std::make_unique<TraceRing>()}
+			{
+				registry().attach(*ring);
+			}
+
+			~LocalRing(){
+				registry().detach(*ring);
+			}
+		};
+
+		TraceRing& localRing(){
+			static thread_local LocalRing local_ring;
+			return *local_ring.ring;
+		}
+
+		const char* eventName(size_t event){
+			static const char* names[static_cast<size_t>(TraceEvent::COUNT)] = {
+				"poll",
+				"poll",
+				"fd_notify",
+				"fd_notify",
+				"connection_notify",
+				"connection_notify",
+				"read_request",
+				"write_request",
+				"read_response",
+				"write_response"
+			};
+			return names[event];
+		}
+
+		char eventPhase(size_t event){
+			switch(static_cast<TraceEvent>(event)){
+				case TraceEvent::POLL_BEGIN:
+				case TraceEvent::FD_NOTIFY_BEGIN:
+				case TraceEvent::CONNECTION_NOTIFY_BEGIN:
+					return 'B';
+				case TraceEvent::POLL_END:
+				case TraceEvent::FD_NOTIFY_END:
+				case TraceEvent::CONNECTION_NOTIFY_END:
+					return 'E';
+				default:
+					return 'i';
+			}
+		}
+	}
+
+	void trace(TraceEvent event, uint64_t id, uint64_t arg0, uint32_t arg1){
+		TraceRing& ring = localRing();
+		uint64_t head = ring.head.load(std::memory_order_relaxed);
+		TraceRecord& record = ring.records[head % trace_ring_size];
+		record.timestamp_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+		record.id = id;
+		record.arg0 = arg0;
+		record.arg1 = arg1;
+		record.event = static_cast<uint32_t>(event);
+		ring.head.store(head + 1, std::memory_order_release);
+	}
+
+	bool traceEnabled(){
+		return true;
+	}
+
+	bool dumpTrace(const std::string& path){
+		std::ofstream file{path, std::ios::binary | std::ios::trunc};
+		if(!file){
+			return false;
+		}
+		const uint32_t version = 1;
+		file.write("DVRTRACE", 8);
+		file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+
+		uint32_t event_count = static_cast<uint32_t>(TraceEvent::COUNT);
+		file.write(reinterpret_cast<const char*>(&event_count), sizeof(event_count));
+		for(uint32_t i = 0; i < event_count; ++i){
+			std::string name = eventName(i);
+			char phase = eventPhase(i);
+			uint8_t name_size = static_cast<uint8_t>(name.size());
+			file.write(reinterpret_cast<const char*>(&i), sizeof(i));
+			file.write(&phase, 1);
+			file.write(reinterpret_cast<const char*>(&name_size), 1);
+			file.write(name.data(), name_size);
+		}
+
+		return registry().dump(file);
+	}
+#else
+	void trace(TraceEvent, uint64_t, uint64_t, uint32_t){}
+
+	bool traceEnabled(){
+		return false;
+	}
+
+	bool dumpTrace(const std::string&){
+		return false;
+	}
+#endif
+}
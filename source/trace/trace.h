@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+/*
+ * Trace points only exist when compiled with DVR_TRACE_ENABLED (scons trace=yes).
+ * Otherwise DVR_TRACE expands to nothing and the arguments aren't evaluated.
+ *
+ * Each thread writes fixed size records into its own ring. The oldest
+ * records are overwritten. Convert a dump with tools/trace2chrome.py.
+ */
+#ifdef DVR_TRACE_ENABLED
+#define DVR_TRACE(event, id, arg0, arg1) ::dvr::trace(::dvr::TraceEvent::event, static_cast<uint64_t>(id), static_cast<uint64_t>(arg0), static_cast<uint32_t>(arg1))
+#else
+#define DVR_TRACE(event, id, arg0, arg1) do {} while(0)
+#endif
+
+namespace dvr {
+	/*
+	 * Events ending with BEGIN and END are durations, all others are instants
+	 */
+	enum class TraceEvent : uint32_t {
+		POLL_BEGIN,
+		POLL_END,
+		FD_NOTIFY_BEGIN,
+		FD_NOTIFY_END,
+		CONNECTION_NOTIFY_BEGIN,
+		CONNECTION_NOTIFY_END,
+		READ_REQUEST,
+		WRITE_REQUEST,
+		READ_RESPONSE,
+		WRITE_RESPONSE,
+		COUNT
+	};
+
+	struct TraceRecord {
+		uint64_t timestamp_ns;
+		// fd or connection id
+		uint64_t id;
+		uint64_t arg0;
+		uint32_t arg1;
+		uint32_t event;
+	};
+	static_assert(sizeof(TraceRecord) == 32, "Trace records are dumped as is");
+
+	void trace(TraceEvent event, uint64_t id, uint64_t arg0, uint32_t arg1);
+
+	bool traceEnabled();
+	/*
+	 * Writes the rings of all threads into a file.
+	 * Format, all values in host byte order
+	 * "DVRTRACE", u32 version(=1)
+	 * u32 event count, for each: u32 id, char phase (B, E or i), u8 name size, name
+	 * u32 thread count, for each: u32 thread, u32 record count, TraceRecord...
+	 * Returns false if tracing is compiled out or the file can't be written.
+	 */
+	bool dumpTrace(const std::string& path);
+}
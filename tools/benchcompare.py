@@ -0,0 +1,53 @@
+#!/usr/bin/env python3
+#
+# Compares two reports of bin/devoured-bench, e.g. of two commits.
+#
+# usage: benchcompare.py <before> <after>
+#
+# Reports consist of "<name> <value>" lines. The unit is the suffix of the
+# name. For "_per_s" and "_rps" metrics more is better, for all others less
+# is better.
+
+import sys
+
+
+def load(path):
+    values = {}
+    order = []
+    with open(path) as report:
+        for line in report:
+            parts = line.split()
+            if len(parts) != 2 or line.startswith("#"):
+                continue
+            try:
+                values[parts[0]] = float(parts[1])
+            except ValueError:
+                continue
+            order.append(parts[0])
+    return order, values
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.stderr.write("usage: benchcompare.py <before> <after>\n")
+        return 1
+    order, before = load(sys.argv[1])
+    _, after = load(sys.argv[2])
+
+    print("{:<36} {:>14} {:>14} {:>9}".format("metric", "before", "after", "change"))
+    for name in order:
+        if name not in after or name == "iterations":
+            continue
+        old, new = before[name], after[name]
+        change = (new - old) / old * 100.0 if old else 0.0
+        better = change > 0 if name.endswith(("_per_s", "_rps")) else change < 0
+        mark = "" if abs(change) < 5.0 else (" +" if better else " -")
+        print("{:<36} {:>14.1f} {:>14.1f} {:>8.1f}%{}".format(name, old, new, change, mark))
+    for name in after:
+        if name not in before:
+            print("{:<36} {:>14} {:>14.1f}".format(name, "-", after[name]))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+#
+# Converts a trace dump of devoured into the Chrome trace event format.
+# Open the result in chrome://tracing or https://ui.perfetto.dev
+#
+# usage: trace2chrome.py <dump> [output.json]
+#
+# The dump format is described in source/trace/trace.h
+
+import json
+import struct
+import sys
+
+
+def read(fmt, data, offset):
+    size = struct.calcsize(fmt)
+    return struct.unpack_from(fmt, data, offset), offset + size
+
+
+def convert(data):
+    if data[:8] != b"DVRTRACE":
+        raise ValueError("Not a devoured trace dump")
+    (version,), offset = read("=I", data, 8)
+    if version != 1:
+        raise ValueError("Unsupported trace version " + str(version))
+
+    events = {}
+    (event_count,), offset = read("=I", data, offset)
+    for _ in range(event_count):
+        (event_id, phase, name_size), offset = read("=IcB", data, offset)
+        name = data[offset:offset + name_size].decode()
+        offset += name_size
+        events[event_id] = (name, phase.decode())
+
+    trace_events = []
+    (thread_count,), offset = read("=I", data, offset)
+    for _ in range(thread_count):
+        (thread, record_count), offset = read("=II", data, offset)
+        for _ in range(record_count):
+            (timestamp, ident, arg0, arg1, event), offset = read("=QQQII", data, offset)
+            name, phase = events.get(event, ("event_" + str(event), "i"))
+            entry = {
+                "name": name,
+                "ph": phase,
+                "ts": timestamp / 1000.0,
+                "pid": 0,
+                "tid": thread,
+            }
+            if phase != "E":
+                entry["args"] = {"id": ident, "arg0": arg0, "arg1": arg1}
+            if phase == "i":
+                entry["s"] = "t"
+            trace_events.append(entry)
+
+    trace_events.sort(key=lambda e: e["ts"])
+    return {"traceEvents": trace_events, "displayTimeUnit": "ns"}
+
+
+def main(argv):
+    if len(argv) < 2:
+        print("usage: " + argv[0] + " <dump> [output.json]", file=sys.stderr)
+        return 1
+    with open(argv[1], "rb") as dump:
+        result = convert(dump.read())
+    if len(argv) > 2:
+        with open(argv[2], "w") as output:
+            json.dump(result, output)
+    else:
+        json.dump(result, sys.stdout)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))